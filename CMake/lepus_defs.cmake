@@ -4,6 +4,10 @@ SET(PPU_Y 2)
 set(PATH_DEFAULT \"/media\")
 set(FILE_SYSTEM \"/dev/mmcblk0p2\")
 
+# Only 32 MiB of RAM.
+set(IMAGE_CACHE_KB 1024)
+set(ZOOM_IMAGE_KB 8192)
+
 set(CMDR_KEY_UP SDLK_UP) # Up
 set(CMDR_KEY_RIGHT SDLK_RIGHT) # Right
 set(CMDR_KEY_DOWN SDLK_DOWN) # Down
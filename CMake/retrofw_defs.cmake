@@ -6,6 +6,10 @@ set(PATH_DEFAULT getenv\(\"HOME\"\))
 set(PATH_DEFAULT_RIGHT \"/media/mmcblk1p1\")
 set(PATH_DEFAULT_RIGHT_FALLBACK \"/home/retrofw\")
 
+# Only 32 MiB of RAM.
+set(IMAGE_CACHE_KB 1024)
+set(ZOOM_IMAGE_KB 8192)
+
 set(CMDR_KEY_UP SDLK_UP) # Up
 set(CMDR_KEY_RIGHT SDLK_RIGHT) # Right
 set(CMDR_KEY_DOWN SDLK_DOWN) # Down
@@ -34,7 +34,7 @@ make_buildroot() {
   if [[ "$TARGET" == retrofw ]]; then
     deps+=(freetype)
   else
-    deps+=(sdl_ttf sdl_gfx)
+    deps+=(sdl_ttf)
   fi
   if (( ${#deps[@]} )); then
     make "${deps[@]}" BR2_JLEVEL=0
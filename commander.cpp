@@ -1,16 +1,22 @@
 #include "commander.h"
 
+#include <cerrno>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <functional>
 #include <iostream>
 #include <sstream>
 
+#include "completion.h"
 #include "def.h"
 #include "dialog.h"
 #include "error_dialog.h"
 #include "file_info.h"
 #include "fileutils.h"
+#include "hex_viewer.h"
 #include "image_viewer.h"
+#include "imageutils.h"
 #include "keyboard.h"
 #include "resourceManager.h"
 #include "screen.h"
@@ -258,6 +264,20 @@ bool CCommander::mouseDown(int button, int x, int y)
     return changed;
 }
 
+namespace {
+
+// The names in the panel's directory, for completion.
+std::vector<std::string> listedNames(const CPanel &panel)
+{
+    std::vector<std::string> names;
+    // The first item is "..".
+    for (unsigned int i = 1; i < panel.getNbItems(); ++i)
+        names.push_back(panel.getItem(i).m_name);
+    return names;
+}
+
+} // namespace
+
 bool CCommander::itemMenu() const
 {
     if (m_panelSource->isDirectoryHighlighted())
@@ -327,6 +347,7 @@ const bool CCommander::openCopyMenu(void) const
             l_dialog.addOption("Rename");
             handlers.push_back([&]() {
                 CKeyboard l_keyboard(m_panelSource->getHighlightedItem());
+                l_keyboard.setCompleter(Completer::forNames(listedNames(*m_panelSource)));
                 if (l_keyboard.execute() == 1 && !l_keyboard.getInputText().empty() && l_keyboard.getInputText() != m_panelSource->getHighlightedItem())
                 {
                     File_utils::renameFile(m_panelSource->getHighlightedItemFull(), m_panelSource->getCurrentPath() + (m_panelSource->getCurrentPath() == "/" ? "" : "/") + l_keyboard.getInputText());
@@ -381,6 +402,41 @@ const bool CCommander::openCopyMenu(void) const
     return false;
 }
 
+bool CCommander::goToPath(void)
+{
+    // Completed from both panels' recent directories.
+    std::vector<std::string> l_recent = m_panelSource->getRecentPaths();
+    const std::vector<std::string> &l_recentTarget = m_panelTarget->getRecentPaths();
+    l_recent.insert(l_recent.end(), l_recentTarget.begin(), l_recentTarget.end());
+    const std::string &l_currentPath = m_panelSource->getCurrentPath();
+    CKeyboard l_keyboard(l_currentPath == "/" ? l_currentPath : l_currentPath + "/");
+    l_keyboard.setCompleter(Completer::forPaths(l_recent));
+    if (l_keyboard.execute() != 1 || l_keyboard.getInputText().empty())
+        return false;
+    std::string l_path = l_keyboard.getInputText();
+    // Relative to the current directory. Resolved so that the panel can
+    // go up from it, and so that one directory has a single entry in the
+    // recent paths.
+    if (l_path[0] != '/')
+        l_path = l_currentPath + (l_currentPath == "/" ? "" : "/") + l_path;
+    char *l_resolved = realpath(l_path.c_str(), nullptr);
+    if (l_resolved == nullptr)
+    {
+        ErrorDialog("Unable to open directory", l_path + "\n" + std::strerror(errno));
+        return false;
+    }
+    l_path = l_resolved;
+    std::free(l_resolved);
+    if (l_path == l_currentPath)
+        return false;
+    if (!FileInfo::Get(l_path).directory() || !m_panelSource->open(l_path))
+    {
+        ErrorDialog("Unable to open directory", l_path);
+        return false;
+    }
+    return true;
+}
+
 const bool CCommander::openSystemMenu(void)
 {
     bool l_ret(false);
@@ -395,6 +451,7 @@ const bool CCommander::openSystemMenu(void)
         l_dialog.addOption("Select all");
         l_dialog.addOption("Select none");
         l_dialog.addOption("New directory");
+        l_dialog.addOption("Go to path");
         l_dialog.addOption("Disk info");
         l_dialog.addOption("Quit");
         l_dialog.init();
@@ -414,6 +471,7 @@ const bool CCommander::openSystemMenu(void)
             // New dir
             {
                 CKeyboard l_keyboard("");
+                l_keyboard.setCompleter(Completer::forNames(listedNames(*m_panelSource)));
                 if (l_keyboard.execute() == 1 && !l_keyboard.getInputText().empty())
                 {
                     File_utils::makeDirectory(m_panelSource->getCurrentPath() + (m_panelSource->getCurrentPath() == "/" ? "" : "/") + l_keyboard.getInputText());
@@ -423,10 +481,14 @@ const bool CCommander::openSystemMenu(void)
             }
             break;
         case 4:
+            // Go to path
+            l_ret = goToPath();
+            break;
+        case 5:
             // Disk info
             File_utils::diskInfo();
             break;
-        case 5:
+        case 6:
             // Quit
             m_retVal = -1;
             break;
@@ -471,20 +533,28 @@ OpenFileResult OpenFileDialog(const std::string &path,
 
 void CCommander::ViewFile(std::string &&path) const
 {
-    // Check size
-    constexpr std::size_t kMaxFileSize = 16777216; // = 16 MB
-    const auto file_size = File_utils::getFileSize(path);
-    if (file_size > kMaxFileSize) {
-        ErrorDialog(path, "Error:", "File too large (>16 MiB)");
+    // Baseline JPEGs and non-interlaced PNGs are downscaled while decoding,
+    // and text and binary files are read lazily, so none of them has a size
+    // limit. Other images are decoded within a memory budget.
+    {
+        ImageViewer image_viewer(m_panelSource);
+        if (image_viewer.ok()) {
+            image_viewer.execute();
+            return;
+        }
+    }
+    if (SDL_utils::isSupportedImageExt(File_utils::getLowercaseFileExtension(path))
+        && !Image_utils::fitsFullDecode(path, SDL_utils::fullDecodeBudget())) {
+        ErrorDialog("Image too large to decode", path);
         return;
     }
-    ImageViewer image_viewer(m_panelSource);
-    if (image_viewer.ok()) {
-        image_viewer.execute();
+    if (HexViewer::isBinaryFile(path)) {
+        HexViewer hex_viewer(path);
+        if (hex_viewer.ok()) hex_viewer.execute();
         return;
     }
-
-    TextViewer(path).execute();
+    TextViewer text_viewer(path);
+    if (text_viewer.ok()) text_viewer.execute();
 }
 
 void CCommander::openExecuteMenu(void) const
@@ -59,6 +59,9 @@ class CCommander : public CWindow
     // Open the selection menu
     const bool openSystemMenu(void);
 
+    // Prompt for a directory to open in the source panel
+    bool goToPath(void);
+
     // Repeated actions.
     bool actionUp();
     bool actionDown();
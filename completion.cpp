@@ -0,0 +1,95 @@
+#include "completion.h"
+
+#include <algorithm>
+#include <cctype>
+
+#include "fileLister.h"
+
+namespace {
+
+std::string toLower(std::string s)
+{
+    for (char &c : s) c = std::tolower(static_cast<unsigned char>(c));
+    return s;
+}
+
+} // namespace
+
+PrefixIndex::PrefixIndex(const std::vector<std::string> &names)
+{
+    entries_.reserve(names.size());
+    for (const std::string &name : names)
+        entries_.emplace_back(toLower(name), name);
+    std::sort(entries_.begin(), entries_.end());
+    entries_.erase(
+        std::unique(entries_.begin(), entries_.end()), entries_.end());
+}
+
+std::vector<std::string> PrefixIndex::find(
+    const std::string &prefix, std::size_t limit) const
+{
+    std::vector<std::string> result;
+    const std::string key = toLower(prefix);
+    auto it = std::lower_bound(entries_.begin(), entries_.end(),
+        std::make_pair(key, std::string()));
+    for (; it != entries_.end() && result.size() < limit; ++it) {
+        if (it->first.compare(0, key.size(), key) != 0) break;
+        result.push_back(it->second);
+    }
+    return result;
+}
+
+std::unique_ptr<Completer> Completer::forNames(
+    const std::vector<std::string> &names)
+{
+    return std::unique_ptr<Completer> { new Completer(
+        /*paths=*/false, names) };
+}
+
+std::unique_ptr<Completer> Completer::forPaths(
+    const std::vector<std::string> &recent_dirs)
+{
+    return std::unique_ptr<Completer> { new Completer(
+        /*paths=*/true, recent_dirs) };
+}
+
+std::vector<Completer::Suggestion> Completer::complete(
+    const std::string &text, std::size_t limit)
+{
+    std::vector<Suggestion> result;
+    if (text.empty() && !paths_) return result;
+    // One more, in case it is the text itself.
+    for (std::string &name : index_.find(text, limit + 1)) {
+        if (name == text) continue;
+        result.push_back(Suggestion { name, name });
+    }
+    const std::size_t slash = text.rfind('/');
+    if (paths_ && slash != std::string::npos) {
+        const std::string dir = text.substr(0, slash + 1);
+        if (dir != dir_) {
+            dir_ = dir;
+            std::vector<std::string> names;
+            CFileLister lister;
+            if (lister.list(dir)) {
+                // The first one is "..".
+                for (unsigned int i = 1; i < lister.getNbDirs(); ++i)
+                    names.push_back(lister[i].m_name);
+            }
+            dir_index_ = PrefixIndex(names);
+        }
+        for (const std::string &name :
+            dir_index_.find(text.substr(slash + 1), limit)) {
+            const std::string path = dir + name;
+            // Already suggested as a recent directory.
+            const bool recent = std::find_if(result.begin(), result.end(),
+                                    [&path](const Suggestion &s) {
+                                        return s.text == path;
+                                    })
+                != result.end();
+            if (recent || path + "/" == text) continue;
+            result.push_back(Suggestion { path + "/", name + "/" });
+        }
+    }
+    if (result.size() > limit) result.resize(limit);
+    return result;
+}
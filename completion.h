@@ -0,0 +1,69 @@
+#ifndef COMPLETION_H_
+#define COMPLETION_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A sorted array of names, searched by prefix ignoring ASCII case.
+ */
+class PrefixIndex {
+  public:
+    PrefixIndex() = default;
+    explicit PrefixIndex(const std::vector<std::string> &names);
+
+    // Up to `limit` names that start with `prefix`, in order.
+    std::vector<std::string> find(
+        const std::string &prefix, std::size_t limit) const;
+
+  private:
+    // The lowercase name and the name, sorted.
+    std::vector<std::pair<std::string, std::string>> entries_;
+};
+
+/**
+ * @brief Suggests completions for the text typed in `CKeyboard`.
+ *
+ * Names are completed from a fixed list, e.g. the current directory's
+ * listing. Paths are completed from the recently visited directories, and
+ * their last component from the subdirectories of the directory before it,
+ * which is listed once when the text moves into it.
+ */
+class Completer {
+  public:
+    struct Suggestion {
+        // Replaces the whole text.
+        std::string text;
+        // What is shown, e.g. only the completed path component.
+        std::string label;
+    };
+
+    static std::unique_ptr<Completer> forNames(
+        const std::vector<std::string> &names);
+    static std::unique_ptr<Completer> forPaths(
+        const std::vector<std::string> &recent_dirs);
+
+    // Up to `limit` suggestions for `text`, which start with it ignoring
+    // case.
+    std::vector<Suggestion> complete(
+        const std::string &text, std::size_t limit);
+
+  private:
+    Completer(bool paths, const std::vector<std::string> &names)
+        : paths_(paths)
+        , index_(names)
+    {
+    }
+
+    bool paths_;
+    // The names, or the recently visited directories.
+    PrefixIndex index_;
+    // For paths, the last directory listed and its subdirectories.
+    std::string dir_;
+    PrefixIndex dir_index_;
+};
+
+#endif // COMPLETION_H_
@@ -0,0 +1,686 @@
+#include "compressed_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <unistd.h>
+#include <utility>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+// Compressed data is read in chunks of this size.
+constexpr std::size_t kInputBytes = 64 * 1024;
+
+// The minimum amount of decompressed data between two checkpoints, at
+// first. It doubles whenever the checkpoints are thinned out.
+constexpr std::uint64_t kCheckpointSpan = 1024 * 1024;
+
+// Bounds the memory taken by the gzip windows to a few MiB at worst, when
+// the data does not compress.
+constexpr std::size_t kMaxCheckpoints = 128;
+
+// `read` decompresses and caches chunks of this size.
+constexpr std::size_t kChunkBytes = 64 * 1024;
+constexpr std::size_t kMaxChunks = 32;
+
+} // namespace
+
+class CompressedFile::Decoder {
+  public:
+    explicit Decoder(int fd)
+        : fd_(fd)
+        , in_(kInputBytes)
+    {
+    }
+    virtual ~Decoder() = default;
+
+    bool ok() const { return ok_; }
+
+    // Makes this decoder record checkpoints as it streams the file.
+    void setOnCheckpoint(std::function<void(Checkpoint)> on_checkpoint)
+    {
+        on_checkpoint_ = std::move(on_checkpoint);
+    }
+
+    // Resumes decompressing from the checkpoint.
+    bool restore(const Checkpoint &checkpoint)
+    {
+        seek(checkpoint.in);
+        out_ = checkpoint.out;
+        done_ = !reset(checkpoint);
+        return !done_;
+    }
+
+    // Decompresses up to `len` bytes into `out`. Returns less than `len`
+    // only at the end of the data or on an error.
+    std::size_t decode(char *out, std::size_t len)
+    {
+        std::size_t total = 0;
+        while (total < len && !done_)
+            total += decodeSome(out + total, len - total);
+        return total;
+    }
+
+    // The offset in the decompressed data.
+    std::uint64_t position() const { return out_; }
+
+    // Takes the next checkpoints `span` apart, from the last one.
+    void setCheckpointSpan(std::uint64_t span)
+    {
+        next_checkpoint_ += span - checkpoint_span_;
+        checkpoint_span_ = span;
+    }
+
+  protected:
+    // Resets the format specific state to resume from the checkpoint.
+    // The input is already positioned at `checkpoint.in`.
+    virtual bool reset(const Checkpoint &checkpoint) = 0;
+
+    // Decompresses some of the next bytes into `out`, advancing `out_`.
+    // Sets `done_` at the end of the data or on an error.
+    virtual std::size_t decodeSome(char *out, std::size_t len) = 0;
+
+    // Makes the next compressed bytes available at `next_in_`.
+    // Returns false at the end of the file.
+    bool fill()
+    {
+        if (avail_in_ > 0) return true;
+        ssize_t n;
+        do {
+            n = pread(fd_, in_.data(), in_.size(),
+                static_cast<off_t>(in_offset_));
+        } while (n == -1 && errno == EINTR);
+        if (n <= 0) return false;
+        next_in_ = in_.data();
+        avail_in_ = static_cast<std::size_t>(n);
+        in_offset_ += static_cast<std::uint64_t>(n);
+        return true;
+    }
+
+    bool readBytes(unsigned char *out, std::size_t len)
+    {
+        while (len > 0) {
+            if (!fill()) return false;
+            const std::size_t n = std::min(len, avail_in_);
+            std::copy(next_in_, next_in_ + n, out);
+            next_in_ += n;
+            avail_in_ -= n;
+            out += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    void seek(std::uint64_t offset)
+    {
+        in_offset_ = offset;
+        avail_in_ = 0;
+    }
+
+    // The offset in the file of the next compressed byte.
+    std::uint64_t inPosition() const { return in_offset_ - avail_in_; }
+
+    bool streaming() const { return static_cast<bool>(on_checkpoint_); }
+
+    // Whether a checkpoint should be taken at the current position, if the
+    // format allows it.
+    bool wantsCheckpoint() const
+    {
+        return streaming() && out_ >= next_checkpoint_;
+    }
+
+    void addCheckpoint(Checkpoint checkpoint)
+    {
+        next_checkpoint_ = out_ + checkpoint_span_;
+        on_checkpoint_(std::move(checkpoint));
+    }
+
+    bool ok_ = true;
+    bool done_ = false;
+    std::uint64_t out_ = 0;
+    const unsigned char *next_in_ = nullptr;
+    std::size_t avail_in_ = 0;
+
+  private:
+    int fd_;
+    std::vector<unsigned char> in_;
+    // The offset in the file after the bytes in `in_`.
+    std::uint64_t in_offset_ = 0;
+    std::function<void(Checkpoint)> on_checkpoint_;
+    std::uint64_t checkpoint_span_ = kCheckpointSpan;
+    // The start is a checkpoint already.
+    std::uint64_t next_checkpoint_ = kCheckpointSpan;
+};
+
+namespace {
+
+#ifdef HAVE_ZLIB
+class GzipDecoder : public CompressedFile::Decoder {
+  public:
+    explicit GzipDecoder(int fd)
+        : Decoder(fd)
+    {
+        std::memset(&strm_, 0, sizeof(strm_));
+        ok_ = inflateInit2(&strm_, kGzipWindowBits) == Z_OK;
+    }
+    ~GzipDecoder() override
+    {
+        if (ok_) inflateEnd(&strm_);
+    }
+
+  protected:
+    bool reset(const CompressedFile::Checkpoint &checkpoint) override
+    {
+        // Deflate data resumed in the middle of a member has no header.
+        raw_ = !checkpoint.window.empty();
+        std::vector<unsigned char> window;
+        if (raw_) {
+            window.resize(kWindowBytes);
+            uLongf size = static_cast<uLongf>(window.size());
+            if (uncompress(window.data(), &size, checkpoint.window.data(),
+                    static_cast<uLong>(checkpoint.window.size()))
+                != Z_OK)
+                return false;
+            window.resize(size);
+        }
+        if (inflateReset2(&strm_, raw_ ? -kWindowBits : kGzipWindowBits)
+            != Z_OK)
+            return false;
+        if (checkpoint.state != 0) {
+            // The block starts within the previous byte.
+            seek(checkpoint.in - 1);
+            unsigned char byte;
+            if (!readBytes(&byte, 1)) return false;
+            inflatePrime(
+                &strm_, checkpoint.state, byte >> (8 - checkpoint.state));
+        }
+        if (raw_
+            && inflateSetDictionary(&strm_, window.data(),
+                   static_cast<uInt>(window.size()))
+                != Z_OK)
+            return false;
+        if (streaming()) window_ = std::move(window);
+        return true;
+    }
+
+    std::size_t decodeSome(char *out, std::size_t len) override
+    {
+        if (!fill()) {
+            done_ = true;
+            return 0;
+        }
+        strm_.next_in = const_cast<Bytef *>(next_in_);
+        strm_.avail_in = static_cast<uInt>(avail_in_);
+        strm_.next_out = reinterpret_cast<Bytef *>(out);
+        strm_.avail_out = static_cast<uInt>(len);
+        // Stops between deflate blocks, where checkpoints can be taken.
+        const int ret = inflate(&strm_, streaming() ? Z_BLOCK : Z_NO_FLUSH);
+        next_in_ = strm_.next_in;
+        avail_in_ = strm_.avail_in;
+        const std::size_t n = len - strm_.avail_out;
+        out_ += n;
+        if (streaming()) remember(out, n);
+        if (ret == Z_STREAM_END) {
+            nextMember();
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            // Shows what could be decompressed of a corrupt file.
+            done_ = true;
+        } else if ((strm_.data_type & 128) != 0
+            && (strm_.data_type & 64) == 0 && wantsCheckpoint()) {
+            // Between two blocks, not after the last one.
+            std::vector<unsigned char> window;
+            if (compressWindow(&window)) {
+                addCheckpoint(CompressedFile::Checkpoint { out_,
+                    inPosition(), strm_.data_type & 7, std::move(window) });
+            }
+        }
+        return n;
+    }
+
+  private:
+    // Automatic gzip or zlib header detection.
+    static constexpr int kGzipWindowBits = 15 + 32;
+    static constexpr int kWindowBits = 15;
+    static constexpr std::size_t kWindowBytes = 1 << kWindowBits;
+
+    // Concatenated members are read as one stream, like `gzip -d` does.
+    void nextMember()
+    {
+        if (raw_) {
+            unsigned char trailer[8];
+            if (!readBytes(trailer, sizeof(trailer))) {
+                done_ = true;
+                return;
+            }
+            raw_ = false;
+        }
+        // Trailing garbage ends the data with a decoding error.
+        if (inflateReset2(&strm_, kGzipWindowBits) != Z_OK) done_ = true;
+    }
+
+    // Compresses the last `kWindowBytes` of output into `out`. Text usually
+    // shrinks several times even at the fastest level.
+    bool compressWindow(std::vector<unsigned char> *out) const
+    {
+        const std::size_t size = std::min(window_.size(), kWindowBytes);
+        // An empty window would mark the start of the file.
+        if (size == 0) return false;
+        uLongf out_size = compressBound(static_cast<uLong>(size));
+        out->resize(out_size);
+        if (compress2(out->data(), &out_size,
+                window_.data() + window_.size() - size,
+                static_cast<uLong>(size), Z_BEST_SPEED)
+            != Z_OK)
+            return false;
+        out->resize(out_size);
+        out->shrink_to_fit();
+        return true;
+    }
+
+    // Keeps the last `kWindowBytes` of output, trimming it only once it is
+    // twice as long.
+    void remember(const char *data, std::size_t len)
+    {
+        window_.insert(window_.end(), data, data + len);
+        if (window_.size() >= 2 * kWindowBytes)
+            window_.erase(window_.begin(), window_.end() - kWindowBytes);
+    }
+
+    z_stream strm_;
+    bool raw_ = false;
+    std::vector<unsigned char> window_;
+};
+
+constexpr int GzipDecoder::kGzipWindowBits;
+constexpr int GzipDecoder::kWindowBits;
+constexpr std::size_t GzipDecoder::kWindowBytes;
+#endif // HAVE_ZLIB
+
+#ifdef HAVE_LZMA
+// Parses the xz container to decode each block with its own decoder, as the
+// decoder for the whole stream does not expose where blocks start.
+class XzDecoder : public CompressedFile::Decoder {
+  public:
+    explicit XzDecoder(int fd)
+        : Decoder(fd)
+    {
+    }
+    ~XzDecoder() override
+    {
+        lzma_end(&strm_);
+        lzma_index_end(index_, nullptr);
+    }
+
+  protected:
+    bool reset(const CompressedFile::Checkpoint &checkpoint) override
+    {
+        if (checkpoint.in == 0) {
+            state_ = State::STREAM_HEADER;
+        } else {
+            check_ = static_cast<lzma_check>(checkpoint.state);
+            state_ = State::BLOCK_HEADER;
+        }
+        return true;
+    }
+
+    std::size_t decodeSome(char *out, std::size_t len) override
+    {
+        switch (state_) {
+            case State::STREAM_HEADER: readStreamHeader(); return 0;
+            case State::BLOCK_HEADER: readBlockHeader(); return 0;
+            case State::BLOCK: return decodeBlock(out, len);
+            case State::INDEX: skipIndex(); return 0;
+        }
+        return 0;
+    }
+
+  private:
+    enum class State { STREAM_HEADER, BLOCK_HEADER, BLOCK, INDEX };
+
+    void readStreamHeader()
+    {
+        unsigned char header[LZMA_STREAM_HEADER_SIZE];
+        lzma_stream_flags flags;
+        if (!readBytes(header, sizeof(header))
+            || lzma_stream_header_decode(&flags, header) != LZMA_OK) {
+            done_ = true;
+            return;
+        }
+        check_ = flags.check;
+        state_ = State::BLOCK_HEADER;
+    }
+
+    void readBlockHeader()
+    {
+        if (!fill()) {
+            done_ = true;
+            return;
+        }
+        if (*next_in_ == 0) {
+            // The index follows the last block of the stream.
+            if (lzma_index_decoder(&strm_, &index_, UINT64_MAX) != LZMA_OK)
+                done_ = true;
+            state_ = State::INDEX;
+            return;
+        }
+        const std::uint64_t block_start = inPosition();
+        lzma_filter filters[LZMA_FILTERS_MAX + 1];
+        std::memset(&block_, 0, sizeof(block_));
+        block_.version = 0;
+        block_.check = check_;
+        block_.filters = filters;
+        block_.header_size = lzma_block_header_size_decode(*next_in_);
+        unsigned char header[LZMA_BLOCK_HEADER_SIZE_MAX];
+        if (!readBytes(header, block_.header_size)
+            || lzma_block_header_decode(&block_, nullptr, header) != LZMA_OK) {
+            done_ = true;
+            return;
+        }
+        // The decoder copies the filters, but keeps using `block_`.
+        const lzma_ret ret = lzma_block_decoder(&strm_, &block_);
+        block_.filters = nullptr;
+        for (std::size_t i = 0; filters[i].id != LZMA_VLI_UNKNOWN; ++i)
+            std::free(filters[i].options);
+        if (ret != LZMA_OK) {
+            done_ = true;
+            return;
+        }
+        if (wantsCheckpoint()) {
+            addCheckpoint(CompressedFile::Checkpoint {
+                out_, block_start, static_cast<int>(check_), {} });
+        }
+        state_ = State::BLOCK;
+    }
+
+    std::size_t decodeBlock(char *out, std::size_t len)
+    {
+        if (!fill()) {
+            done_ = true;
+            return 0;
+        }
+        strm_.next_in = next_in_;
+        strm_.avail_in = avail_in_;
+        strm_.next_out = reinterpret_cast<std::uint8_t *>(out);
+        strm_.avail_out = len;
+        const lzma_ret ret = lzma_code(&strm_, LZMA_RUN);
+        next_in_ = strm_.next_in;
+        avail_in_ = strm_.avail_in;
+        const std::size_t n = len - strm_.avail_out;
+        out_ += n;
+        if (ret == LZMA_STREAM_END)
+            state_ = State::BLOCK_HEADER;
+        else if (ret != LZMA_OK)
+            done_ = true;
+        return n;
+    }
+
+    void skipIndex()
+    {
+        if (!fill()) {
+            done_ = true;
+            return;
+        }
+        strm_.next_in = next_in_;
+        strm_.avail_in = avail_in_;
+        strm_.next_out = nullptr;
+        strm_.avail_out = 0;
+        const lzma_ret ret = lzma_code(&strm_, LZMA_RUN);
+        next_in_ = strm_.next_in;
+        avail_in_ = strm_.avail_in;
+        if (ret == LZMA_OK) return;
+        lzma_index_end(index_, nullptr);
+        index_ = nullptr;
+        unsigned char footer[LZMA_STREAM_HEADER_SIZE];
+        if (ret != LZMA_STREAM_END || !readBytes(footer, sizeof(footer))) {
+            done_ = true;
+            return;
+        }
+        // Streams can be concatenated, with zero padding between them.
+        while (fill() && *next_in_ == 0) {
+            ++next_in_;
+            --avail_in_;
+        }
+        if (avail_in_ == 0)
+            done_ = true;
+        else
+            state_ = State::STREAM_HEADER;
+    }
+
+    lzma_stream strm_ = LZMA_STREAM_INIT;
+    lzma_block block_;
+    lzma_index *index_ = nullptr;
+    lzma_check check_ = LZMA_CHECK_NONE;
+    State state_ = State::STREAM_HEADER;
+};
+#endif // HAVE_LZMA
+
+#ifdef HAVE_ZSTD
+class ZstdDecoder : public CompressedFile::Decoder {
+  public:
+    explicit ZstdDecoder(int fd)
+        : Decoder(fd)
+        , dctx_(ZSTD_createDCtx())
+    {
+        ok_ = dctx_ != nullptr;
+    }
+    ~ZstdDecoder() override { ZSTD_freeDCtx(dctx_); }
+
+  protected:
+    bool reset(const CompressedFile::Checkpoint &) override
+    {
+        frame_start_ = true;
+        return !ZSTD_isError(
+            ZSTD_DCtx_reset(dctx_, ZSTD_reset_session_only));
+    }
+
+    std::size_t decodeSome(char *out, std::size_t len) override
+    {
+        if (!fill()) {
+            done_ = true;
+            return 0;
+        }
+        if (frame_start_ && wantsCheckpoint()) {
+            addCheckpoint(
+                CompressedFile::Checkpoint { out_, inPosition(), 0, {} });
+        }
+        ZSTD_inBuffer in { next_in_, avail_in_, 0 };
+        ZSTD_outBuffer output { out, len, 0 };
+        const std::size_t ret = ZSTD_decompressStream(dctx_, &output, &in);
+        next_in_ += in.pos;
+        avail_in_ -= in.pos;
+        out_ += output.pos;
+        if (ZSTD_isError(ret)) {
+            done_ = true;
+            return output.pos;
+        }
+        // 0 once a frame is complete: the next byte starts a new one.
+        frame_start_ = ret == 0;
+        return output.pos;
+    }
+
+  private:
+    ZSTD_DCtx *dctx_;
+    bool frame_start_ = true;
+};
+#endif // HAVE_ZSTD
+
+std::unique_ptr<CompressedFile::Decoder> makeDecoder(
+    int fd, CompressedFile::Format format)
+{
+    std::unique_ptr<CompressedFile::Decoder> decoder;
+    switch (format) {
+#ifdef HAVE_ZLIB
+        case CompressedFile::Format::GZIP:
+            decoder.reset(new GzipDecoder(fd));
+            break;
+#endif
+#ifdef HAVE_LZMA
+        case CompressedFile::Format::XZ:
+            decoder.reset(new XzDecoder(fd));
+            break;
+#endif
+#ifdef HAVE_ZSTD
+        case CompressedFile::Format::ZSTD:
+            decoder.reset(new ZstdDecoder(fd));
+            break;
+#endif
+        default: break;
+    }
+    if (decoder == nullptr || !decoder->ok()) return nullptr;
+    return decoder;
+}
+
+} // namespace
+
+CompressedFile::Format CompressedFile::detect(int fd)
+{
+    unsigned char magic[6];
+    ssize_t n;
+    do {
+        n = pread(fd, magic, sizeof(magic), 0);
+    } while (n == -1 && errno == EINTR);
+#ifdef HAVE_ZLIB
+    if (n >= 2 && magic[0] == 0x1F && magic[1] == 0x8B) return Format::GZIP;
+#endif
+#ifdef HAVE_LZMA
+    if (n >= 6 && std::memcmp(magic, "\xFD" "7zXZ\0", 6) == 0)
+        return Format::XZ;
+#endif
+#ifdef HAVE_ZSTD
+    if (n >= 4 && std::memcmp(magic, "\x28\xB5\x2F\xFD", 4) == 0)
+        return Format::ZSTD;
+#endif
+    return Format::NONE;
+}
+
+std::unique_ptr<CompressedFile> CompressedFile::open(int fd, Format format)
+{
+    std::unique_ptr<Decoder> stream = makeDecoder(fd, format);
+    std::unique_ptr<Decoder> reader = makeDecoder(fd, format);
+    if (stream == nullptr || reader == nullptr) return nullptr;
+    return std::unique_ptr<CompressedFile> { new CompressedFile(
+        std::move(stream), std::move(reader)) };
+}
+
+CompressedFile::CompressedFile(
+    std::unique_ptr<Decoder> stream, std::unique_ptr<Decoder> reader)
+    : stream_(std::move(stream))
+    , reader_(std::move(reader))
+    , checkpoint_span_(kCheckpointSpan)
+{
+    checkpoints_.push_back(Checkpoint { 0, 0, 0, {} });
+    stream_->setOnCheckpoint([this](Checkpoint checkpoint) {
+        addCheckpoint(std::move(checkpoint));
+    });
+}
+
+CompressedFile::~CompressedFile() = default;
+
+std::size_t CompressedFile::readNext(char *out, std::size_t len)
+{
+    return stream_->decode(out, len);
+}
+
+void CompressedFile::addCheckpoint(Checkpoint checkpoint)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    checkpoints_.push_back(std::move(checkpoint));
+    if (checkpoints_.size() < kMaxCheckpoints) return;
+    // Keeps the start and every other one after it, ending with the last
+    // one, from which the next one is taken. Called by `stream_`, so it can
+    // be told the new span right away.
+    std::size_t kept = 1;
+    for (std::size_t i = 1 + checkpoints_.size() % 2; i < checkpoints_.size();
+         i += 2) {
+        if (i != kept) checkpoints_[kept] = std::move(checkpoints_[i]);
+        ++kept;
+    }
+    checkpoints_.resize(kept);
+    checkpoint_span_ *= 2;
+    stream_->setCheckpointSpan(checkpoint_span_);
+}
+
+std::size_t CompressedFile::read(
+    std::uint64_t offset, std::size_t len, char *out)
+{
+    std::size_t total = 0;
+    while (total < len) {
+        const std::vector<char> &data = chunk(offset / kChunkBytes);
+        const std::size_t begin
+            = static_cast<std::size_t>(offset % kChunkBytes);
+        if (begin >= data.size()) break;
+        const std::size_t n = std::min(len - total, data.size() - begin);
+        std::copy(data.begin() + begin, data.begin() + begin + n, out + total);
+        total += n;
+        offset += n;
+    }
+    return total;
+}
+
+const std::vector<char> &CompressedFile::chunk(std::uint64_t index)
+{
+    ++clock_;
+    for (Chunk &chunk : chunks_) {
+        if (chunk.index == index) {
+            chunk.last_used = clock_;
+            return chunk.data;
+        }
+    }
+    Chunk *chunk;
+    if (chunks_.size() < kMaxChunks) {
+        chunks_.emplace_back();
+        chunk = &chunks_.back();
+    } else {
+        chunk = &*std::min_element(chunks_.begin(), chunks_.end(),
+            [](const Chunk &a, const Chunk &b) {
+                return a.last_used < b.last_used;
+            });
+    }
+    chunk->index = index;
+    chunk->last_used = clock_;
+    chunk->data.resize(kChunkBytes);
+    chunk->data.resize(
+        decodeAt(index * kChunkBytes, chunk->data.data(), kChunkBytes));
+    return chunk->data;
+}
+
+std::size_t CompressedFile::decodeAt(
+    std::uint64_t offset, char *out, std::size_t len)
+{
+    const std::uint64_t position = reader_->position();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // The last checkpoint at or before `offset`.
+        const auto it = std::upper_bound(checkpoints_.begin(),
+                            checkpoints_.end(), offset,
+                            [](std::uint64_t offset, const Checkpoint &c) {
+                                return offset < c.out;
+                            })
+            - 1;
+        // Decompressing on from the current position is cheaper than
+        // restarting from a checkpoint before it.
+        if ((position > offset || it->out > position)
+            && !reader_->restore(*it))
+            return 0;
+    }
+    std::vector<char> skipped;
+    while (reader_->position() < offset) {
+        skipped.resize(kChunkBytes);
+        const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(
+            offset - reader_->position(), skipped.size()));
+        if (reader_->decode(skipped.data(), n) < n) return 0;
+    }
+    return reader_->decode(out, len);
+}
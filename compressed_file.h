@@ -0,0 +1,107 @@
+#ifndef COMPRESSED_FILE_H_
+#define COMPRESSED_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Random access to the decompressed contents of a gzip, xz or zstd
+ * file.
+ *
+ * The file is decompressed as a stream with `readNext`, which records
+ * checkpoints along the way: the state needed to resume decompressing from
+ * that point. `read` then decompresses any part of what has been streamed
+ * from the nearest checkpoint before it, and keeps the last chunks it has
+ * decompressed, so that reading the lines around the viewport is cheap.
+ *
+ * gzip checkpoints are taken between deflate blocks about every 1 MiB, with
+ * the 32 KiB window that the following data can refer to, compressed, as in
+ * zlib's zran example. xz and zstd decoders cannot resume from within a
+ * block or frame, so their checkpoints are at the start of xz blocks and
+ * zstd frames. Files made of a single block or frame are read from the
+ * start.
+ *
+ * The number of checkpoints is bounded: when there are too many, every
+ * other one is dropped and the following ones are taken twice as far apart.
+ *
+ * xz needs liblzma (HAVE_LZMA) and zstd needs libzstd (HAVE_ZSTD).
+ */
+class CompressedFile {
+  public:
+    enum class Format { NONE, GZIP, XZ, ZSTD };
+
+    // A point from which decompression can resume.
+    struct Checkpoint {
+        // The offset in the decompressed data.
+        std::uint64_t out;
+        // The offset in the file.
+        std::uint64_t in;
+        // gzip: the number of bits of the byte before `in` that have not
+        // been decoded yet. xz: the check type of the stream.
+        int state;
+        // gzip: the last 32 KiB before `out`, zlib-compressed. Empty at the
+        // start.
+        std::vector<unsigned char> window;
+    };
+
+    // Defined in compressed_file.cpp.
+    class Decoder;
+
+    // The format of the file from its magic bytes. NONE for uncompressed
+    // files, and for the formats that this build cannot decompress.
+    static Format detect(int fd);
+
+    // Does not take ownership of `fd`.
+    // Returns nullptr if the decoder cannot be created.
+    static std::unique_ptr<CompressedFile> open(int fd, Format format);
+
+    ~CompressedFile();
+
+    CompressedFile(const CompressedFile &) = delete;
+    CompressedFile &operator=(const CompressedFile &) = delete;
+
+    // Decompresses the next bytes of the stream into `out`. Returns less
+    // than `len` only at the end of the data or on a decoding error.
+    std::size_t readNext(char *out, std::size_t len);
+
+    // Reads up to `len` decompressed bytes at `offset`. Only the bytes
+    // streamed by `readNext` so far can be read. Can be called while
+    // another thread calls `readNext`, but not concurrently with itself.
+    std::size_t read(std::uint64_t offset, std::size_t len, char *out);
+
+  private:
+    CompressedFile(std::unique_ptr<Decoder> stream,
+        std::unique_ptr<Decoder> reader);
+
+    // Returns the chunk at `index * kChunkBytes`, decompressing it if it is
+    // not cached. Shorter at the end of the data.
+    const std::vector<char> &chunk(std::uint64_t index);
+
+    // Decompresses into `out` from `offset` with `reader_`.
+    std::size_t decodeAt(std::uint64_t offset, char *out, std::size_t len);
+
+    void addCheckpoint(Checkpoint checkpoint);
+
+    std::unique_ptr<Decoder> stream_;
+    std::unique_ptr<Decoder> reader_;
+
+    // Sorted by offset. The first one is the start of the file.
+    std::vector<Checkpoint> checkpoints_;
+    // Guards `checkpoints_`, which `stream_` appends to.
+    std::mutex mutex_;
+    // The current span between the checkpoints of `stream_`.
+    std::uint64_t checkpoint_span_;
+
+    struct Chunk {
+        std::uint64_t index;
+        std::vector<char> data;
+        std::uint64_t last_used;
+    };
+    std::vector<Chunk> chunks_;
+    std::uint64_t clock_ = 0;
+};
+
+#endif // COMPRESSED_FILE_H_
@@ -208,6 +208,9 @@ void Config::Load(const std::string &path)
     CFG_STR(res_dir)
     processEnvValue(&res_dir);
 
+    CFG_INT(image_cache_kb)
+    CFG_INT(zoom_image_kb)
+
     CFG_BOOL(osk_key_system_is_backspace)
 
     CFG_SDLK(key_down)
@@ -31,6 +31,14 @@ struct Config {
     // Resources directory (e.g. icons).
     std::string res_dir { RES_DIR };
 
+    // Memory budget for the image viewer's cache of scaled images, in KiB.
+    int image_cache_kb = IMAGE_CACHE_KB;
+
+    // Memory budget for a zoomed image in the image viewer, in KiB.
+    // Larger images are decoded at a reduced resolution, or not at all if
+    // their format can only be decoded at full size.
+    int zoom_image_kb = ZOOM_IMAGE_KB;
+
     // Keyboard key code mappings
     SDLC_Keycode key_down = CMDR_KEY_DOWN;
     SDLC_Keycode key_left = CMDR_KEY_LEFT;
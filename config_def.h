@@ -46,6 +46,14 @@
 #define FILE_SYSTEM "/dev/sda4"
 #endif
 
+#ifndef IMAGE_CACHE_KB
+#define IMAGE_CACHE_KB 16384
+#endif
+
+#ifndef ZOOM_IMAGE_KB
+#define ZOOM_IMAGE_KB 131072
+#endif
+
 #ifndef CMDR_KEY_UP
 #define CMDR_KEY_UP SDLK_UP
 #endif
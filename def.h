@@ -44,9 +44,17 @@
 #define COLOR_TEXT_SELECTED 255, 0, 0
 #define COLOR_CURSOR_1 232, 152, 80
 #define COLOR_CURSOR_2 232, 201, 173
+#define COLOR_SEARCH_MATCH 255, 221, 87
 #define COLOR_BG_1 255, 255, 255
 #define COLOR_BG_2 232, 228, 224
 #define COLOR_BORDER 102, 85, 74
 #define COLOR_BORDER_ERROR 128, 55, 55
+// Syntax highlighting in the text viewer
+#define COLOR_SYNTAX_COMMENT 140, 128, 118
+#define COLOR_SYNTAX_KEYWORD 165, 42, 42
+#define COLOR_SYNTAX_KEY 75, 70, 164
+#define COLOR_SYNTAX_STRING 38, 120, 48
+#define COLOR_SYNTAX_NUMBER 150, 58, 145
+#define COLOR_SYNTAX_VARIABLE 20, 115, 135
 
 #endif // _DEF_H_
@@ -0,0 +1,523 @@
+#include "hex_viewer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+#include "compressed_file.h"
+#include "config.h"
+#include "def.h"
+#include "error_dialog.h"
+#include "keyboard.h"
+#include "resourceManager.h"
+#include "screen.h"
+#include "sdlutils.h"
+#include "text_encoding.h"
+#include "text_scan.h"
+
+#define VIEWER_PADDING_X 1
+#define VIEWER_PADDING_X_PHYS static_cast<int>(VIEWER_PADDING_X * screen.ppu_x)
+#define VIEWER_LINE_HEIGHT 13
+#define VIEWER_LINE_HEIGHT_PHYS                                                \
+    static_cast<int>(VIEWER_LINE_HEIGHT * screen.ppu_y)
+#define VIEWER_Y_LIST 17
+#define VIEWER_Y_LIST_PHYS static_cast<int>(VIEWER_Y_LIST * screen.ppu_y)
+
+namespace {
+
+// The number of bytes sniffed to tell binary files from text files.
+constexpr std::size_t kSniffBytes = 4096;
+
+// The number of rows that fully fit into the viewport.
+int numViewportRows()
+{
+    return std::max(1,
+        (screen.actual_h - VIEWER_Y_LIST_PHYS) / VIEWER_LINE_HEIGHT_PHYS);
+}
+
+std::string toHex(std::uint64_t value, int digits)
+{
+    static const char kDigits[] = "0123456789ABCDEF";
+    std::string result(digits, '0');
+    for (int i = digits - 1; i >= 0 && value != 0; --i, value >>= 4)
+        result[i] = kDigits[value & 0xF];
+    return result;
+}
+
+int hexDigitValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parses e.g. "3F", "3f00" or "3F 00 A", a single digit being a byte.
+bool parseHexBytes(const std::string &text, std::vector<unsigned char> *bytes)
+{
+    std::size_t i = 0;
+    while (i < text.size()) {
+        if (text[i] == ' ' || text[i] == '\t') {
+            ++i;
+            continue;
+        }
+        const int high = hexDigitValue(text[i]);
+        if (high == -1) return false;
+        const int low
+            = i + 1 < text.size() ? hexDigitValue(text[i + 1]) : -1;
+        if (low == -1) {
+            if (i + 1 < text.size() && text[i + 1] != ' '
+                && text[i + 1] != '\t')
+                return false;
+            bytes->push_back(static_cast<unsigned char>(high));
+            i += 1;
+        } else {
+            bytes->push_back(static_cast<unsigned char>(high * 16 + low));
+            i += 2;
+        }
+    }
+    return !bytes->empty();
+}
+
+} // namespace
+
+bool HexViewer::isBinaryFile(const std::string &path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+    char buffer[kSniffBytes];
+    ssize_t n;
+    // Compressed text is shown in the text viewer, so it is the
+    // decompressed data that is sniffed.
+    const CompressedFile::Format format = CompressedFile::detect(fd);
+    std::unique_ptr<CompressedFile> compressed;
+    if (format != CompressedFile::Format::NONE)
+        compressed = CompressedFile::open(fd, format);
+    if (compressed != nullptr) {
+        n = static_cast<ssize_t>(compressed->readNext(buffer, sizeof(buffer)));
+        compressed = nullptr;
+    } else {
+        do {
+            n = pread(fd, buffer, sizeof(buffer), 0);
+        } while (n == -1 && errno == EINTR);
+    }
+    ::close(fd);
+    if (n <= 0) return false;
+    const std::size_t size = static_cast<std::size_t>(n);
+    // UTF-16 text is full of NUL bytes.
+    const TextEncoding encoding = Text_utils::detectEncoding(buffer, size);
+    if (encoding == TextEncoding::UTF16LE || encoding == TextEncoding::UTF16BE)
+        return false;
+    return Text_utils::looksBinary(buffer, size);
+}
+
+HexViewer::HexViewer(std::string filename)
+    : fonts_(CResourceManager::instance().getFonts())
+    , filename_(std::move(filename))
+{
+    if (!openFile()) {
+        ErrorDialog(
+            "Unable to open file", filename_ + "\n" + std::strerror(errno));
+        m_retVal = -1;
+        return;
+    }
+    ok_ = true;
+    init();
+}
+
+HexViewer::~HexViewer()
+{
+    closeFile();
+    if (write_fd_ != -1) ::close(write_fd_);
+}
+
+bool HexViewer::openFile()
+{
+    fd_ = ::open(filename_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ == -1) return false;
+    struct stat st;
+    int error = 0;
+    if (fstat(fd_, &st) == -1)
+        error = errno;
+    else if (S_ISDIR(st.st_mode))
+        error = EISDIR;
+    if (error != 0) {
+        closeFile();
+        errno = error;
+        return false;
+    }
+    size_ = S_ISREG(st.st_mode) ? st.st_size : 0;
+
+    // Only the pages of the visible rows are ever resident. Files larger
+    // than the address space are read with `pread` instead.
+    // The mapping is shared so that it reflects the bytes written.
+    if (size_ > 0 && size_ <= SIZE_MAX) {
+        void *data = mmap(nullptr, static_cast<std::size_t>(size_), PROT_READ,
+            MAP_SHARED, fd_, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, static_cast<std::size_t>(size_), MADV_RANDOM);
+            data_ = static_cast<const unsigned char *>(data);
+        }
+    }
+    return true;
+}
+
+void HexViewer::closeFile()
+{
+    if (data_ != nullptr)
+        munmap(const_cast<unsigned char *>(data_),
+            static_cast<std::size_t>(size_));
+    data_ = nullptr;
+    if (fd_ != -1) ::close(fd_);
+    fd_ = -1;
+}
+
+void HexViewer::init()
+{
+    const SDL_PixelFormat *pixel_format = screen.surface->format;
+    border_color_ = SDL_MapRGB(pixel_format, COLOR_BORDER);
+    sdl_bg_color_ = SDL_Color { COLOR_BG_1 };
+    bg_color_ = SDL_MapRGB(pixel_format, COLOR_BG_1);
+    sdl_highlight_color_ = SDL_Color { COLOR_CURSOR_1 };
+    highlight_color_ = SDL_MapRGB(pixel_format, COLOR_CURSOR_1);
+
+    // Create background image
+    background_ = SDLSurfaceUniquePtr { SDL_utils::createImage(
+        screen.actual_w, screen.actual_h, bg_color_) };
+    {
+        SDL_Rect rect = SDL_utils::Rect(0, 0, screen.actual_w, HEADER_H_PHYS);
+        SDL_FillRect(background_.get(), &rect, border_color_);
+    }
+    // Print title
+    {
+        SDLSurfaceUniquePtr tmp { SDL_utils::renderText(fonts_,
+            filename_ + " (hex)", Globals::g_colorTextTitle,
+            { COLOR_TITLE_BG }) };
+        SDL_Rect rect;
+        SDL_Rect *clip_rect = nullptr;
+        if (tmp->w > background_->w - 2 * VIEWER_PADDING_X_PHYS) {
+            rect.x = tmp->w - (background_->w - 2 * VIEWER_PADDING_X_PHYS);
+            rect.y = 0;
+            rect.w = background_->w - 2 * VIEWER_PADDING_X_PHYS;
+            rect.h = tmp->h;
+            clip_rect = &rect;
+        }
+        SDL_utils::applyPpuScaledSurface(VIEWER_PADDING_X_PHYS,
+            HEADER_PADDING_TOP_PHYS, tmp.get(), background_.get(), clip_rect);
+    }
+
+    // The glyphs are rendered once, so that drawing a row is only blits.
+    hex_glyphs_.clear();
+    char_glyphs_.clear();
+    hex_cell_w_ = char_cell_w_ = 0;
+    for (int value = 0; value < 256; ++value) {
+        hex_glyphs_.emplace_back(SDL_utils::renderText(fonts_,
+            toHex(value, 2), Globals::g_colorTextNormal, sdl_bg_color_));
+        const char c
+            = value >= 0x20 && value < 0x7F ? static_cast<char>(value) : '.';
+        char_glyphs_.emplace_back(SDL_utils::renderText(fonts_,
+            std::string(1, c), Globals::g_colorTextNormal, sdl_bg_color_));
+        if (hex_glyphs_.back() != nullptr)
+            hex_cell_w_ = std::max(hex_cell_w_, hex_glyphs_.back()->w);
+        if (char_glyphs_.back() != nullptr)
+            char_cell_w_ = std::max(char_cell_w_, char_glyphs_.back()->w);
+    }
+    const int gap = std::max(1, hex_cell_w_ / 3);
+    hex_cell_w_ += gap;
+
+    offset_digits_ = 8;
+    while (offset_digits_ < 16 && (size_ >> (4 * offset_digits_)) != 0)
+        offset_digits_ += 2;
+    // Each hex glyph is two digits wide.
+    hex_x_ = VIEWER_PADDING_X_PHYS + hex_cell_w_ * offset_digits_ / 2 + gap;
+
+    // As many bytes per row as fit, from 4 to 32 in powers of two.
+    bytes_per_row_ = 32;
+    while (bytes_per_row_ > 4
+        && hex_x_
+                + static_cast<int>(bytes_per_row_)
+                    * (hex_cell_w_ + char_cell_w_)
+                + gap + VIEWER_PADDING_X_PHYS
+            > screen.actual_w)
+        bytes_per_row_ /= 2;
+    char_x_ = hex_x_ + static_cast<int>(bytes_per_row_) * hex_cell_w_ + gap;
+
+    moveCursorTo(cursor_);
+}
+
+void HexViewer::onResize() { init(); }
+
+void HexViewer::render(const bool focused) const
+{
+    SDL_utils::applyPpuScaledSurface(0, 0, background_.get(), screen.surface);
+    renderCursorOffset();
+
+    const int rows = numViewportRows();
+    const std::uint64_t start = first_row_ * bytes_per_row_;
+    std::vector<unsigned char> bytes(
+        static_cast<std::size_t>(rows) * bytes_per_row_);
+    bytes.resize(read(start, bytes.size(), bytes.data()));
+
+    const int y0 = VIEWER_Y_LIST_PHYS;
+    const int line_height = VIEWER_LINE_HEIGHT_PHYS;
+    for (std::size_t i = 0; i < bytes.size(); ++i) {
+        const std::uint64_t offset = start + i;
+        const int column = static_cast<int>(i % bytes_per_row_);
+        const int y = y0 + static_cast<int>(i / bytes_per_row_) * line_height;
+        if (column == 0) {
+            SDLSurfaceUniquePtr tmp { SDL_utils::renderText(fonts_,
+                toHex(offset, offset_digits_), Globals::g_colorTextDir,
+                sdl_bg_color_) };
+            if (tmp != nullptr)
+                SDL_utils::applyPpuScaledSurface(
+                    VIEWER_PADDING_X_PHYS, y, tmp.get(), screen.surface);
+        }
+        const int hex_x = hex_x_ + column * hex_cell_w_;
+        const int char_x = char_x_ + column * char_cell_w_;
+        const unsigned char value = bytes[i];
+        if (offset == cursor_ || modified_.count(offset) != 0) {
+            // Written bytes are shown in a different color.
+            const SDL_Color &fg = modified_.count(offset) != 0
+                ? Globals::g_colorTextSelected
+                : Globals::g_colorTextNormal;
+            SDL_Color bg = sdl_bg_color_;
+            if (offset == cursor_) {
+                bg = sdl_highlight_color_;
+                SDL_Rect rect = SDL_utils::makeRect(
+                    hex_x, y, hex_cell_w_, line_height);
+                SDL_FillRect(screen.surface, &rect, highlight_color_);
+                rect = SDL_utils::makeRect(
+                    char_x, y, char_cell_w_, line_height);
+                SDL_FillRect(screen.surface, &rect, highlight_color_);
+            }
+            SDLSurfaceUniquePtr hex { SDL_utils::renderText(
+                fonts_, toHex(value, 2), fg, bg) };
+            if (hex != nullptr)
+                SDL_utils::applyPpuScaledSurface(
+                    hex_x, y, hex.get(), screen.surface);
+            const char c = value >= 0x20 && value < 0x7F
+                ? static_cast<char>(value)
+                : '.';
+            SDLSurfaceUniquePtr text { SDL_utils::renderText(
+                fonts_, std::string(1, c), fg, bg) };
+            if (text != nullptr)
+                SDL_utils::applyPpuScaledSurface(
+                    char_x, y, text.get(), screen.surface);
+            continue;
+        }
+        if (hex_glyphs_[value] != nullptr)
+            SDL_utils::applyPpuScaledSurface(
+                hex_x, y, hex_glyphs_[value].get(), screen.surface);
+        if (char_glyphs_[value] != nullptr)
+            SDL_utils::applyPpuScaledSurface(
+                char_x, y, char_glyphs_[value].get(), screen.surface);
+    }
+}
+
+void HexViewer::renderCursorOffset() const
+{
+    if (size_ == 0) return;
+    SDLSurfaceUniquePtr tmp { SDL_utils::renderText(fonts_,
+        "0x" + toHex(cursor_, offset_digits_), Globals::g_colorTextTitle,
+        { COLOR_TITLE_BG }) };
+    if (tmp == nullptr) return;
+    const int x = screen.actual_w - tmp->w - VIEWER_PADDING_X_PHYS;
+    // Covers the end of a long title.
+    SDL_Rect rect = SDL_utils::makeRect(x - VIEWER_PADDING_X_PHYS, 0,
+        screen.actual_w - x + VIEWER_PADDING_X_PHYS, HEADER_H_PHYS);
+    SDL_FillRect(screen.surface, &rect, border_color_);
+    SDL_utils::applyPpuScaledSurface(
+        x, HEADER_PADDING_TOP_PHYS, tmp.get(), screen.surface);
+}
+
+bool HexViewer::keyPress(
+    const SDL_Event &event, SDLC_Keycode key, ControllerButton button)
+{
+    CWindow::keyPress(event, key, button);
+    const auto &c = config();
+    const std::int64_t row = bytes_per_row_;
+    const std::int64_t page = row * std::max(1, numViewportRows() - 1);
+    if (key == c.key_system || button == c.gamepad_system || key == c.key_parent
+        || button == c.gamepad_parent) {
+        m_retVal = -1;
+        return true;
+    }
+    if (key == c.key_open || button == c.gamepad_open || key == c.key_operation
+        || button == c.gamepad_operation)
+        return editBytes();
+    if (key == c.key_select || button == c.gamepad_select) return goToOffset();
+    if (key == c.key_up || button == c.gamepad_up) return moveCursor(-row);
+    if (key == c.key_down || button == c.gamepad_down) return moveCursor(row);
+    if (key == c.key_pageup || button == c.gamepad_pageup)
+        return moveCursor(-page);
+    if (key == c.key_pagedown || button == c.gamepad_pagedown)
+        return moveCursor(page);
+    if (key == c.key_left || button == c.gamepad_left) return moveCursor(-1);
+    if (key == c.key_right || button == c.gamepad_right) return moveCursor(1);
+    return false;
+}
+
+bool HexViewer::keyHold()
+{
+    const auto &c = config();
+    const std::int64_t row = bytes_per_row_;
+    const std::int64_t page = row * std::max(1, numViewportRows() - 1);
+    if (tick(c.key_up)) return moveCursor(-row);
+    if (tick(c.key_down)) return moveCursor(row);
+    if (tick(c.key_pageup)) return moveCursor(-page);
+    if (tick(c.key_pagedown)) return moveCursor(page);
+    if (tick(c.key_left)) return moveCursor(-1);
+    if (tick(c.key_right)) return moveCursor(1);
+    return false;
+}
+
+#if SDL_VERSION_ATLEAST(2, 0, 0)
+bool HexViewer::gamepadHold(SDL_GameController *controller)
+{
+    const auto &c = config();
+    const std::int64_t row = bytes_per_row_;
+    const std::int64_t page = row * std::max(1, numViewportRows() - 1);
+    if (tick(controller, c.gamepad_up)) return moveCursor(-row);
+    if (tick(controller, c.gamepad_down)) return moveCursor(row);
+    if (tick(controller, c.gamepad_pageup)) return moveCursor(-page);
+    if (tick(controller, c.gamepad_pagedown)) return moveCursor(page);
+    if (tick(controller, c.gamepad_left)) return moveCursor(-1);
+    if (tick(controller, c.gamepad_right)) return moveCursor(1);
+    return false;
+}
+#endif
+
+bool HexViewer::mouseWheel(int dx, int dy)
+{
+    const std::int64_t row = bytes_per_row_;
+    if (dy > 0) return moveCursor(-row);
+    if (dy < 0) return moveCursor(row);
+    if (dx < 0) return moveCursor(-1);
+    if (dx > 0) return moveCursor(1);
+    return false;
+}
+
+std::size_t HexViewer::read(
+    std::uint64_t offset, std::size_t len, unsigned char *out) const
+{
+    std::size_t total = 0;
+    if (data_ != nullptr && offset < size_) {
+        total = static_cast<std::size_t>(
+            std::min<std::uint64_t>(len, size_ - offset));
+        std::copy(data_ + offset, data_ + offset + total, out);
+        return total;
+    }
+    while (total < len) {
+        const ssize_t n = pread(fd_, out + total, len - total,
+            static_cast<off_t>(offset + total));
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        total += static_cast<std::size_t>(n);
+    }
+    return total;
+}
+
+bool HexViewer::writeBytes(
+    std::uint64_t offset, const std::vector<unsigned char> &bytes)
+{
+    if (write_fd_ == -1) {
+        write_fd_ = ::open(filename_.c_str(), O_WRONLY | O_CLOEXEC);
+        if (write_fd_ == -1) {
+            ErrorDialog("Unable to write file",
+                filename_ + "\n" + std::strerror(errno));
+            return false;
+        }
+    }
+    std::size_t total = 0;
+    while (total < bytes.size()) {
+        const ssize_t n = pwrite(write_fd_, bytes.data() + total,
+            bytes.size() - total, static_cast<off_t>(offset + total));
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) {
+            ErrorDialog("Unable to write file",
+                filename_ + "\n" + std::strerror(n == -1 ? errno : EIO));
+            break;
+        }
+        total += static_cast<std::size_t>(n);
+    }
+    for (std::size_t i = 0; i < total; ++i) modified_.insert(offset + i);
+    if (total > 0) fdatasync(write_fd_);
+    return total == bytes.size();
+}
+
+bool HexViewer::editBytes()
+{
+    if (cursor_ >= size_) return false;
+    unsigned char value = 0;
+    read(cursor_, 1, &value);
+    CKeyboard keyboard(toHex(value, 2));
+    if (keyboard.execute() != 1) return true;
+    std::vector<unsigned char> bytes;
+    if (!parseHexBytes(keyboard.getInputText(), &bytes)) {
+        ErrorDialog("Invalid hex bytes", keyboard.getInputText());
+        return true;
+    }
+    // The file is never extended.
+    if (bytes.size() > size_ - cursor_)
+        bytes.resize(static_cast<std::size_t>(size_ - cursor_));
+    writeBytes(cursor_, bytes);
+    return true;
+}
+
+bool HexViewer::goToOffset()
+{
+    if (size_ == 0) return false;
+    CKeyboard keyboard("0x" + toHex(cursor_, offset_digits_));
+    if (keyboard.execute() != 1) return true;
+    const std::string &text = keyboard.getInputText();
+    char *end;
+    errno = 0;
+    const unsigned long long offset = std::strtoull(text.c_str(), &end, 16);
+    if (text.empty() || *end != '\0' || errno != 0) {
+        ErrorDialog("Invalid hex offset", text);
+        return true;
+    }
+    moveCursorTo(std::min<std::uint64_t>(offset, size_ - 1));
+    return true;
+}
+
+bool HexViewer::moveCursor(std::int64_t delta)
+{
+    if (size_ == 0) return false;
+    std::uint64_t offset;
+    if (delta < 0) {
+        const std::uint64_t back = static_cast<std::uint64_t>(-delta);
+        offset = cursor_ >= back ? cursor_ - back : 0;
+    } else {
+        offset = std::min(
+            cursor_ + static_cast<std::uint64_t>(delta), size_ - 1);
+    }
+    if (offset == cursor_) return false;
+    return moveCursorTo(offset);
+}
+
+bool HexViewer::moveCursorTo(std::uint64_t offset)
+{
+    cursor_ = offset;
+    const std::uint64_t row = cursor_ / bytes_per_row_;
+    const std::uint64_t rows = numViewportRows();
+    if (row < first_row_) first_row_ = row;
+    if (row >= first_row_ + rows) first_row_ = row - rows + 1;
+    // Keep the viewport full after a resize.
+    if (numRows() > rows)
+        first_row_ = std::min(first_row_, numRows() - rows);
+    else
+        first_row_ = 0;
+    return true;
+}
+
+std::uint64_t HexViewer::numRows() const
+{
+    return (size_ + bytes_per_row_ - 1) / bytes_per_row_;
+}
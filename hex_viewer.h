@@ -0,0 +1,110 @@
+#ifndef HEX_VIEWER_H_
+#define HEX_VIEWER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "sdl_ptrs.h"
+#include "sdl_ttf_multifont.h"
+#include "window.h"
+
+/**
+ * @brief Shows a binary file as hex and ASCII, and overwrites its bytes.
+ *
+ * The file is memory-mapped (or read with `pread` if it cannot be mapped)
+ * and only the visible rows are read. Overwritten bytes are written to the
+ * file right away with `pwrite`, so patching a few bytes of a large file
+ * only writes those bytes.
+ */
+class HexViewer : public CWindow {
+  public:
+    // Returns true if the start of the file looks like binary data.
+    static bool isBinaryFile(const std::string &path);
+
+    explicit HexViewer(std::string filename);
+    virtual ~HexViewer();
+
+    HexViewer(const HexViewer &) = delete;
+    HexViewer &operator=(const HexViewer &) = delete;
+
+    // False if the file could not be opened, an error having been shown.
+    bool ok() const { return ok_; }
+
+  private:
+    void init();
+
+    void render(const bool focused) const override;
+    void renderCursorOffset() const;
+    bool keyPress(const SDL_Event &event, SDLC_Keycode key,
+        ControllerButton button) override;
+    bool keyHold() override;
+#if SDL_VERSION_ATLEAST(2, 0, 0)
+    bool gamepadHold(SDL_GameController *controller) override;
+#endif
+    bool mouseWheel(int dx, int dy) override;
+
+    void onResize() override;
+    bool isFullScreen() const override { return true; }
+
+    // Returns false and sets `errno` on failure.
+    bool openFile();
+    void closeFile();
+
+    // Reads up to `len` bytes at `offset`, from the mapping if possible.
+    std::size_t read(
+        std::uint64_t offset, std::size_t len, unsigned char *out) const;
+
+    // Writes the bytes at `offset` and flushes them to the disk.
+    bool writeBytes(
+        std::uint64_t offset, const std::vector<unsigned char> &bytes);
+
+    // Overwrites the bytes starting at the cursor with the typed hex bytes.
+    bool editBytes();
+    bool goToOffset();
+
+    // Moves the cursor by `delta` bytes, clamped to the file.
+    bool moveCursor(std::int64_t delta);
+    bool moveCursorTo(std::uint64_t offset);
+
+    std::uint64_t numRows() const;
+
+    const Fonts &fonts_;
+    std::string filename_;
+    SDLSurfaceUniquePtr background_;
+
+    // Colors:
+    std::uint32_t bg_color_;
+    SDL_Color sdl_bg_color_;
+    std::uint32_t highlight_color_;
+    SDL_Color sdl_highlight_color_;
+    std::uint32_t border_color_;
+
+    // Layout, in physical pixels:
+    // Each byte value rendered as hex and as a character.
+    std::vector<SDLSurfaceUniquePtr> hex_glyphs_;
+    std::vector<SDLSurfaceUniquePtr> char_glyphs_;
+    int hex_cell_w_;
+    int char_cell_w_;
+    int offset_digits_;
+    int hex_x_;
+    int char_x_;
+    std::size_t bytes_per_row_;
+
+    bool ok_ = false;
+    int fd_ = -1;
+    // Opened on the first write.
+    int write_fd_ = -1;
+    std::uint64_t size_ = 0;
+    // Null if the file is not mapped.
+    const unsigned char *data_ = nullptr;
+
+    std::uint64_t first_row_ = 0;
+    std::uint64_t cursor_ = 0;
+    // Offsets of the bytes written in this session.
+    std::set<std::uint64_t> modified_;
+};
+
+#endif // HEX_VIEWER_H_
@@ -0,0 +1,66 @@
+#include "image_cache.h"
+
+#include <algorithm>
+
+#include <sys/stat.h>
+
+#include "config.h"
+
+ImageCache &ImageCache::instance()
+{
+    static ImageCache cache(
+        static_cast<std::size_t>(std::max(config().image_cache_kb, 0)) * 1024);
+    return cache;
+}
+
+bool ImageCache::makeKey(
+    const std::string &path, int width, int height, Key *key)
+{
+    struct stat st;
+    if (::stat(path.c_str(), &st) == -1) return false;
+    *key = Key { path, st.st_mtime, width, height };
+    return true;
+}
+
+SDLSurfaceSharedPtr ImageCache::get(const Key &key)
+{
+    auto it = index_.find(key);
+    if (it == index_.end()) return nullptr;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->surface;
+}
+
+void ImageCache::put(const Key &key, SDLSurfaceSharedPtr surface)
+{
+    if (surface == nullptr) return;
+    const std::size_t bytes
+        = static_cast<std::size_t>(surface->pitch) * surface->h;
+    if (bytes > budget_bytes_) return;
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        used_bytes_ -= it->second->bytes;
+        entries_.erase(it->second);
+        index_.erase(it);
+    }
+    entries_.push_front(Entry { key, std::move(surface), bytes });
+    index_.emplace(key, entries_.begin());
+    used_bytes_ += bytes;
+    evict();
+}
+
+void ImageCache::clear()
+{
+    index_.clear();
+    entries_.clear();
+    used_bytes_ = 0;
+}
+
+void ImageCache::evict()
+{
+    while (used_bytes_ > budget_bytes_ && !entries_.empty()) {
+        const Entry &entry = entries_.back();
+        used_bytes_ -= entry.bytes;
+        index_.erase(entry.key);
+        entries_.pop_back();
+    }
+}
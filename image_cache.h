@@ -0,0 +1,75 @@
+#ifndef IMAGE_CACHE_H_
+#define IMAGE_CACHE_H_
+
+#include <cstddef>
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+#include <tuple>
+
+#include "sdl_ptrs.h"
+
+/**
+ * @brief An LRU cache of scaled images in the display format, limited by the
+ * total size of their pixel data.
+ *
+ * Not thread-safe: only used from the main thread.
+ */
+class ImageCache
+{
+    public:
+    struct Key
+    {
+        std::string path;
+        std::time_t mtime;
+        // Target size in physical pixels.
+        int width, height;
+
+        bool operator<(const Key &other) const
+        {
+            return std::tie(path, mtime, width, height)
+                < std::tie(other.path, other.mtime, other.width, other.height);
+        }
+    };
+
+    // Returns the cache sized according to `config().image_cache_kb`.
+    static ImageCache &instance();
+
+    // Returns false if the file does not exist.
+    static bool makeKey(const std::string &path, int width, int height, Key *key);
+
+    explicit ImageCache(std::size_t budget_bytes)
+        : budget_bytes_(budget_bytes)
+    {
+    }
+
+    ImageCache(const ImageCache &) = delete;
+    ImageCache &operator=(const ImageCache &) = delete;
+
+    // Returns nullptr if the image is not in the cache.
+    SDLSurfaceSharedPtr get(const Key &key);
+
+    void put(const Key &key, SDLSurfaceSharedPtr surface);
+
+    void clear();
+
+    private:
+    struct Entry
+    {
+        Key key;
+        SDLSurfaceSharedPtr surface;
+        std::size_t bytes;
+    };
+
+    void evict();
+
+    std::size_t budget_bytes_;
+    std::size_t used_bytes_ = 0;
+
+    // Most recently used first.
+    std::list<Entry> entries_;
+    std::map<Key, std::list<Entry>::iterator> index_;
+};
+
+#endif // IMAGE_CACHE_H_
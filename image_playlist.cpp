@@ -0,0 +1,31 @@
+#include "image_playlist.h"
+
+#include <algorithm>
+
+#include "panel.h"
+#include "sdlutils.h"
+
+constexpr std::size_t ImagePlaylist::npos;
+
+ImagePlaylist::ImagePlaylist(const CPanel &panel, int current_index)
+{
+    const int num_items = static_cast<int>(panel.getNbItems());
+    for (int i = 0; i < num_items; ++i) {
+        if (i != current_index) {
+            if (panel.isDirectory(i)) continue;
+            const T_FILE &item = panel.getItem(i);
+            if (item.m_size == 0 || !SDL_utils::isSupportedImageExt(item.m_ext))
+                continue;
+        }
+        entries_.push_back(Entry { i, panel.getItemFull(i) });
+    }
+}
+
+std::size_t ImagePlaylist::find(int panel_index) const
+{
+    const auto it = std::lower_bound(entries_.begin(), entries_.end(),
+        panel_index,
+        [](const Entry &entry, int index) { return entry.panel_index < index; });
+    if (it == entries_.end() || it->panel_index != panel_index) return npos;
+    return static_cast<std::size_t>(it - entries_.begin());
+}
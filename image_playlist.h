@@ -0,0 +1,49 @@
+#ifndef IMAGE_PLAYLIST_H_
+#define IMAGE_PLAYLIST_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class CPanel;
+
+/**
+ * @brief The images in a panel's listing, in panel order.
+ *
+ * Built once from the listing's extensions and sizes, without touching the
+ * file system, so that moving between images is index arithmetic.
+ */
+class ImagePlaylist {
+  public:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    // Collects the images listed in the panel. The item at `current_index`
+    // is included even if its extension is not known to be an image.
+    ImagePlaylist(const CPanel &panel, int current_index);
+
+    std::size_t size() const { return entries_.size(); }
+
+    int panelIndex(std::size_t position) const
+    {
+        return entries_[position].panel_index;
+    }
+
+    const std::string &path(std::size_t position) const
+    {
+        return entries_[position].path;
+    }
+
+    // Returns the position of the image at the given panel index, or `npos`.
+    std::size_t find(int panel_index) const;
+
+  private:
+    struct Entry {
+        int panel_index;
+        std::string path;
+    };
+
+    // Sorted by panel index.
+    std::vector<Entry> entries_;
+};
+
+#endif // IMAGE_PLAYLIST_H_
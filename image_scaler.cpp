@@ -0,0 +1,287 @@
+#include "image_scaler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define IMAGE_SCALER_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define IMAGE_SCALER_NEON
+#endif
+
+namespace Image_utils {
+
+namespace {
+
+// Filter weights are 14-bit fixed point and sum to 1 << kWeightBits.
+constexpr int kWeightBits = 14;
+constexpr int kWeightOne = 1 << kWeightBits;
+
+// The horizontal pass keeps 8 extra bits of precision: 8.8 fixed point.
+constexpr int kHorizontalShift = kWeightBits - 8;
+
+// The vertical pass removes the extra bits and the weight scale.
+constexpr int kVerticalShift = kWeightBits + 8;
+
+// Source taps and weights of each destination pixel along one axis.
+struct FilterTable
+{
+    std::vector<int> first;
+    std::vector<int> count;
+    std::vector<std::uint16_t> weights; // `max_taps` per destination pixel.
+    int max_taps;
+};
+
+FilterTable makeFilterTable(int p_src, int p_dst)
+{
+    FilterTable table;
+    table.first.resize(p_dst);
+    table.count.resize(p_dst);
+    const double scale = static_cast<double>(p_src) / p_dst;
+    table.max_taps = p_dst < p_src ? static_cast<int>(std::ceil(scale)) + 1 : 2;
+    table.weights.assign(static_cast<std::size_t>(p_dst) * table.max_taps, 0);
+    std::vector<double> w(table.max_taps);
+    for (int i = 0; i < p_dst; ++i) {
+        int first, count = 0;
+        if (p_dst < p_src) {
+            // Area-averaging: coverage of each source pixel by [begin, end).
+            const double begin = i * scale;
+            const double end = std::min<double>((i + 1) * scale, p_src);
+            first = static_cast<int>(begin);
+            for (int s = first; s < end && count < table.max_taps; ++s) {
+                w[count++] = std::min<double>(s + 1, end) - std::max<double>(s, begin);
+            }
+        } else {
+            // Bilinear, with pixel centers aligned.
+            const double x = std::max(0.0, (i + 0.5) * scale - 0.5);
+            first = std::min(static_cast<int>(x), p_src - 1);
+            const double frac = x - first;
+            w[count++] = 1.0 - frac;
+            if (first + 1 < p_src) w[count++] = frac;
+        }
+        double total = 0;
+        for (int t = 0; t < count; ++t) total += w[t];
+        // Quantize the running sum so that the weights sum to exactly one
+        // and the rounding error is spread across the taps.
+        std::uint16_t *out = &table.weights[static_cast<std::size_t>(i) * table.max_taps];
+        double cumulative = 0;
+        long prev = 0;
+        for (int t = 0; t < count; ++t) {
+            cumulative += w[t];
+            const long next = std::lround(cumulative / total * kWeightOne);
+            out[t] = static_cast<std::uint16_t>(next - prev);
+            prev = next;
+        }
+        table.first[i] = first;
+        table.count[i] = count;
+    }
+    return table;
+}
+
+// Unpacks a row of 32-bit pixels into RGBA bytes.
+void unpackRow(const SDL_PixelFormat *p_format, const Uint32 *p_src, int p_w, std::uint8_t *p_out)
+{
+    const SDL_PixelFormat &f = *p_format;
+    for (int x = 0; x < p_w; ++x, p_out += 4) {
+        const Uint32 px = p_src[x];
+        p_out[0] = static_cast<std::uint8_t>(((px & f.Rmask) >> f.Rshift) << f.Rloss);
+        p_out[1] = static_cast<std::uint8_t>(((px & f.Gmask) >> f.Gshift) << f.Gloss);
+        p_out[2] = static_cast<std::uint8_t>(((px & f.Bmask) >> f.Bshift) << f.Bloss);
+        p_out[3] = f.Amask == 0 ? 0xFF
+                                : static_cast<std::uint8_t>(((px & f.Amask) >> f.Ashift) << f.Aloss);
+    }
+}
+
+void horizontalPass(const FilterTable &p_table, const std::uint8_t *p_src, int p_dst_w, std::uint16_t *p_out)
+{
+    for (int x = 0; x < p_dst_w; ++x, p_out += 4) {
+        const std::uint8_t *src = p_src + p_table.first[x] * 4;
+        const std::uint16_t *w = &p_table.weights[static_cast<std::size_t>(x) * p_table.max_taps];
+        std::uint32_t r = 0, g = 0, b = 0, a = 0;
+        for (int t = 0, n = p_table.count[x]; t < n; ++t, src += 4) {
+            r += w[t] * src[0];
+            g += w[t] * src[1];
+            b += w[t] * src[2];
+            a += w[t] * src[3];
+        }
+        constexpr std::uint32_t kRound = 1 << (kHorizontalShift - 1);
+        p_out[0] = static_cast<std::uint16_t>((r + kRound) >> kHorizontalShift);
+        p_out[1] = static_cast<std::uint16_t>((g + kRound) >> kHorizontalShift);
+        p_out[2] = static_cast<std::uint16_t>((b + kRound) >> kHorizontalShift);
+        p_out[3] = static_cast<std::uint16_t>((a + kRound) >> kHorizontalShift);
+    }
+}
+
+// Weighted sum of `p_taps` rows of `p_n` 8.8 values into bytes.
+void verticalPass(const std::uint16_t *const *p_rows, const std::uint16_t *p_weights, int p_taps, int p_n, std::uint8_t *p_out)
+{
+    constexpr std::uint32_t kRound = 1u << (kVerticalShift - 1);
+    int i = 0;
+#if defined(IMAGE_SCALER_SSE2)
+    const __m128i round = _mm_set1_epi32(kRound);
+    for (; i + 8 <= p_n; i += 8) {
+        __m128i acc_lo = round, acc_hi = round;
+        for (int t = 0; t < p_taps; ++t) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p_rows[t] + i));
+            const __m128i w = _mm_set1_epi16(static_cast<short>(p_weights[t]));
+            const __m128i lo = _mm_mullo_epi16(v, w);
+            const __m128i hi = _mm_mulhi_epu16(v, w);
+            acc_lo = _mm_add_epi32(acc_lo, _mm_unpacklo_epi16(lo, hi));
+            acc_hi = _mm_add_epi32(acc_hi, _mm_unpackhi_epi16(lo, hi));
+        }
+        acc_lo = _mm_srli_epi32(acc_lo, kVerticalShift);
+        acc_hi = _mm_srli_epi32(acc_hi, kVerticalShift);
+        const __m128i words = _mm_packs_epi32(acc_lo, acc_hi);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(p_out + i), _mm_packus_epi16(words, words));
+    }
+#elif defined(IMAGE_SCALER_NEON)
+    for (; i + 8 <= p_n; i += 8) {
+        uint32x4_t acc_lo = vdupq_n_u32(0), acc_hi = vdupq_n_u32(0);
+        for (int t = 0; t < p_taps; ++t) {
+            const uint16x8_t v = vld1q_u16(p_rows[t] + i);
+            const uint16x4_t w = vdup_n_u16(p_weights[t]);
+            acc_lo = vmlal_u16(acc_lo, vget_low_u16(v), w);
+            acc_hi = vmlal_u16(acc_hi, vget_high_u16(v), w);
+        }
+        const uint16x8_t words = vcombine_u16(vmovn_u32(vrshrq_n_u32(acc_lo, kVerticalShift)),
+            vmovn_u32(vrshrq_n_u32(acc_hi, kVerticalShift)));
+        vst1_u8(p_out + i, vqmovn_u16(words));
+    }
+#endif
+    // Scalar: 32-bit arithmetic only, which suits MIPS32 cores.
+    for (; i < p_n; ++i) {
+        std::uint32_t acc = kRound;
+        for (int t = 0; t < p_taps; ++t) acc += p_weights[t] * static_cast<std::uint32_t>(p_rows[t][i]);
+        p_out[i] = static_cast<std::uint8_t>(std::min<std::uint32_t>(acc >> kVerticalShift, 255));
+    }
+}
+
+template <typename Pixel>
+void packRow(const SDL_PixelFormat *p_format, const std::uint8_t *p_src, int p_w, Pixel *p_out)
+{
+    const SDL_PixelFormat &f = *p_format;
+    for (int x = 0; x < p_w; ++x, p_src += 4) {
+        Uint32 px = (static_cast<Uint32>(p_src[0] >> f.Rloss) << f.Rshift)
+            | (static_cast<Uint32>(p_src[1] >> f.Gloss) << f.Gshift)
+            | (static_cast<Uint32>(p_src[2] >> f.Bloss) << f.Bshift);
+        if (f.Amask != 0) px |= static_cast<Uint32>(p_src[3] >> f.Aloss) << f.Ashift;
+        p_out[x] = static_cast<Pixel>(px);
+    }
+}
+
+// Source rows after the horizontal pass, cached while they are needed by the
+// vertical filter.
+class RowCache
+{
+    public:
+    RowCache(int p_size, int p_row_len)
+        : m_index(p_size, -1)
+        , m_rows(p_size, std::vector<std::uint16_t>(p_row_len))
+    {
+    }
+
+    // Returns the row and whether it must be computed.
+    std::uint16_t *get(int p_y, bool *p_missing)
+    {
+        const std::size_t slot = static_cast<std::size_t>(p_y) % m_rows.size();
+        *p_missing = m_index[slot] != p_y;
+        m_index[slot] = p_y;
+        return m_rows[slot].data();
+    }
+
+    private:
+    std::vector<int> m_index;
+    std::vector<std::vector<std::uint16_t>> m_rows;
+};
+
+} // namespace
+
+PixelLayout PixelLayout::of(const SDL_PixelFormat *p_format)
+{
+    return PixelLayout { p_format->BitsPerPixel, p_format->Rmask,
+        p_format->Gmask, p_format->Bmask, p_format->Amask };
+}
+
+PixelLayout PixelLayout::rgba32()
+{
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+    return PixelLayout { 32, 0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF };
+#else
+    return PixelLayout { 32, 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000 };
+#endif
+}
+
+bool PixelLayout::matches(const SDL_PixelFormat *p_format) const
+{
+    return p_format->BitsPerPixel == bpp && p_format->Rmask == rmask
+        && p_format->Gmask == gmask && p_format->Bmask == bmask
+        && p_format->Amask == amask;
+}
+
+SDLSurfaceUniquePtr scale(SDL_Surface *p_src, int p_w, int p_h, const PixelLayout &p_layout)
+{
+    if (p_src == nullptr || p_w <= 0 || p_h <= 0) return nullptr;
+    if (p_layout.bpp != 16 && p_layout.bpp != 32) return nullptr;
+
+    // Reading is only implemented for 32-bit pixels.
+    SDLSurfaceUniquePtr converted;
+    SDL_Surface *src = p_src;
+    if (src->format->BytesPerPixel != 4) {
+        const PixelLayout rgba = PixelLayout::rgba32();
+        SDLSurfaceUniquePtr tmp { SDL_CreateRGBSurface(SDL_SWSURFACE, 1, 1, 32,
+            rgba.rmask, rgba.gmask, rgba.bmask, rgba.amask) };
+        if (tmp == nullptr) return nullptr;
+        converted = SDLSurfaceUniquePtr { SDL_ConvertSurface(src, tmp->format, SDL_SWSURFACE) };
+        if (converted == nullptr) return nullptr;
+        src = converted.get();
+    }
+
+    SDLSurfaceUniquePtr dst { SDL_CreateRGBSurface(SDL_SWSURFACE, p_w, p_h,
+        p_layout.bpp, p_layout.rmask, p_layout.gmask, p_layout.bmask,
+        p_layout.amask) };
+    if (dst == nullptr) return nullptr;
+
+    const FilterTable htable = makeFilterTable(src->w, p_w);
+    const FilterTable vtable = makeFilterTable(src->h, p_h);
+    const int row_len = p_w * 4;
+    RowCache cache(vtable.max_taps + 1, row_len);
+    std::vector<std::uint8_t> unpacked(static_cast<std::size_t>(src->w) * 4);
+    std::vector<std::uint8_t> out(row_len);
+    std::vector<const std::uint16_t *> rows(vtable.max_taps);
+
+    if (SDL_MUSTLOCK(src)) SDL_LockSurface(src);
+    for (int y = 0; y < p_h; ++y) {
+        const int first = vtable.first[y];
+        const int taps = vtable.count[y];
+        for (int t = 0; t < taps; ++t) {
+            bool missing;
+            std::uint16_t *row = cache.get(first + t, &missing);
+            if (missing) {
+                const Uint32 *src_row = reinterpret_cast<const Uint32 *>(
+                    static_cast<const std::uint8_t *>(src->pixels)
+                    + static_cast<std::size_t>(first + t) * src->pitch);
+                unpackRow(src->format, src_row, src->w, unpacked.data());
+                horizontalPass(htable, unpacked.data(), p_w, row);
+            }
+            rows[t] = row;
+        }
+        verticalPass(rows.data(),
+            &vtable.weights[static_cast<std::size_t>(y) * vtable.max_taps],
+            taps, row_len, out.data());
+        std::uint8_t *dst_row = static_cast<std::uint8_t *>(dst->pixels)
+            + static_cast<std::size_t>(y) * dst->pitch;
+        if (p_layout.bpp == 32) {
+            packRow(dst->format, out.data(), p_w, reinterpret_cast<Uint32 *>(dst_row));
+        } else {
+            packRow(dst->format, out.data(), p_w, reinterpret_cast<Uint16 *>(dst_row));
+        }
+    }
+    if (SDL_MUSTLOCK(src)) SDL_UnlockSurface(src);
+    return dst;
+}
+
+} // namespace Image_utils
@@ -0,0 +1,34 @@
+#ifndef IMAGE_SCALER_H_
+#define IMAGE_SCALER_H_
+
+#include <SDL.h>
+
+#include "sdl_ptrs.h"
+
+namespace Image_utils
+{
+    // A pixel layout to scale into, e.g. that of the screen.
+    // Unlike SDL_PixelFormat, it is a plain value that can be passed to
+    // another thread.
+    struct PixelLayout
+    {
+        int bpp;
+        Uint32 rmask, gmask, bmask, amask;
+
+        static PixelLayout of(const SDL_PixelFormat *p_format);
+
+        // 32-bit with an alpha channel, bytes in RGBA order in memory.
+        static PixelLayout rgba32();
+
+        bool matches(const SDL_PixelFormat *p_format) const;
+    };
+
+    // Scales the surface to the given size using separable area-averaging
+    // when shrinking and bilinear filtering when enlarging, writing directly
+    // into a new surface with the given layout (16 or 32 bits per pixel).
+    //
+    // Can be called from any thread.
+    SDLSurfaceUniquePtr scale(SDL_Surface *p_src, int p_w, int p_h, const PixelLayout &p_layout);
+}
+
+#endif // IMAGE_SCALER_H_
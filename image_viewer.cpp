@@ -2,19 +2,47 @@
 
 #include "config.h"
 #include "def.h"
+#include "image_cache.h"
 #include "resourceManager.h"
 #include "screen.h"
 #include "sdlutils.h"
 #include "text_viewer.h"
 
 #include <algorithm>
-#include <sys/stat.h>
+#include <cmath>
+#include <utility>
+
+namespace {
+
+// Zoom steps are powers of sqrt(2), so that 1:1 is one of them.
+constexpr double kZoomStepsPerDoubling = 2;
+
+// Relative to the logical pixel size.
+constexpr double kMaxZoom = 4;
+
+// Panning moves the view by this fraction of the screen size.
+constexpr double kPanStep = 0.25;
+
+} // namespace
 
 ImageViewer::ImageViewer(CPanel *panel)
-    : panel_(panel), showTitle_(false)
+    : panel_(panel)
+    , playlist_(*panel, panel->getHighlightedIndex())
+    , position_(playlist_.find(panel->getHighlightedIndex()))
+    , showTitle_(false)
 {
     init();
-    setPath(panel->getHighlightedItemFull());
+    // The first image is loaded synchronously so that the caller can fall
+    // back to another viewer if it cannot be decoded.
+    setPath(std::string { playlist_.path(position_) });
+    if (ok_) showImage(position_, 1);
+}
+
+ImageViewer::~ImageViewer()
+{
+    // Leave the panel cursor on the last viewed image.
+    panel_->moveCursorToIndex(grid_mode_ ? grid_.selectedPanelIndex()
+                                         : playlist_.panelIndex(position_));
 }
 
 void ImageViewer::init()
@@ -42,132 +70,517 @@ void ImageViewer::init()
     }
 }
 
+ImageCache::Key ImageViewer::cacheKey(const std::string &path)
+{
+    auto it = keys_.find(path);
+    if (it != keys_.end()) return it->second;
+    ImageCache::Key key;
+    if (!ImageCache::makeKey(path, screen.w * screen.ppu_x,
+            screen.h * screen.ppu_y, &key)) {
+        key = ImageCache::Key { path, 0, 0, 0 };
+    }
+    keys_.emplace(path, key);
+    return key;
+}
+
 void ImageViewer::setPath(std::string &&path)
 {
     filename_ = std::move(path);
     image_ = nullptr;
-
-    // Load image scaled to fit the screen
-    image_ = SDLSurfaceUniquePtr{
-        SDL_utils::loadImageToFit(filename_, screen.w, screen.h)
-    };
+    keys_.clear();
+
+    const ImageCache::Key key = cacheKey(filename_);
+    image_ = ImageCache::instance().get(key);
+    if (image_ == nullptr) {
+        // Show the thumbnail embedded in large photos at first, and decode
+        // the full image in the background.
+        image_ = SDLSurfaceSharedPtr { SDL_utils::convertImageToDisplayFormat(
+            SDL_utils::decodeImagePreviewToFit(filename_, screen.w, screen.h,
+                screen.ppu_x, screen.ppu_y,
+                Image_utils::PixelLayout::of(screen.surface->format)),
+            filename_) };
+        loading_ = (image_ != nullptr);
+    }
+    if (image_ == nullptr) {
+        // Load image scaled to fit the screen
+        image_ = SDLSurfaceSharedPtr { SDL_utils::loadImageToFit(
+            filename_, screen.w, screen.h) };
+        ImageCache::instance().put(key, image_);
+    }
     ok_ = (image_ != nullptr);
 }
 
 void ImageViewer::onResize()
 {
     // Recreate background and reload the image when the window is resized
+    resetDecoding();
+    leaveZoom();
     image_ = nullptr;
     background_ = nullptr;
     init();
-    setPath(std::move(filename_));
+    loading_ = true;
+    showImage(position_, 1);
+    if (grid_mode_) grid_.onResize();
+}
+
+void ImageViewer::resetDecoding()
+{
+    decoder_.clearPending();
+    in_flight_.clear();
+    prefetched_.clear();
+    keys_.clear();
+    ++generation_;
+}
+
+void ImageViewer::dropQueuedRequests()
+{
+    decoder_.clearPending();
+    in_flight_.clear();
+    std::lock_guard<std::mutex> lock(decoded_mutex_);
+    for (const auto &running : running_) {
+        if (running.first == generation_) in_flight_.insert(running.second);
+    }
+    for (const auto &result : decoded_) {
+        if (!result.preview && result.generation == generation_)
+            in_flight_.insert(result.key.path);
+    }
+}
+
+void ImageViewer::requestPreview(const std::string &path)
+{
+    const unsigned generation = generation_;
+    const ImageCache::Key key = cacheKey(path);
+    const int fit_w = screen.w;
+    const int fit_h = screen.h;
+    const float ppu_x = screen.ppu_x;
+    const float ppu_y = screen.ppu_y;
+    const Image_utils::PixelLayout layout
+        = Image_utils::PixelLayout::of(screen.surface->format);
+    decoder_.enqueue(
+        [this, key, generation, fit_w, fit_h, ppu_x, ppu_y, layout]() {
+        SDLSurfaceUniquePtr surface = SDL_utils::decodeImagePreviewToFit(
+            key.path, fit_w, fit_h, ppu_x, ppu_y, layout);
+        if (surface == nullptr) return;
+        std::lock_guard<std::mutex> lock(decoded_mutex_);
+        decoded_.push_back(
+            DecodedImage { key, generation, /*preview=*/true, std::move(surface) });
+    });
+}
+
+void ImageViewer::requestImage(const std::string &path)
+{
+    if (!in_flight_.insert(path).second) return;
+    const unsigned generation = generation_;
+    const ImageCache::Key key = cacheKey(path);
+    const int fit_w = screen.w;
+    const int fit_h = screen.h;
+    const float ppu_x = screen.ppu_x;
+    const float ppu_y = screen.ppu_y;
+    const Image_utils::PixelLayout layout
+        = Image_utils::PixelLayout::of(screen.surface->format);
+    decoder_.enqueue(
+        [this, key, generation, fit_w, fit_h, ppu_x, ppu_y, layout]() {
+        {
+            std::lock_guard<std::mutex> lock(decoded_mutex_);
+            running_.emplace(generation, key.path);
+        }
+        SDLSurfaceUniquePtr surface = SDL_utils::decodeImageToFit(
+            key.path, fit_w, fit_h, ppu_x, ppu_y, layout);
+        std::lock_guard<std::mutex> lock(decoded_mutex_);
+        running_.erase(std::make_pair(generation, key.path));
+        decoded_.push_back(
+            DecodedImage { key, generation, /*preview=*/false, std::move(surface) });
+    });
+}
+
+bool ImageViewer::collectDecodedImages()
+{
+    std::vector<DecodedImage> decoded;
+    {
+        std::lock_guard<std::mutex> lock(decoded_mutex_);
+        decoded.swap(decoded_);
+    }
+    bool changed = false;
+    for (auto &result : decoded) {
+        if (result.generation != generation_) continue;
+        const std::string &path = result.key.path;
+        if (result.preview) {
+            // Only shown until the full image is decoded.
+            if (loading_ && path == filename_ && image_ == nullptr) {
+                image_ = SDLSurfaceSharedPtr {
+                    SDL_utils::convertImageToDisplayFormat(
+                        std::move(result.surface), path)
+                };
+                changed = true;
+            }
+            continue;
+        }
+        in_flight_.erase(path);
+        SDLSurfaceSharedPtr surface {
+            SDL_utils::convertImageToDisplayFormat(
+                std::move(result.surface), path)
+        };
+        ImageCache::instance().put(result.key, surface);
+        if (loading_ && path == filename_) {
+            // Keep the preview if the full image fails to decode.
+            if (surface != nullptr) image_ = std::move(surface);
+            loading_ = false;
+            changed = true;
+        } else if (path == prev_path_ || path == next_path_) {
+            prefetched_[path] = std::move(surface);
+        }
+    }
+    return changed;
+}
+
+bool ImageViewer::findDecodedImage(
+    const std::string &path, SDLSurfaceSharedPtr *surface)
+{
+    auto it = prefetched_.find(path);
+    if (it != prefetched_.end()) {
+        *surface = it->second;
+        return true;
+    }
+    *surface = ImageCache::instance().get(cacheKey(path));
+    return *surface != nullptr;
+}
+
+void ImageViewer::showImage(std::size_t position, int direction)
+{
+    collectDecodedImages();
+    const std::string &path = playlist_.path(position);
+    if (path != filename_) {
+        leaveZoom();
+        keys_.clear();
+    }
+    if (path != filename_ || image_ == nullptr) {
+        if (image_ != nullptr && !loading_) prefetched_[filename_] = image_;
+        loading_ = !findDecodedImage(path, &image_);
+    }
+    filename_ = path;
+    position_ = position;
+
+    // Decode the current image first, then its neighbours, starting with the
+    // one in the direction of travel.
+    dropQueuedRequests();
+    if (loading_) {
+        if (image_ == nullptr) requestPreview(filename_);
+        requestImage(filename_);
+    }
+    const std::size_t next = neighbour(position, direction);
+    const std::size_t prev = neighbour(position, -direction);
+    next_path_ = next == ImagePlaylist::npos ? "" : playlist_.path(next);
+    prev_path_ = prev == ImagePlaylist::npos ? "" : playlist_.path(prev);
+    for (auto it = prefetched_.begin(); it != prefetched_.end();) {
+        if (it->first != next_path_ && it->first != prev_path_)
+            it = prefetched_.erase(it);
+        else
+            ++it;
+    }
+    SDLSurfaceSharedPtr neighbour;
+    if (!next_path_.empty()) {
+        if (findDecodedImage(next_path_, &neighbour))
+            prefetched_[next_path_] = neighbour;
+        else
+            requestImage(next_path_);
+    }
+    if (!prev_path_.empty()) {
+        if (findDecodedImage(prev_path_, &neighbour))
+            prefetched_[prev_path_] = neighbour;
+        else
+            requestImage(prev_path_);
+    }
 }
 
 void ImageViewer::render(const bool focused) const
 {
+    if (grid_mode_) {
+        grid_.render();
+        renderTitle(grid_.selectedPath());
+        return;
+    }
+
     // Draw background
     SDL_utils::applyPpuScaledSurface(0, 0, background_.get(), screen.surface);
 
-    // Draw centered image
-    SDL_utils::applyPpuScaledSurface(
-        (screen.actual_w - image_->w) / 2,
-        (screen.actual_h - image_->h) / 2,
-        image_.get(), screen.surface
-    );
+    if (zoomed()) {
+        zoom_image_->render(screen.surface,
+            SDL_utils::makeRect(0, 0, screen.actual_w, screen.actual_h), zoom_,
+            zoom_ * screen.ppu_y / screen.ppu_x, center_x_, center_y_);
+    } else if (image_ != nullptr) {
+        // Draw centered image
+        SDL_utils::applyPpuScaledSurface(
+            (screen.actual_w - image_->w) / 2,
+            (screen.actual_h - image_->h) / 2,
+            image_.get(), screen.surface
+        );
+    }
 
     // Draw title bar if enabled
-    if (showTitle_) {
-        const auto &fonts = CResourceManager::instance().getFonts();
+    if (showTitle_) renderTitle(filename_);
+}
+
+void ImageViewer::renderTitle(const std::string &title) const
+{
+    const auto &fonts = CResourceManager::instance().getFonts();
 
-        // Draw background rectangle for title
-        SDL_Rect rect = SDL_utils::Rect(0, 0, screen.actual_w, HEADER_H * screen.ppu_y);
-        SDL_FillRect(screen.surface, &rect, SDL_MapRGB(screen.surface->format, COLOR_BORDER));
+    // Draw background rectangle for title
+    SDL_Rect rect = SDL_utils::Rect(0, 0, screen.actual_w, HEADER_H * screen.ppu_y);
+    SDL_FillRect(screen.surface, &rect, SDL_MapRGB(screen.surface->format, COLOR_BORDER));
 
-        // Render title text
-        SDLSurfaceUniquePtr tmp{
-            SDL_utils::renderText(fonts, filename_, Globals::g_colorTextTitle, { COLOR_TITLE_BG })
-        };
+    // Render title text
+    SDLSurfaceUniquePtr tmp{
+        SDL_utils::renderText(fonts, title, Globals::g_colorTextTitle, { COLOR_TITLE_BG })
+    };
 
-        SDL_utils::applyPpuScaledSurface(2 * screen.ppu_x, HEADER_PADDING_TOP * screen.ppu_y,
-                                         tmp.get(), screen.surface);
-    }
+    SDL_utils::applyPpuScaledSurface(2 * screen.ppu_x, HEADER_PADDING_TOP * screen.ppu_y,
+                                     tmp.get(), screen.surface);
 }
 
-// --- Helper: check if a file is an image with supported extension ---
-static bool isSupportedImageFile(const std::string& filename) {
-    static const std::vector<std::string> exts = {".png", ".jpg", ".jpeg", ".bmp", ".gif"};
-    std::string lower = filename;
-
-    // Convert to lowercase
-    std::transform(lower.begin(), lower.end(), lower.begin(),
-                   [](unsigned char c){ return std::tolower(c); });
+std::size_t ImageViewer::neighbour(std::size_t position, int direction) const
+{
+    if (direction < 0) return position == 0 ? ImagePlaylist::npos : position - 1;
+    return position + 1 < playlist_.size() ? position + 1 : ImagePlaylist::npos;
+}
 
-    for (const auto& ext : exts) {
-        if (lower.size() >= ext.size() &&
-            lower.compare(lower.size() - ext.size(), ext.size(), ext) == 0) {
-            return true;
+void ImageViewer::toggleGrid()
+{
+    if (!grid_mode_) {
+        leaveZoom();
+        std::vector<ThumbnailGrid::Image> images;
+        images.reserve(playlist_.size());
+        for (std::size_t i = 0; i < playlist_.size(); ++i) {
+            images.push_back(ThumbnailGrid::Image { playlist_.panelIndex(i),
+                playlist_.path(i) });
         }
+        grid_.open(std::move(images), playlist_.panelIndex(position_));
+        grid_mode_ = true;
+        return;
     }
-    return false;
+    const std::size_t position = playlist_.find(grid_.selectedPanelIndex());
+    grid_.close();
+    grid_mode_ = false;
+    if (position != ImagePlaylist::npos && position != position_)
+        showImage(position, 1);
 }
 
-// --- Helper: check if a path is a directory ---
-static bool isDirectory(const std::string& path) {
-    struct stat s;
-    if (stat(path.c_str(), &s) == 0) {
-        return (s.st_mode & S_IFDIR);
+bool ImageViewer::gridKeyPress(SDLC_Keycode key, ControllerButton button)
+{
+    const auto &c = config();
+    if (key == c.key_open || button == c.gamepad_open) {
+        toggleGrid();
+        return true;
     }
+    const int page = grid_.columns() * grid_.rows();
+    if (key == c.key_up || button == c.gamepad_up)
+        return grid_.moveSelection(-grid_.columns());
+    if (key == c.key_down || button == c.gamepad_down)
+        return grid_.moveSelection(grid_.columns());
+    if (key == c.key_left || button == c.gamepad_left)
+        return grid_.moveSelection(-1);
+    if (key == c.key_right || button == c.gamepad_right)
+        return grid_.moveSelection(1);
+    if (key == c.key_pageup || button == c.gamepad_pageup)
+        return grid_.moveSelection(-page);
+    if (key == c.key_pagedown || button == c.gamepad_pagedown)
+        return grid_.moveSelection(page);
+    return false;
+}
+
+bool ImageViewer::gridKeyHold()
+{
+    const auto &c = config();
+    const int page = grid_.columns() * grid_.rows();
+    if (tick(c.key_up)) return grid_.moveSelection(-grid_.columns());
+    if (tick(c.key_down)) return grid_.moveSelection(grid_.columns());
+    if (tick(c.key_left)) return grid_.moveSelection(-1);
+    if (tick(c.key_right)) return grid_.moveSelection(1);
+    if (tick(c.key_pageup)) return grid_.moveSelection(-page);
+    if (tick(c.key_pagedown)) return grid_.moveSelection(page);
     return false;
 }
 
-// --- Helper: restore panel cursor to a previous file path ---
-// Used when no valid image is found, so the selection goes back
-// to the file that was selected before navigation started.
-static void restoreSelection(CPanel* panel, const std::string& old_path) {
-    // Try moving upwards until we find the old path
-    while (true) {
-        std::string current = panel->getHighlightedItemFull();
-        if (current == old_path) return; // found it
-        if (!panel->moveCursorUp(1)) break;
+#if SDL_VERSION_ATLEAST(2, 0, 0)
+bool ImageViewer::gridGamepadHold(SDL_GameController *controller)
+{
+    const auto &c = config();
+    const int page = grid_.columns() * grid_.rows();
+    if (tick(controller, c.gamepad_up)) return grid_.moveSelection(-grid_.columns());
+    if (tick(controller, c.gamepad_down)) return grid_.moveSelection(grid_.columns());
+    if (tick(controller, c.gamepad_left)) return grid_.moveSelection(-1);
+    if (tick(controller, c.gamepad_right)) return grid_.moveSelection(1);
+    if (tick(controller, c.gamepad_pageup)) return grid_.moveSelection(-page);
+    if (tick(controller, c.gamepad_pagedown)) return grid_.moveSelection(page);
+    return false;
+}
+#endif
+
+void ImageViewer::requestZoomImage()
+{
+    zoom_loading_ = true;
+    const unsigned generation = generation_;
+    const std::string path = filename_;
+    const std::size_t max_bytes
+        = static_cast<std::size_t>(std::max(config().zoom_image_kb, 0)) * 1024;
+    const Image_utils::PixelLayout layout = SDL_utils::imageLayout(
+        path, Image_utils::PixelLayout::of(screen.surface->format));
+    // Ahead of the prefetching, which is requested again on the next image.
+    dropQueuedRequests();
+    decoder_.enqueue([this, path, generation, max_bytes, layout]() {
+        std::unique_ptr<TiledImage> image
+            = TiledImage::load(path, max_bytes, layout);
+        std::lock_guard<std::mutex> lock(decoded_mutex_);
+        decoded_zoom_.push_back(ZoomImage { path, generation, std::move(image) });
+    });
+    if (loading_) requestImage(filename_);
+}
+
+bool ImageViewer::collectZoomImage()
+{
+    std::vector<ZoomImage> decoded;
+    {
+        std::lock_guard<std::mutex> lock(decoded_mutex_);
+        decoded.swap(decoded_zoom_);
     }
-    // If not found upwards, try moving downwards
-    while (true) {
-        std::string current = panel->getHighlightedItemFull();
-        if (current == old_path) return; // trouvé
-        if (!panel->moveCursorDown(1)) break;
+    bool changed = false;
+    for (auto &result : decoded) {
+        if (result.generation != generation_ || result.path != filename_
+            || !zoom_loading_)
+            continue;
+        zoom_loading_ = false;
+        zoom_image_ = std::move(result.image);
+        if (zoom_requested_ && zoom_image_ != nullptr) changed = zoomIn();
+        zoom_requested_ = false;
     }
-    // If not found at all, leave cursor where it is
+    return changed;
 }
 
-bool ImageViewer::nextOrPreviousImage(int direction)
+double ImageViewer::fitZoom() const
 {
-    std::string old_path = panel_->getHighlightedItemFull();
+    const double scale = std::min(1.0,
+        std::min(static_cast<double>(screen.w) / zoom_image_->width(),
+            static_cast<double>(screen.h) / zoom_image_->height()));
+    return scale * screen.ppu_x;
+}
 
-    while (true) {
-        if (direction == -1) {
-            if (!panel_->moveCursorUp(1)) break;
-        } else {
-            if (!panel_->moveCursorDown(1)) break;
-        }
+bool ImageViewer::zoomIn()
+{
+    if (zoom_image_ == nullptr) {
+        if (!zoom_loading_) requestZoomImage();
+        zoom_requested_ = true;
+        return false;
+    }
+    const double max_zoom = kMaxZoom * screen.ppu_x;
+    const double current = zoomed() ? zoom_ : fitZoom();
+    if (current >= max_zoom) return false;
+    if (!zoomed()) {
+        center_x_ = zoom_image_->width() / 2.0;
+        center_y_ = zoom_image_->height() / 2.0;
+    }
+    // The next step, skipping steps that are barely larger.
+    const double step = std::floor(
+        std::log2(current * 1.01) * kZoomStepsPerDoubling + 1);
+    zoom_ = std::min(max_zoom, std::exp2(step / kZoomStepsPerDoubling));
+    clampCenter();
+    return true;
+}
+
+bool ImageViewer::zoomOut()
+{
+    if (!zoomed()) return false;
+    const double step = std::ceil(
+        std::log2(zoom_ / 1.01) * kZoomStepsPerDoubling - 1);
+    const double zoom = std::exp2(step / kZoomStepsPerDoubling);
+    if (zoom <= fitZoom() * 1.01) return resetZoom();
+    zoom_ = zoom;
+    clampCenter();
+    return true;
+}
+
+bool ImageViewer::resetZoom()
+{
+    zoom_requested_ = false;
+    if (!zoomed()) return false;
+    zoom_ = 0;
+    return true;
+}
 
-        std::string new_path = panel_->getHighlightedItemFull();
+void ImageViewer::leaveZoom()
+{
+    resetZoom();
+    zoom_image_ = nullptr;
+    zoom_loading_ = false;
+}
 
-        if (File_utils::getFileName(new_path) == "..") continue;
-        if (isDirectory(new_path)) continue;
-        if (!isSupportedImageFile(new_path)) continue;
+void ImageViewer::clampCenter()
+{
+    const double zoom_y = zoom_ * screen.ppu_y / screen.ppu_x;
+    const auto clamp = [](double center, double size, double view_size) {
+        // Centered if the image is smaller than the view.
+        if (size <= view_size) return size / 2;
+        return std::max(view_size / 2, std::min(size - view_size / 2, center));
+    };
+    center_x_ = clamp(
+        center_x_, zoom_image_->width(), screen.actual_w / zoom_);
+    center_y_ = clamp(
+        center_y_, zoom_image_->height(), screen.actual_h / zoom_y);
+}
 
-        constexpr std::size_t kMaxFileSize = 16777216; // = 16 MB
-        if (File_utils::getFileSize(new_path) > kMaxFileSize) continue;
+bool ImageViewer::pan(double dx, double dy)
+{
+    const double old_x = center_x_;
+    const double old_y = center_y_;
+    center_x_ += dx * screen.actual_w / zoom_;
+    center_y_ += dy * screen.actual_h * screen.ppu_x / (zoom_ * screen.ppu_y);
+    clampCenter();
+    return center_x_ != old_x || center_y_ != old_y;
+}
 
-        setPath(std::move(new_path));
-        return ok();
-    }
+bool ImageViewer::zoomKeyPress(SDLC_Keycode key, ControllerButton button)
+{
+    const auto &c = config();
+    if (key == c.key_open || button == c.gamepad_open) return resetZoom();
+    if (key == c.key_up || button == c.gamepad_up) return pan(0, -kPanStep);
+    if (key == c.key_down || button == c.gamepad_down) return pan(0, kPanStep);
+    if (key == c.key_left || button == c.gamepad_left) return pan(-kPanStep, 0);
+    if (key == c.key_right || button == c.gamepad_right) return pan(kPanStep, 0);
+    return false;
+}
 
-    // No valid image found → restore previous selection
-    restoreSelection(panel_, old_path);
+bool ImageViewer::zoomKeyHold()
+{
+    const auto &c = config();
+    if (tick(c.key_up)) return pan(0, -kPanStep);
+    if (tick(c.key_down)) return pan(0, kPanStep);
+    if (tick(c.key_left)) return pan(-kPanStep, 0);
+    if (tick(c.key_right)) return pan(kPanStep, 0);
+    if (tick(c.key_pageup)) return zoomIn();
+    if (tick(c.key_pagedown)) return zoomOut();
     return false;
 }
 
+#if SDL_VERSION_ATLEAST(2, 0, 0)
+bool ImageViewer::zoomGamepadHold(SDL_GameController *controller)
+{
+    const auto &c = config();
+    if (tick(controller, c.gamepad_up)) return pan(0, -kPanStep);
+    if (tick(controller, c.gamepad_down)) return pan(0, kPanStep);
+    if (tick(controller, c.gamepad_left)) return pan(-kPanStep, 0);
+    if (tick(controller, c.gamepad_right)) return pan(kPanStep, 0);
+    if (tick(controller, c.gamepad_pageup)) return zoomIn();
+    if (tick(controller, c.gamepad_pagedown)) return zoomOut();
+    return false;
+}
+#endif
+
+bool ImageViewer::nextOrPreviousImage(int direction)
+{
+    const std::size_t position = neighbour(position_, direction);
+    if (position == ImagePlaylist::npos) return false;
+    showImage(position, direction);
+    return true;
+}
+
 // Key press management
 bool ImageViewer::keyPress(
     const SDL_Event &event, SDLC_Keycode key, ControllerButton button)
@@ -182,6 +595,23 @@ bool ImageViewer::keyPress(
         return true;
     }
 
+    // Toggle thumbnail grid
+    if (key == c.key_operation || button == c.gamepad_operation) {
+        toggleGrid();
+        return true;
+    }
+
+    if (grid_mode_) return gridKeyPress(key, button);
+
+    // Zoom in and out. SELECT cycles through the zoom steps for devices
+    // without page keys.
+    if (key == c.key_pageup || button == c.gamepad_pageup) return zoomIn();
+    if (key == c.key_pagedown || button == c.gamepad_pagedown) return zoomOut();
+    if (key == c.key_select || button == c.gamepad_select)
+        return zoomIn() || (zoomed() && resetZoom());
+
+    if (zoomed()) return zoomKeyPress(key, button);
+
     // Previous image
     if (key == c.key_up || button == c.gamepad_up ||
         key == c.key_left || button == c.gamepad_left) return actionUp();
@@ -206,15 +636,21 @@ bool ImageViewer::actionRight() { return nextOrPreviousImage(1); }
 
 bool ImageViewer::keyHold()
 {
+    // Called every frame, so this is where background results are picked up.
+    const bool changed = collectDecodedImages() | collectZoomImage();
+    if (grid_mode_) return grid_.collectThumbnails() | gridKeyHold();
+    if (zoomed()) return zoomKeyHold() || changed;
     const auto &c = config();
-    if (tick(c.key_up) || tick(c.key_left)) return actionUp();
-    if (tick(c.key_down) || tick(c.key_right)) return actionDown();
-    return false;
+    if (tick(c.key_up) || tick(c.key_left)) return actionUp() || changed;
+    if (tick(c.key_down) || tick(c.key_right)) return actionDown() || changed;
+    return changed;
 }
 
 #if SDL_VERSION_ATLEAST(2, 0, 0)
-bool CCommander::gamepadHold(SDL_GameController *controller)
+bool ImageViewer::gamepadHold(SDL_GameController *controller)
 {
+    if (grid_mode_) return gridGamepadHold(controller);
+    if (zoomed()) return zoomGamepadHold(controller);
     const auto &c = config();
     if (tick(controller, c.gamepad_up) || tick(controller, c.gamepad_left)) return actionUp();
     if (tick(controller, c.gamepad_down) || tick(controller, c.gamepad_right)) return actionDown();
@@ -225,6 +661,12 @@ bool CCommander::gamepadHold(SDL_GameController *controller)
 bool ImageViewer::mouseWheel(int dx, int dy)
 {
     CWindow::mouseWheel(dx, dy);
+    if (grid_mode_) {
+        if (dy < 0) return grid_.moveSelection(-grid_.columns());
+        if (dy > 0) return grid_.moveSelection(grid_.columns());
+        return false;
+    }
+    if (zoomed()) return dy != 0 && pan(0, dy > 0 ? -kPanStep : kPanStep);
     if (dy < 0) return nextOrPreviousImage(-1);
     if (dy > 0) return nextOrPreviousImage(1);
     return false;
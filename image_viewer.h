@@ -2,16 +2,27 @@
 #define IMAGE_VIEWER_H_
 
 #include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "image_cache.h"
+#include "image_playlist.h"
 #include "panel.h"
 #include "sdl_ptrs.h"
+#include "thumbnail_grid.h"
+#include "tiled_image.h"
 #include "window.h"
+#include "worker_pool.h"
 
 class ImageViewer : public CWindow {
   public:
     explicit ImageViewer(CPanel *panel);
-    virtual ~ImageViewer() = default;
+    virtual ~ImageViewer();
 
     ImageViewer(const ImageViewer &) = delete;
     ImageViewer &operator=(const ImageViewer &) = delete;
@@ -22,6 +33,7 @@ class ImageViewer : public CWindow {
     void setPath(std::string &&path);
     void init();
     void render(const bool focused) const override;
+    void renderTitle(const std::string &title) const;
 
     // Key press management
     bool keyPress(const SDL_Event &event, SDLC_Keycode key,
@@ -39,19 +51,169 @@ class ImageViewer : public CWindow {
 
     bool nextOrPreviousImage(int direction);
 
+    // Returns the playlist position next to `position` in the given
+    // direction, or `ImagePlaylist::npos` if there is none.
+    std::size_t neighbour(std::size_t position, int direction) const;
+
+    // Shows the image at the given playlist position, decoding it in the
+    // background if it has not been prefetched.
+    void showImage(std::size_t position, int direction);
+
+    // Decodes the image on the worker thread unless it is already being
+    // decoded.
+    void requestImage(const std::string &path);
+
+    // Decodes the thumbnail embedded in the image on the worker thread, to be
+    // shown until the full image is decoded.
+    void requestPreview(const std::string &path);
+
+    // Looks up a prefetched or cached image.
+    // A null surface with a true result means the image failed to decode.
+    bool findDecodedImage(const std::string &path, SDLSurfaceSharedPtr *surface);
+
+    // Stats the file only once per navigation.
+    ImageCache::Key cacheKey(const std::string &path);
+
+    // Moves the images decoded by the worker thread to the main thread.
+    // Returns true if the current image has changed.
+    bool collectDecodedImages();
+
+    // Discards all the queued and decoded images.
+    void resetDecoding();
+
+    // Discards the decodes that have not started yet. The results of the
+    // running ones are still accepted.
+    void dropQueuedRequests();
+
+    // Switches between the single image and the thumbnail grid.
+    // Leaving the grid shows the selected image.
+    void toggleGrid();
+
+    bool gridKeyPress(SDLC_Keycode key, ControllerButton button);
+    bool gridKeyHold();
+#if SDL_VERSION_ATLEAST(2, 0, 0)
+    bool gridGamepadHold(SDL_GameController *controller);
+#endif
+
+    bool zoomKeyPress(SDLC_Keycode key, ControllerButton button);
+    bool zoomKeyHold();
+#if SDL_VERSION_ATLEAST(2, 0, 0)
+    bool zoomGamepadHold(SDL_GameController *controller);
+#endif
+
+    // Zooms in by one step, decoding the image at full resolution on the
+    // worker thread first if needed.
+    bool zoomIn();
+
+    // Zooms out by one step, back to fitting the screen.
+    bool zoomOut();
+
+    // Fits the image to the screen again.
+    bool resetZoom();
+
+    // Also discards the full-resolution image.
+    void leaveZoom();
+
+    bool zoomed() const { return zoom_ != 0; }
+
+    // The zoom at which the image fits the screen without being enlarged.
+    double fitZoom() const;
+
+    // Moves the view by the given fraction of the screen size.
+    bool pan(double dx, double dy);
+
+    // Keeps the view within the image.
+    void clampCenter();
+
+    void requestZoomImage();
+
+    // Picks up the full-resolution image decoded by the worker thread.
+    // Returns true if the view has changed.
+    bool collectZoomImage();
+
     SDLSurfaceUniquePtr background_;
-    SDLSurfaceUniquePtr image_;
+    SDLSurfaceSharedPtr image_;
     bool ok_;
     CPanel *panel_;
     std::string filename_;
 
+    // The images in the panel. The panel cursor is only moved on exit.
+    ImagePlaylist playlist_;
+    std::size_t position_;
+
+    // True while the current image is being decoded.
+    // Its low-resolution preview may be shown meanwhile.
+    bool loading_ = false;
+
     bool showTitle_;
 
+    // Prefetched images (in display format) by path.
+    // Only the neighbours of the current image are kept, regardless of
+    // whether they still fit in the image cache.
+    // A null surface means that the image could not be decoded.
+    std::map<std::string, SDLSurfaceSharedPtr> prefetched_;
+    std::string prev_path_, next_path_;
+
+    // Paths queued for decoding or being decoded.
+    std::set<std::string> in_flight_;
+
+    // Cache keys of the paths looked up since the last navigation.
+    std::map<std::string, ImageCache::Key> keys_;
+
+    // Results from the worker thread, guarded by `decoded_mutex_`.
+    struct DecodedImage {
+        ImageCache::Key key;
+        unsigned generation;
+        // A low-resolution preview of the image.
+        bool preview;
+        SDLSurfaceUniquePtr surface;
+    };
+    std::mutex decoded_mutex_;
+    std::vector<DecodedImage> decoded_;
+
+    // The generation and path of the full decodes running on the worker
+    // thread, guarded by `decoded_mutex_`.
+    std::set<std::pair<unsigned, std::string>> running_;
+
+    // Incremented to discard the results of stale requests,
+    // e.g. after a resize.
+    unsigned generation_ = 0;
+
+    // Physical pixels per original image pixel horizontally, or 0 if the image
+    // fits the screen. Vertically, the zoom also accounts for the aspect
+    // ratio of the physical pixels.
+    double zoom_ = 0;
+
+    // The point of the original image at the center of the screen.
+    double center_x_ = 0;
+    double center_y_ = 0;
+
+    // The current image in tiles, for zooming. Loaded on the first zoom in.
+    std::unique_ptr<TiledImage> zoom_image_;
+    bool zoom_loading_ = false;
+
+    // Whether to zoom in as soon as `zoom_image_` is loaded.
+    bool zoom_requested_ = false;
+
+    // Result from the worker thread, guarded by `decoded_mutex_`.
+    struct ZoomImage {
+        std::string path;
+        unsigned generation;
+        std::unique_ptr<TiledImage> image;
+    };
+    std::vector<ZoomImage> decoded_zoom_;
+
+    bool grid_mode_ = false;
+    ThumbnailGrid grid_;
+
     // Repeated actions
     bool actionUp();
     bool actionDown();
     bool actionLeft();
     bool actionRight();
+
+    // Must be destroyed first because its tasks refer to the members above.
+    WorkerPool decoder_;
 };
 
 #endif // IMAGE_VIEWER_H_
@@ -0,0 +1,667 @@
+#include "imageutils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <SDL.h>
+#include <SDL_image.h>
+
+#ifdef HAVE_LIBJPEG
+#include <csetjmp>
+#include <jpeglib.h>
+#endif
+
+#ifdef HAVE_LIBPNG
+#include <png.h>
+#endif
+
+namespace Image_utils {
+
+namespace {
+
+struct FileCloser
+{
+    void operator()(std::FILE *file) const { std::fclose(file); }
+};
+using FileUniquePtr = std::unique_ptr<std::FILE, FileCloser>;
+
+SDL_Surface *createRGBA32Surface(int p_w, int p_h)
+{
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+    return SDL_CreateRGBSurface(SDL_SWSURFACE, p_w, p_h, 32, 0xFF000000,
+        0x00FF0000, 0x0000FF00, 0x000000FF);
+#else
+    return SDL_CreateRGBSurface(SDL_SWSURFACE, p_w, p_h, 32, 0x000000FF,
+        0x0000FF00, 0x00FF0000, 0xFF000000);
+#endif
+}
+
+// Largest integer reduction factor that keeps the size at least the target.
+int reductionFactor(int p_w, int p_h, int p_target_w, int p_target_h)
+{
+    const int fx = p_target_w > 0 ? p_w / p_target_w : p_w;
+    const int fy = p_target_h > 0 ? p_h / p_target_h : p_h;
+    return std::max(1, std::min(fx, fy));
+}
+
+// Writes the rows into an RGBA surface.
+class SurfaceSink : public RowSink
+{
+    public:
+    bool begin(int p_w, int p_h) override
+    {
+        m_surface = SDLSurfaceUniquePtr { createRGBA32Surface(p_w, p_h) };
+        return m_surface != nullptr;
+    }
+
+    void addRow(const unsigned char *p_rgba) override
+    {
+        if (m_y == m_surface->h) return;
+        std::memcpy(static_cast<unsigned char *>(m_surface->pixels)
+                + static_cast<std::size_t>(m_y) * m_surface->pitch,
+            p_rgba, static_cast<std::size_t>(m_surface->w) * 4);
+        ++m_y;
+    }
+
+    SDLSurfaceUniquePtr release() { return std::move(m_surface); }
+
+    private:
+    SDLSurfaceUniquePtr m_surface;
+    int m_y = 0;
+};
+
+// Averages `factor` x `factor` blocks of pixels as rows are added, passing
+// RGBA rows of size (in_w / factor) to the sink.
+// Leftover columns and rows are merged into the last block.
+class BoxReducer
+{
+    public:
+    BoxReducer(int p_in_w, int p_in_h, int p_channels, int p_factor, RowSink &p_sink)
+        : m_in_w(p_in_w)
+        , m_in_h(p_in_h)
+        , m_channels(p_channels)
+        , m_factor(p_factor)
+        , m_out_w(std::max(1, p_in_w / p_factor))
+        , m_out_h(std::max(1, p_in_h / p_factor))
+        , m_sums(static_cast<std::size_t>(m_out_w) * 4)
+        , m_out_row(static_cast<std::size_t>(m_out_w) * 4)
+        , m_sink(p_sink)
+        , m_ok(p_sink.begin(m_out_w, m_out_h))
+    {
+    }
+
+    bool ok() const { return m_ok; }
+
+    void addRow(const unsigned char *p_row)
+    {
+        if (m_out_y == m_out_h) return;
+        if (m_factor == 1) {
+            writeRow(p_row);
+            return;
+        }
+        std::uint32_t *sum = m_sums.data();
+        for (int ox = 0; ox < m_out_w; ++ox, sum += 4) {
+            const int end = blockEnd(ox, m_out_w, m_in_w);
+            for (int x = ox * m_factor; x < end; ++x) {
+                const unsigned char *px = p_row + x * m_channels;
+                sum[0] += px[0];
+                sum[1] += px[1];
+                sum[2] += px[2];
+                sum[3] += m_channels == 4 ? px[3] : 0xFF;
+            }
+        }
+        ++m_in_y;
+        if (m_in_y == blockEnd(m_out_y, m_out_h, m_in_h)) flushBlock();
+    }
+
+    private:
+    // End of the input range for the output index `p_out`.
+    int blockEnd(int p_out, int p_out_size, int p_in_size) const
+    {
+        return p_out + 1 == p_out_size ? p_in_size : (p_out + 1) * m_factor;
+    }
+
+    void flushBlock()
+    {
+        const std::uint32_t rows = m_in_y - m_out_y * m_factor;
+        unsigned char *out = m_out_row.data();
+        for (int ox = 0; ox < m_out_w; ++ox) {
+            const std::uint32_t area = rows
+                * static_cast<std::uint32_t>(blockEnd(ox, m_out_w, m_in_w) - ox * m_factor);
+            for (int c = 0; c < 4; ++c) {
+                std::uint32_t &sum = m_sums[ox * 4 + c];
+                out[ox * 4 + c] = static_cast<unsigned char>((sum + area / 2) / area);
+                sum = 0;
+            }
+        }
+        m_sink.addRow(out);
+        ++m_out_y;
+    }
+
+    void writeRow(const unsigned char *p_row)
+    {
+        if (m_channels == 4) {
+            m_sink.addRow(p_row);
+        } else {
+            unsigned char *out = m_out_row.data();
+            for (int x = 0; x < m_out_w; ++x, out += 4, p_row += m_channels) {
+                out[0] = p_row[0];
+                out[1] = p_row[1];
+                out[2] = p_row[2];
+                out[3] = 0xFF;
+            }
+            m_sink.addRow(m_out_row.data());
+        }
+        ++m_out_y;
+    }
+
+    const int m_in_w;
+    const int m_in_h;
+    const int m_channels;
+    const int m_factor;
+    const int m_out_w;
+    const int m_out_h;
+    std::vector<std::uint32_t> m_sums;
+    std::vector<unsigned char> m_out_row;
+    RowSink &m_sink;
+    const bool m_ok;
+    int m_in_y = 0;
+    int m_out_y = 0;
+};
+
+#ifdef HAVE_LIBJPEG
+struct JpegErrorManager
+{
+    jpeg_error_mgr pub;
+    std::jmp_buf jmp;
+};
+
+void jpegErrorExit(j_common_ptr p_cinfo)
+{
+    char msg[JMSG_LENGTH_MAX];
+    (*p_cinfo->err->format_message)(p_cinfo, msg);
+    std::cerr << "decodeReduced: " << msg << std::endl;
+    std::longjmp(reinterpret_cast<JpegErrorManager *>(p_cinfo->err)->jmp, 1);
+}
+
+void jpegOutputMessage(j_common_ptr) { }
+
+// State that must survive a longjmp lives on the heap.
+struct JpegState
+{
+    jpeg_decompress_struct cinfo;
+    JpegErrorManager err;
+    std::vector<unsigned char> row;
+    std::unique_ptr<BoxReducer> reducer;
+};
+
+bool decodeJpeg(std::FILE *p_file, const TargetSizeFn &p_target_size, std::size_t p_max_bytes, RowSink &p_sink, int *p_orig_w, int *p_orig_h)
+{
+    const std::unique_ptr<JpegState> state { new JpegState };
+    jpeg_decompress_struct &cinfo = state->cinfo;
+    cinfo.err = jpeg_std_error(&state->err.pub);
+    state->err.pub.error_exit = jpegErrorExit;
+    state->err.pub.output_message = jpegOutputMessage;
+    if (setjmp(state->err.jmp)) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    jpeg_create_decompress(&cinfo);
+    // libjpeg fails rather than allocate more, as it has no backing store.
+    cinfo.mem->max_memory_to_use = static_cast<long>(std::min<std::size_t>(p_max_bytes, LONG_MAX));
+    jpeg_stdio_src(&cinfo, p_file);
+    jpeg_read_header(&cinfo, TRUE);
+    if (cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    if (cinfo.progressive_mode) {
+        // The coefficients of the whole image are kept until the last scan,
+        // whatever the output scale.
+        std::uint64_t coef_bytes = 0;
+        for (int i = 0; i < cinfo.num_components; ++i) {
+            const jpeg_component_info &comp = cinfo.comp_info[i];
+            coef_bytes += static_cast<std::uint64_t>(comp.width_in_blocks)
+                * comp.height_in_blocks * sizeof(JBLOCK);
+        }
+        if (coef_bytes > p_max_bytes) {
+            std::cerr << "decodeReduced: progressive JPEG too large" << std::endl;
+            jpeg_destroy_decompress(&cinfo);
+            return false;
+        }
+    }
+    *p_orig_w = cinfo.image_width;
+    *p_orig_h = cinfo.image_height;
+    int target_w, target_h;
+    p_target_size(cinfo.image_width, cinfo.image_height, &target_w, &target_h);
+
+    // DCT-domain scaling by 1/2, 1/4 or 1/8: supported by all libjpeg versions.
+    const int factor = reductionFactor(cinfo.image_width, cinfo.image_height, target_w, target_h);
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = factor >= 8 ? 8 : factor >= 4 ? 4 : factor >= 2 ? 2 : 1;
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.dct_method = JDCT_IFAST;
+    jpeg_start_decompress(&cinfo);
+
+    state->reducer.reset(new BoxReducer(cinfo.output_width, cinfo.output_height,
+        cinfo.output_components,
+        reductionFactor(cinfo.output_width, cinfo.output_height, target_w, target_h),
+        p_sink));
+    if (!state->reducer->ok()) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    state->row.resize(static_cast<std::size_t>(cinfo.output_width) * cinfo.output_components);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = state->row.data();
+        jpeg_read_scanlines(&cinfo, &row, 1);
+        state->reducer->addRow(state->row.data());
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+#endif
+
+#ifdef HAVE_LIBPNG
+void pngError(png_structp p_png, png_const_charp p_msg)
+{
+    std::cerr << "decodeReduced: " << p_msg << std::endl;
+    png_longjmp(p_png, 1);
+}
+
+void pngWarning(png_structp, png_const_charp) { }
+
+// State that must survive a longjmp lives on the heap.
+struct PngState
+{
+    png_structp png = nullptr;
+    png_infop info = nullptr;
+    std::vector<unsigned char> row;
+    std::unique_ptr<BoxReducer> reducer;
+
+    ~PngState() { png_destroy_read_struct(&png, info != nullptr ? &info : nullptr, nullptr); }
+};
+
+bool decodePng(std::FILE *p_file, const TargetSizeFn &p_target_size, RowSink &p_sink, int *p_orig_w, int *p_orig_h)
+{
+    const std::unique_ptr<PngState> state { new PngState };
+    state->png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, pngError, pngWarning);
+    if (state->png == nullptr) return false;
+    state->info = png_create_info_struct(state->png);
+    if (state->info == nullptr) return false;
+    png_structp png = state->png;
+    png_infop info = state->info;
+    if (setjmp(png_jmpbuf(png))) return false;
+
+    png_init_io(png, p_file);
+    png_read_info(png, info);
+    if (png_get_interlace_type(png, info) != PNG_INTERLACE_NONE) {
+        // Interlaced images cannot be decoded a row at a time.
+        return false;
+    }
+    const png_uint_32 width = png_get_image_width(png, info);
+    const png_uint_32 height = png_get_image_height(png, info);
+    *p_orig_w = width;
+    *p_orig_h = height;
+    int target_w, target_h;
+    p_target_size(width, height, &target_w, &target_h);
+
+    // Normalize to 8-bit RGBA.
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_gray_to_rgb(png);
+    png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
+    png_read_update_info(png, info);
+
+    state->reducer.reset(new BoxReducer(width, height, 4,
+        reductionFactor(width, height, target_w, target_h), p_sink));
+    if (!state->reducer->ok()) return false;
+    state->row.resize(png_get_rowbytes(png, info));
+    for (png_uint_32 y = 0; y < height; ++y) {
+        png_read_row(png, state->row.data(), nullptr);
+        state->reducer->addRow(state->row.data());
+    }
+    return true;
+}
+#endif
+
+// Reads the TIFF structure of the EXIF data, with bounds checks.
+class TiffReader
+{
+    public:
+    TiffReader(const unsigned char *p_data, std::size_t p_size)
+        : m_data(p_data)
+        , m_size(p_size)
+        , m_little_endian(p_size >= 2 && p_data[0] == 'I' && p_data[1] == 'I')
+    {
+    }
+
+    bool valid() const
+    {
+        std::uint32_t magic;
+        return m_size >= 8
+            && (m_little_endian || (m_data[0] == 'M' && m_data[1] == 'M'))
+            && u16(2, &magic) && magic == 42;
+    }
+
+    bool u16(std::size_t p_offset, std::uint32_t *p_value) const
+    {
+        if (p_offset > m_size || m_size - p_offset < 2) return false;
+        const unsigned char *p = m_data + p_offset;
+        *p_value = m_little_endian ? p[0] | (p[1] << 8) : (p[0] << 8) | p[1];
+        return true;
+    }
+
+    bool u32(std::size_t p_offset, std::uint32_t *p_value) const
+    {
+        std::uint32_t lo, hi;
+        if (!u16(p_offset + (m_little_endian ? 0 : 2), &lo)
+            || !u16(p_offset + (m_little_endian ? 2 : 0), &hi))
+            return false;
+        *p_value = (hi << 16) | lo;
+        return true;
+    }
+
+    private:
+    const unsigned char *m_data;
+    std::size_t m_size;
+    bool m_little_endian;
+};
+
+constexpr char kExifHeader[] = "Exif\0";
+constexpr std::size_t kExifHeaderSize = sizeof(kExifHeader);
+
+// Finds the JPEG thumbnail in IFD1 of the EXIF data.
+bool findExifThumbnail(const std::vector<unsigned char> &p_exif, std::size_t *p_offset, std::size_t *p_length)
+{
+    const TiffReader tiff(p_exif.data() + kExifHeaderSize, p_exif.size() - kExifHeaderSize);
+    if (!tiff.valid()) return false;
+    std::uint32_t ifd0, num_entries, ifd1;
+    if (!tiff.u32(4, &ifd0) || !tiff.u16(ifd0, &num_entries)
+        || !tiff.u32(ifd0 + 2 + 12 * num_entries, &ifd1) || ifd1 == 0
+        || !tiff.u16(ifd1, &num_entries))
+        return false;
+    std::uint32_t compression = 6, offset = 0, length = 0;
+    for (std::uint32_t i = 0; i < num_entries; ++i) {
+        const std::size_t entry = ifd1 + 2 + 12 * i;
+        std::uint32_t tag, type, value;
+        if (!tiff.u16(entry, &tag) || !tiff.u16(entry + 2, &type)) return false;
+        // SHORT values are left-aligned in the value field.
+        if (!(type == 3 ? tiff.u16(entry + 8, &value) : tiff.u32(entry + 8, &value)))
+            return false;
+        switch (tag) {
+            case 0x0103: compression = value; break;
+            case 0x0201: offset = value; break;
+            case 0x0202: length = value; break;
+        }
+    }
+    // Compression 6 is JPEG. Uncompressed thumbnails are very rare.
+    const std::size_t tiff_size = p_exif.size() - kExifHeaderSize;
+    if (compression != 6 || length == 0 || offset > tiff_size
+        || length > tiff_size - offset)
+        return false;
+    *p_offset = kExifHeaderSize + offset;
+    *p_length = length;
+    return true;
+}
+
+// Reads the JPEG markers up to the frame header, keeping the EXIF segment
+// unless `p_exif` is nullptr.
+bool readJpegHeaders(std::FILE *p_file, std::vector<unsigned char> *p_exif, int *p_w, int *p_h)
+{
+    unsigned char buf[5];
+    if (std::fread(buf, 1, 2, p_file) != 2 || buf[0] != 0xFF || buf[1] != 0xD8)
+        return false;
+    while (true) {
+        if (std::fgetc(p_file) != 0xFF) return false;
+        int marker;
+        do {
+            marker = std::fgetc(p_file);
+        } while (marker == 0xFF);
+        // EOF, end of image or start of scan before the frame header.
+        if (marker == EOF || marker == 0xD9 || marker == 0xDA) return false;
+        // Markers without a segment.
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) continue;
+        if (std::fread(buf, 1, 2, p_file) != 2) return false;
+        const std::size_t length = (buf[0] << 8) | buf[1];
+        if (length < 2) return false;
+        const std::size_t size = length - 2;
+
+        const bool is_frame_header = marker >= 0xC0 && marker <= 0xCF
+            && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (is_frame_header) {
+            if (size < 5 || std::fread(buf, 1, 5, p_file) != 5) return false;
+            *p_h = (buf[1] << 8) | buf[2];
+            *p_w = (buf[3] << 8) | buf[4];
+            return (p_exif == nullptr || !p_exif->empty()) && *p_w > 0 && *p_h > 0;
+        }
+        if (marker == 0xE1 && p_exif != nullptr && p_exif->empty()
+            && size > kExifHeaderSize) {
+            std::vector<unsigned char> data(size);
+            if (std::fread(data.data(), 1, size, p_file) != size) return false;
+            // APP1 is also used for XMP.
+            if (std::memcmp(data.data(), kExifHeader, kExifHeaderSize) == 0)
+                *p_exif = std::move(data);
+            continue;
+        }
+        if (std::fseek(p_file, static_cast<long>(size), SEEK_CUR) != 0) return false;
+    }
+}
+
+inline std::uint32_t le16(const unsigned char *p) { return p[0] | (p[1] << 8); }
+inline std::uint32_t be16(const unsigned char *p) { return (p[0] << 8) | p[1]; }
+inline std::uint32_t le32(const unsigned char *p) { return le16(p) | (le16(p + 2) << 16); }
+inline std::uint32_t be32(const unsigned char *p) { return (be16(p) << 16) | be16(p + 2); }
+
+// Reads the next number of a PNM header, skipping whitespace and comments.
+bool pnmNumber(const unsigned char *p_data, std::size_t p_size, std::size_t *p_pos, std::uint32_t *p_value)
+{
+    std::size_t i = *p_pos;
+    while (i < p_size && (std::isspace(p_data[i]) || p_data[i] == '#')) {
+        if (p_data[i] == '#')
+            while (i < p_size && p_data[i] != '\n') ++i;
+        else
+            ++i;
+    }
+    if (i == p_size || !std::isdigit(p_data[i])) return false;
+    std::uint32_t value = 0;
+    for (; i < p_size && std::isdigit(p_data[i]) && value < 0x1000000; ++i)
+        value = value * 10 + (p_data[i] - '0');
+    *p_pos = i;
+    *p_value = value;
+    return true;
+}
+
+// Reads the image size from the start of the file, for the formats that
+// SDL_image supports and whose headers have it.
+bool sizeFromHeader(const unsigned char *p_data, std::size_t p_size, const std::string &p_path, std::uint32_t *p_w, std::uint32_t *p_h)
+{
+    const unsigned char *d = p_data;
+    const auto starts_with = [d, p_size](const char *p_magic, std::size_t p_offset) {
+        const std::size_t len = std::strlen(p_magic);
+        return p_size >= p_offset + len && std::memcmp(d + p_offset, p_magic, len) == 0;
+    };
+    if (starts_with("\x89PNG", 0) && p_size >= 24) {
+        *p_w = be32(d + 16);
+        *p_h = be32(d + 20);
+    } else if ((starts_with("GIF87a", 0) || starts_with("GIF89a", 0)) && p_size >= 10) {
+        // The logical screen, which contains all the frames.
+        *p_w = le16(d + 6);
+        *p_h = le16(d + 8);
+    } else if (starts_with("BM", 0) && p_size >= 26) {
+        if (le32(d + 14) == 12) {
+            *p_w = le16(d + 18);
+            *p_h = le16(d + 20);
+        } else {
+            // Top-down bitmaps have a negative height.
+            *p_w = le32(d + 18);
+            *p_h = static_cast<std::uint32_t>(std::abs(static_cast<std::int32_t>(le32(d + 22))));
+        }
+    } else if (starts_with("RIFF", 0) && starts_with("WEBP", 8) && p_size >= 30) {
+        if (starts_with("VP8 ", 12)) {
+            *p_w = le16(d + 26) & 0x3FFF;
+            *p_h = le16(d + 28) & 0x3FFF;
+        } else if (starts_with("VP8L", 12)) {
+            *p_w = 1 + (((d[22] & 0x3F) << 8) | d[21]);
+            *p_h = 1 + (((d[24] & 0x0F) << 10) | (d[23] << 2) | (d[22] >> 6));
+        } else if (starts_with("VP8X", 12)) {
+            *p_w = 1 + (le16(d + 24) | (d[26] << 16));
+            *p_h = 1 + (le16(d + 27) | (d[29] << 16));
+        } else {
+            return false;
+        }
+    } else if (starts_with("qoif", 0) && p_size >= 12) {
+        *p_w = be32(d + 4);
+        *p_h = be32(d + 8);
+    } else if (starts_with("gimp xcf ", 0) && p_size >= 22) {
+        *p_w = be32(d + 14);
+        *p_h = be32(d + 18);
+    } else if (starts_with("II*", 0) || starts_with("MM\0*", 0)) {
+        const TiffReader tiff(d, p_size);
+        std::uint32_t ifd0, num_entries;
+        if (!tiff.valid() || !tiff.u32(4, &ifd0) || !tiff.u16(ifd0, &num_entries))
+            return false;
+        *p_w = *p_h = 0;
+        for (std::uint32_t i = 0; i < num_entries; ++i) {
+            const std::size_t entry = ifd0 + 2 + 12 * i;
+            std::uint32_t tag, type, value;
+            if (!tiff.u16(entry, &tag) || !tiff.u16(entry + 2, &type)
+                || !(type == 3 ? tiff.u16(entry + 8, &value) : tiff.u32(entry + 8, &value)))
+                return false;
+            if (tag == 0x0100) *p_w = value;
+            if (tag == 0x0101) *p_h = value;
+        }
+    } else if (d[0] == 'P' && p_size >= 2 && d[1] >= '1' && d[1] <= '6') {
+        std::size_t pos = 2;
+        if (!pnmNumber(d, p_size, &pos, p_w) || !pnmNumber(d, p_size, &pos, p_h))
+            return false;
+    } else if (d[0] == 0x0A && p_size >= 12 && d[1] <= 5 && d[2] <= 1) {
+        // PCX stores the bounds of the image.
+        *p_w = le16(d + 8) - le16(d + 4) + 1;
+        *p_h = le16(d + 10) - le16(d + 6) + 1;
+    } else {
+        // TGA has no signature.
+        const std::size_t dot = p_path.rfind('.');
+        if (dot == std::string::npos || p_size < 18) return false;
+        std::string ext = p_path.substr(dot + 1);
+        for (char &c : ext) c = std::tolower(static_cast<unsigned char>(c));
+        if (ext != "tga") return false;
+        *p_w = le16(d + 12);
+        *p_h = le16(d + 14);
+    }
+    return true;
+}
+
+} // namespace
+
+bool readImageSize(const std::string &p_path, int *p_w, int *p_h)
+{
+    FileUniquePtr file { std::fopen(p_path.c_str(), "rb") };
+    if (file == nullptr) return false;
+    unsigned char magic[3];
+    if (std::fread(magic, 1, sizeof(magic), file.get()) != sizeof(magic))
+        return false;
+    std::rewind(file.get());
+    std::uint32_t w, h;
+    if (magic[0] == 0xFF && magic[1] == 0xD8 && magic[2] == 0xFF) {
+        int jpeg_w, jpeg_h;
+        if (!readJpegHeaders(file.get(), nullptr, &jpeg_w, &jpeg_h)) return false;
+        w = jpeg_w;
+        h = jpeg_h;
+    } else {
+        // Enough for the first TIFF directory, which usually follows the
+        // header or the image data of small images.
+        std::vector<unsigned char> header(64 * 1024);
+        header.resize(std::fread(header.data(), 1, header.size(), file.get()));
+        if (!sizeFromHeader(header.data(), header.size(), p_path, &w, &h))
+            return false;
+    }
+    if (w == 0 || h == 0 || w > 0x7FFFFFFF || h > 0x7FFFFFFF) return false;
+    *p_w = static_cast<int>(w);
+    *p_h = static_cast<int>(h);
+    return true;
+}
+
+bool fitsFullDecode(const std::string &p_path, std::size_t p_max_bytes)
+{
+    int w, h;
+    if (readImageSize(p_path, &w, &h))
+        return static_cast<std::uint64_t>(w) * h * 4 <= p_max_bytes;
+    // Unknown size: assume that the pixels take at most 4 times the size of
+    // the file, as in uncompressed formats.
+    FileUniquePtr file { std::fopen(p_path.c_str(), "rb") };
+    if (file == nullptr || std::fseek(file.get(), 0, SEEK_END) != 0) return false;
+    const long size = std::ftell(file.get());
+    return size >= 0 && static_cast<std::uint64_t>(size) * 4 <= p_max_bytes;
+}
+
+SDLSurfaceUniquePtr loadFull(const std::string &p_path, std::size_t p_max_bytes)
+{
+    if (!fitsFullDecode(p_path, p_max_bytes)) {
+        std::cerr << "Image too large to decode: " << p_path << std::endl;
+        return nullptr;
+    }
+    return SDLSurfaceUniquePtr { IMG_Load(p_path.c_str()) };
+}
+
+SDLSurfaceUniquePtr decodeReduced(const std::string &p_path, const TargetSizeFn &p_target_size, std::size_t p_max_bytes, int *p_orig_w, int *p_orig_h)
+{
+    SurfaceSink sink;
+    if (!decodeReducedRows(p_path, p_target_size, p_max_bytes, sink, p_orig_w, p_orig_h))
+        return nullptr;
+    return sink.release();
+}
+
+bool decodeReducedRows(const std::string &p_path, const TargetSizeFn &p_target_size, std::size_t p_max_bytes, RowSink &p_sink, int *p_orig_w, int *p_orig_h)
+{
+    FileUniquePtr file { std::fopen(p_path.c_str(), "rb") };
+    if (file == nullptr) return false;
+    unsigned char magic[8];
+    if (std::fread(magic, 1, sizeof(magic), file.get()) != sizeof(magic))
+        return false;
+    std::rewind(file.get());
+#ifdef HAVE_LIBJPEG
+    if (magic[0] == 0xFF && magic[1] == 0xD8 && magic[2] == 0xFF)
+        return decodeJpeg(file.get(), p_target_size, p_max_bytes, p_sink, p_orig_w, p_orig_h);
+#endif
+#ifdef HAVE_LIBPNG
+    if (png_sig_cmp(magic, 0, sizeof(magic)) == 0)
+        return decodePng(file.get(), p_target_size, p_sink, p_orig_w, p_orig_h);
+#endif
+    return false;
+}
+
+SDLSurfaceUniquePtr decodeExifThumbnail(const std::string &p_path, int *p_orig_w, int *p_orig_h)
+{
+    FileUniquePtr file { std::fopen(p_path.c_str(), "rb") };
+    if (file == nullptr) return nullptr;
+    std::vector<unsigned char> exif;
+    int w, h;
+    std::size_t offset, length;
+    if (!readJpegHeaders(file.get(), &exif, &w, &h)
+        || !findExifThumbnail(exif, &offset, &length))
+        return nullptr;
+    SDLSurfaceUniquePtr thumbnail { IMG_Load_RW(
+        SDL_RWFromConstMem(exif.data() + offset, static_cast<int>(length)), 1) };
+    if (thumbnail == nullptr) {
+        SDL_ClearError();
+        return nullptr;
+    }
+    // Allow for rounding, e.g. 160x107 for 3:2.
+    const long long tw = thumbnail->w, th = thumbnail->h;
+    if (std::abs(tw * h - th * w) * 100 > 3 * th * w) return nullptr;
+    *p_orig_w = w;
+    *p_orig_h = h;
+    return thumbnail;
+}
+
+} // namespace Image_utils
@@ -0,0 +1,85 @@
+#ifndef IMAGEUTILS_H_
+#define IMAGEUTILS_H_
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+#include "sdl_ptrs.h"
+
+namespace Image_utils
+{
+    // Computes the size the image will be displayed at from its original size.
+    using TargetSizeFn = std::function<void(int p_w, int p_h, int *p_target_w, int *p_target_h)>;
+
+    // Decodes a JPEG or PNG image, reducing its size while decoding so that
+    // the result is as small as possible but still at least the target size.
+    // Memory use is proportional to the target size rather than the image
+    // size: JPEGs are scaled in the DCT domain and rows are box-filtered as
+    // they are decoded. Progressive JPEGs are the exception, as libjpeg
+    // keeps the coefficients of the whole image: they are only decoded if
+    // those take at most `p_max_bytes`.
+    //
+    // The result is a 32-bit RGBA surface. The original image size is stored
+    // in `p_orig_w` and `p_orig_h`.
+    //
+    // Returns nullptr if the format is not supported by this loader (e.g.
+    // interlaced PNG, or built without libjpeg/libpng) or the image is over
+    // budget, in which case the caller should fall back to `loadFull`.
+    //
+    // Can be called from any thread.
+    SDLSurfaceUniquePtr decodeReduced(const std::string &p_path, const TargetSizeFn &p_target_size, std::size_t p_max_bytes, int *p_orig_w, int *p_orig_h);
+
+    // Receives the rows of an image as it is decoded.
+    class RowSink
+    {
+        public:
+        virtual ~RowSink() = default;
+
+        // Called once with the output size, before any row.
+        // Returns false to abort decoding.
+        virtual bool begin(int p_w, int p_h) = 0;
+
+        // Called for every row, top to bottom, as 8-bit RGBA.
+        virtual void addRow(const unsigned char *p_rgba) = 0;
+    };
+
+    // Like `decodeReduced`, but passes the rows to `p_sink` instead of
+    // returning a surface, so that the whole image need not be held in
+    // memory in RGBA form.
+    //
+    // Returns false if the format is not supported or decoding failed.
+    // Some rows may have been passed to the sink before a failure.
+    bool decodeReducedRows(const std::string &p_path, const TargetSizeFn &p_target_size, std::size_t p_max_bytes, RowSink &p_sink, int *p_orig_w, int *p_orig_h);
+
+    // Reads the size of an image from the headers of the file.
+    // Returns false if the format is unknown or the headers are invalid.
+    //
+    // Can be called from any thread.
+    bool readImageSize(const std::string &p_path, int *p_w, int *p_h);
+
+    // Whether decoding the image at full size as 32-bit pixels takes at
+    // most `p_max_bytes`. If the size cannot be read from the headers, it is
+    // estimated from the size of the file.
+    bool fitsFullDecode(const std::string &p_path, std::size_t p_max_bytes);
+
+    // Decodes the image at full size with SDL_image, for the formats and
+    // variants that `decodeReduced` does not support. Returns nullptr
+    // without decoding if the result would be larger than `p_max_bytes`
+    // (see `fitsFullDecode`).
+    //
+    // Can be called from any thread.
+    SDLSurfaceUniquePtr loadFull(const std::string &p_path, std::size_t p_max_bytes);
+
+    // Decodes the thumbnail embedded in the EXIF data of a JPEG file
+    // (usually 160x120), reading only the headers of the file.
+    // The size of the main image is stored in `p_orig_w` and `p_orig_h`.
+    //
+    // Returns nullptr if there is no embedded thumbnail, or if its aspect
+    // ratio differs from the main image's (i.e. it is letterboxed).
+    //
+    // Can be called from any thread.
+    SDLSurfaceUniquePtr decodeExifThumbnail(const std::string &p_path, int *p_orig_w, int *p_orig_h);
+}
+
+#endif // IMAGEUTILS_H_
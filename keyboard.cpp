@@ -31,6 +31,8 @@ constexpr std::size_t kFrameBorder = 2;
 constexpr std::size_t kTextFieldHeight = 19;
 constexpr std::size_t kTextFieldMarginBottom = 2;
 constexpr std::size_t kTextFieldBorder = 2;
+constexpr std::size_t kMaxSuggestions = 8;
+constexpr std::size_t kSuggestionGap = 6;
 
 KeyboardLayout UsAsciiLayout(bool support_tabs)
 {
@@ -147,6 +149,15 @@ void CKeyboard::init()
     SDL_SetTextInputRect(&text_field_rect_);
 #endif
 
+    // Suggestions are shown right above the keyboard.
+    suggestions_rect_.w = width_;
+    suggestions_rect_.h = text_field_rect_.h;
+    suggestions_rect_.x = x_;
+    suggestions_rect_.y = static_cast<int>(y_) - suggestions_rect_.h
+        - kTextFieldMarginBottom * screen.ppu_y;
+    // The labels are rendered again at the new scale.
+    suggestions_valid_ = false;
+
     kb_buttons_rect_.x = frame_padding_x_;
     kb_buttons_rect_.y = text_field_rect_.y + text_field_rect_.h
         + kTextFieldMarginBottom * screen.ppu_y;
@@ -212,8 +223,89 @@ void CKeyboard::init()
         SDL_utils::createImage(screen.actual_w, FOOTER_H * screen.ppu_y,
             SDL_MapRGB(surfaces_[0]->format, COLOR_TITLE_BG)));
     SDL_utils::applyText(screen.w / 2, 1, footer_.get(), m_fonts,
-        "A-Input B-Cancel START-OK L/R⇧ Y← X␣", Globals::g_colorTextTitle,
-        { COLOR_TITLE_BG }, SDL_utils::T_TEXT_ALIGN_CENTER);
+        completer_ != nullptr ? "A-Input B-Cancel START-OK L/R⇧ Y← X␣ SEL⇥"
+                              : "A-Input B-Cancel START-OK L/R⇧ Y← X␣",
+        Globals::g_colorTextTitle, { COLOR_TITLE_BG },
+        SDL_utils::T_TEXT_ALIGN_CENTER);
+}
+
+void CKeyboard::setCompleter(std::unique_ptr<Completer> completer)
+{
+    completer_ = std::move(completer);
+    // For the footer.
+    init();
+}
+
+void CKeyboard::updateSuggestions() const
+{
+    const std::string &text = text_edit_.text();
+    if (suggestions_valid_ && suggestions_text_ == text) return;
+    suggestions_valid_ = true;
+    suggestions_text_ = text;
+    suggestions_ = completer_->complete(text, kMaxSuggestions);
+    suggestion_surfaces_.clear();
+    suggestion_xs_.clear();
+    const int max_x = suggestions_rect_.w - frame_padding_x_;
+    int x = frame_padding_x_;
+    for (std::size_t i = 0; i < suggestions_.size(); ++i) {
+        // The first one is accepted with SELECT.
+        SDLSurfaceUniquePtr surface { SDL_utils::renderText(m_fonts,
+            suggestions_[i].label, Globals::g_colorTextNormal,
+            i == 0 ? sdl_highlight_color_ : sdl_bg_color_) };
+        // The first one is clipped if it does not fit.
+        if (surface == nullptr || (i > 0 && x + surface->w > max_x)) break;
+        const int end = std::min(x + surface->w, max_x);
+        suggestion_xs_.emplace_back(x, end);
+        suggestion_surfaces_.push_back(std::move(surface));
+        x = end + kSuggestionGap * screen.ppu_x;
+    }
+}
+
+void CKeyboard::renderSuggestions() const
+{
+    updateSuggestions();
+    if (suggestion_surfaces_.empty()) return;
+    renderRectWithBorder(screen.surface, suggestions_rect_, kFrameBorder,
+        border_color_, bg_color_);
+    const int pad = kSuggestionGap * screen.ppu_x / 2;
+    const int border_h = kFrameBorder * screen.ppu_y;
+    for (std::size_t i = 0; i < suggestion_surfaces_.size(); ++i) {
+        SDL_Surface *surface = suggestion_surfaces_[i].get();
+        const int x = suggestions_rect_.x + suggestion_xs_[i].first;
+        const int w = suggestion_xs_[i].second - suggestion_xs_[i].first;
+        if (i == 0) {
+            SDL_Rect rect = SDL_utils::makeRect(x - pad,
+                suggestions_rect_.y + border_h, w + 2 * pad,
+                suggestions_rect_.h - 2 * border_h);
+            SDL_FillRect(screen.surface, &rect, highlight_color_);
+        }
+        SDL_Rect clip = SDL_utils::makeRect(0, 0, w, surface->h);
+        SDL_utils::applyPpuScaledSurface(x,
+            suggestions_rect_.y + (suggestions_rect_.h - surface->h) / 2,
+            surface, screen.surface, &clip);
+    }
+}
+
+bool CKeyboard::acceptSuggestion(std::size_t index)
+{
+    if (completer_ == nullptr) return false;
+    updateSuggestions();
+    if (index >= suggestion_surfaces_.size()) return false;
+    text_edit_.setText(suggestions_[index].text);
+    return true;
+}
+
+int CKeyboard::getSuggestionAt(int x, int y) const
+{
+    if (completer_ == nullptr || suggestion_surfaces_.empty()) return -1;
+    const SDL_Point p { x, y };
+    if (!SDL_PointInRect(&p, &suggestions_rect_)) return -1;
+    for (std::size_t i = 0; i < suggestion_xs_.size(); ++i) {
+        if (x >= suggestions_rect_.x + suggestion_xs_[i].first
+            && x < suggestions_rect_.x + suggestion_xs_[i].second)
+            return static_cast<int>(i);
+    }
+    return -1;
 }
 
 void CKeyboard::renderButton(
@@ -363,6 +455,9 @@ void CKeyboard::render(const bool p_focus) const
     text_edit_.blitForeground(
         *screen.surface, x_ + text_field_rect_.x, y_ + text_field_rect_.y);
 
+    // The suggestions are updated in the frame in which the text changes.
+    if (completer_ != nullptr) renderSuggestions();
+
     // Draw focused button
     if (isFocusOnButtonsRow()) {
         if (isFocusOnCancel())
@@ -429,6 +524,8 @@ bool CKeyboard::keyPress(
             % keyboard_.num_keysets();
         return true;
     }
+    if (key == c.key_select || button == c.gamepad_select)
+        return acceptSuggestion(0); // SELECT => Complete
     if (key == c.key_transfer || button == c.gamepad_transfer) {
         // START => OK
         m_retVal = 1;
@@ -536,6 +633,9 @@ bool CKeyboard::gamepadHold(SDL_GameController *controller)
 
 bool CKeyboard::mouseDown(int button, int x, int y)
 {
+    const int suggestion = getSuggestionAt(x, y);
+    if (suggestion != -1)
+        return button == SDL_BUTTON_LEFT && acceptSuggestion(suggestion);
     if (x < x_ || x > x_ + width_ || y < y_ || y > y_ + height_) {
         m_retVal = -1;
         return true;
@@ -1,6 +1,7 @@
 #ifndef _KEYBOARD_H_
 #define _KEYBOARD_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 #include <utility>
@@ -8,6 +9,7 @@
 #include <SDL.h>
 #include <SDL_ttf.h>
 
+#include "completion.h"
 #include "controller_buttons.h"
 #include "sdl_backports.h"
 #include "sdl_ptrs.h"
@@ -37,6 +39,9 @@ class CKeyboard : public CWindow
 
     bool handlesTextInput() const override { return true; }
 
+    // Suggests completions of the text, shown above the keyboard.
+    void setCompleter(std::unique_ptr<Completer> completer);
+
     private:
 
     struct Keyboard
@@ -143,6 +148,14 @@ class CKeyboard : public CWindow
     bool isFocusOnOk() const;
     bool isFocusOnCancel() const;
 
+    // Completion:
+    // Computes the suggestions if the text has changed since the last time.
+    void updateSuggestions() const;
+    void renderSuggestions() const;
+    bool acceptSuggestion(std::size_t index);
+    // Returns the index of the suggestion at the given coordinates or -1.
+    int getSuggestionAt(int x, int y) const;
+
     const bool support_tabs_;
 
     // Colors:
@@ -184,6 +197,18 @@ class CKeyboard : public CWindow
     // Input config:
     SDLC_Keycode osk_backspace_;
     SDLC_Keycode osk_cancel_;
+
+    // Completion:
+    std::unique_ptr<Completer> completer_;
+    SDL_Rect suggestions_rect_;
+    // The text that the suggestions are for.
+    mutable std::string suggestions_text_;
+    mutable bool suggestions_valid_ = false;
+    mutable std::vector<Completer::Suggestion> suggestions_;
+    // The labels of the suggestions that fit, and their x ranges within
+    // `suggestions_rect_`.
+    mutable std::vector<SDLSurfaceUniquePtr> suggestion_surfaces_;
+    mutable std::vector<std::pair<int, int>> suggestion_xs_;
 };
 
 #endif
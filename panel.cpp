@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include "panel.h"
@@ -26,6 +27,7 @@ CPanel::CPanel(const std::string &p_path, const Sint16 p_x):
         m_fileLister.list(PATH_DEFAULT);
         m_currentPath = PATH_DEFAULT;
     }
+    addRecentPath();
 }
 
 CPanel::~CPanel(void) { }
@@ -290,6 +292,13 @@ void CPanel::moveCursorToVisibleLineIndex(int index)
     m_highlightedLine = m_camera + index;
 }
 
+void CPanel::moveCursorToIndex(unsigned int p_index)
+{
+    if (p_index >= m_fileLister.getNbTotal()) return;
+    m_highlightedLine = p_index;
+    adjustCamera();
+}
+
 const bool CPanel::open(const std::string &p_path)
 {
     bool l_ret(false);
@@ -326,6 +335,7 @@ const bool CPanel::open(const std::string &p_path)
     {
         // Path OK
         m_currentPath = l_newPath;
+        addRecentPath();
         // If it's a back movement, restore old dir
         if (!l_oldDir.empty())
             m_highlightedLine = m_fileLister.searchDir(l_oldDir);
@@ -354,6 +364,20 @@ const bool CPanel::goToParentDir(void)
     return l_ret;
 }
 
+const std::vector<std::string> &CPanel::getRecentPaths(void) const
+{
+    return m_recentPaths;
+}
+
+void CPanel::addRecentPath(void)
+{
+    constexpr std::size_t kMaxRecentPaths = 32;
+    m_recentPaths.erase(std::remove(m_recentPaths.begin(), m_recentPaths.end(), m_currentPath), m_recentPaths.end());
+    m_recentPaths.insert(m_recentPaths.begin(), m_currentPath);
+    if (m_recentPaths.size() > kMaxRecentPaths)
+        m_recentPaths.resize(kMaxRecentPaths);
+}
+
 void CPanel::adjustCamera(void)
 {
     if (m_fileLister.getNbTotal() <= NB_VISIBLE_LINES)
@@ -371,7 +395,27 @@ const std::string &CPanel::getHighlightedItem(void) const
 
 std::string CPanel::getHighlightedItemFull(void) const
 {
-    return m_currentPath + (m_currentPath == "/" ? "" : "/") + m_fileLister[m_highlightedLine].m_name;
+    return getItemFull(m_highlightedLine);
+}
+
+unsigned int CPanel::getNbItems(void) const
+{
+    return m_fileLister.getNbTotal();
+}
+
+const T_FILE &CPanel::getItem(unsigned int p_index) const
+{
+    return m_fileLister[p_index];
+}
+
+std::string CPanel::getItemFull(unsigned int p_index) const
+{
+    return m_currentPath + (m_currentPath == "/" ? "" : "/") + m_fileLister[p_index].m_name;
+}
+
+bool CPanel::isDirectory(unsigned int p_index) const
+{
+    return m_fileLister.isDirectory(p_index);
 }
 
 const std::string &CPanel::getCurrentPath(void) const
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <set>
+#include <vector>
 #include <SDL.h>
 #include <SDL_ttf.h>
 
@@ -28,6 +29,7 @@ class CPanel
     const bool moveCursorUp(unsigned char p_step);
     const bool moveCursorDown(unsigned char p_step);
     void moveCursorToVisibleLineIndex(int index);
+    void moveCursorToIndex(unsigned int p_index);
 
     // Returns the viewport line index at the given coordinates or -1.
     int getLineAt(int x, int y) const;
@@ -47,9 +49,24 @@ class CPanel
     // Selected file with full path
     std::string getHighlightedItemFull(void) const;
 
+    // Number of items in the current directory, including ".."
+    unsigned int getNbItems(void) const;
+
+    // Item at the given index
+    const T_FILE &getItem(unsigned int p_index) const;
+
+    // Item at the given index with full path
+    std::string getItemFull(unsigned int p_index) const;
+
+    // True => directory, false => file, or dir ".."
+    bool isDirectory(unsigned int p_index) const;
+
     // Current path
     const std::string &getCurrentPath(void) const;
 
+    // The directories visited most recently, latest first
+    const std::vector<std::string> &getRecentPaths(void) const;
+
     // Selected index
     const unsigned int &getHighlightedIndex(void) const;
     const unsigned int getHighlightedIndexRelative(void) const;
@@ -83,6 +100,9 @@ class CPanel
     // Adjust camera
     void adjustCamera(void);
 
+    // Add the current path to the recent paths
+    void addRecentPath(void);
+
     // Resources:
     SDL_Surface *icon_dir() const;
     SDL_Surface *icon_file() const;
@@ -110,6 +130,9 @@ class CPanel
     // Current path
     std::string m_currentPath;
 
+    // Recently visited paths, latest first
+    std::vector<std::string> m_recentPaths;
+
     // Index of the first displayed line
     unsigned int m_camera;
 
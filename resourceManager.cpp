@@ -1,32 +1,28 @@
+#include <algorithm>
 #include <iostream>
 
 #include <SDL_image.h>
-#ifdef USE_SDL2
-#include <SDL2_rotozoom.h>
-#else
-#include <SDL_rotozoom.h>
-#endif
 #include "resourceManager.h"
 #include "def.h"
+#include "image_scaler.h"
 #include "screen.h"
 #include "sdlutils.h"
 
 namespace {
 
 SDLSurfaceUniquePtr LoadIcon(const std::string &path) {
-    SDL_Surface *img = IMG_Load(path.c_str());
+    SDLSurfaceUniquePtr img { IMG_Load(path.c_str()) };
     if(img == nullptr)
     {
         std::cerr << "LoadIcon(\"" << path << "\"): " << IMG_GetError() << std::endl;
         return nullptr;
     }
-    SDLSurfaceUniquePtr scaled;
-    if ((screen.ppu_x == 1 || screen.ppu_x == 2) && (screen.ppu_y == 1 || screen.ppu_y == 2)) {
-        scaled = SDLSurfaceUniquePtr { shrinkSurface(img, 2 / screen.ppu_x, 2 / screen.ppu_y) };
-    } else {
-        scaled = SDLSurfaceUniquePtr { zoomSurface(img, screen.ppu_x / 2, screen.ppu_y / 2, SMOOTHING_ON) };
-    }
-    SDL_FreeSurface(img);
+    // Icons are drawn at 2x.
+    const int w = std::max(1, static_cast<int>(img->w * screen.ppu_x / 2));
+    const int h = std::max(1, static_cast<int>(img->h * screen.ppu_y / 2));
+    SDLSurfaceUniquePtr scaled = Image_utils::scale(
+        img.get(), w, h, Image_utils::PixelLayout::rgba32());
+    if (scaled == nullptr) return nullptr;
 #ifdef USE_SDL2
     return scaled;
 #else
@@ -49,22 +45,9 @@ std::string ResDir = RES_DIR "";
 std::string ResPath(const char *path) { return ResDir + path; }
 std::string ResPath(const std::string &path) { return ResDir + path; }
 
-std::vector<TTF_Font *> LoadFonts(bool low_dpi) {
-    const FontSpec *specs = low_dpi ? kLowDpiFonts : kFonts;
-    const std::size_t len = low_dpi ? kLowDpiFontsLen : kFontsLen;
-
-    std::vector<TTF_Font *> fonts;
-    fonts.reserve(len);
-    for (std::size_t i = 0; i < len; ++i) {
-        const std::string &path = specs[i].path;
-        auto *font = SDL_utils::loadFont(path.front() == '/' ? path : ResPath(path), specs[i].size);
-        if (font != nullptr) fonts.push_back(font);
-    }
-    if (fonts.empty()) {
-        std::cerr << "No fonts found!" << std::endl;
-        exit(1);
-    }
-    return fonts;
+std::string FontPath(const FontSpec &spec) {
+    const std::string path = spec.path;
+    return path.front() == '/' ? path : ResPath(path);
 }
 
 bool ShouldUseLowDpiFonts() {
@@ -88,7 +71,6 @@ CResourceManager& CResourceManager::instance()
 
 CResourceManager::CResourceManager()
     : m_low_dpi_fonts(false)
-    , m_fonts({})
     , m_ppu_x(0)
     , m_ppu_y(0)
 {
@@ -122,8 +104,25 @@ void CResourceManager::onResize()
     if (m_low_dpi_fonts != low_dpi_fonts || screen.ppu_x != m_ppu_x
         || screen.ppu_y != m_ppu_y) {
         m_low_dpi_fonts = low_dpi_fonts;
-        closeFonts();
-        m_fonts = Fonts { LoadFonts(m_low_dpi_fonts) };
+        ++m_font_generation;
+        evictFonts();
+        const FontSpec *specs = m_low_dpi_fonts ? kLowDpiFonts : kFonts;
+        const std::size_t len = m_low_dpi_fonts ? kLowDpiFontsLen : kFontsLen;
+#ifdef USE_TTF_OPENFONT_DPI
+        const unsigned int hdpi = 72 * screen.ppu_x;
+        const unsigned int vdpi = 72 * screen.ppu_y;
+#else
+        const unsigned int hdpi = 0;
+        const unsigned int vdpi = 0;
+#endif
+        m_fonts = Fonts { len, [this, specs, hdpi, vdpi](std::size_t i) {
+                             return openFont(FontKey { FontPath(specs[i]),
+                                 specs[i].size, hdpi, vdpi });
+                         } };
+        if (m_fonts.GetFirstFont() == nullptr) {
+            std::cerr << "No fonts found!" << std::endl;
+            exit(1);
+        }
     }
     m_ppu_x = screen.ppu_x;
     m_ppu_y = screen.ppu_y;
@@ -134,13 +133,37 @@ void CResourceManager::sdlCleanup() {
     closeFonts();
 }
 
-void CResourceManager::closeFonts() {
-    for (auto &font : m_fonts.fonts()) {
-        if (font != nullptr) {
-            TTF_CloseFont(font);
-            font = nullptr;
+TTF_Font *CResourceManager::openFont(const FontKey &p_key)
+{
+    auto it = m_font_cache.find(p_key);
+    if (it != m_font_cache.end()) {
+        it->second.generation = m_font_generation;
+        return it->second.font;
+    }
+    TTF_Font *font = SDL_utils::loadFont(std::get<0>(p_key),
+        std::get<1>(p_key), std::get<2>(p_key), std::get<3>(p_key));
+    m_font_cache.emplace(p_key, CachedFont { font, m_font_generation });
+    return font;
+}
+
+void CResourceManager::evictFonts()
+{
+    for (auto it = m_font_cache.begin(); it != m_font_cache.end();) {
+        if (m_font_generation - it->second.generation <= 1) {
+            ++it;
+            continue;
         }
+        if (it->second.font != nullptr) TTF_CloseFont(it->second.font);
+        it = m_font_cache.erase(it);
+    }
+}
+
+void CResourceManager::closeFonts() {
+    m_fonts = Fonts {};
+    for (auto &entry : m_font_cache) {
+        if (entry.second.font != nullptr) TTF_CloseFont(entry.second.font);
     }
+    m_font_cache.clear();
 }
 
 SDL_Surface *CResourceManager::getSurface(const T_SURFACE p_surface) const
@@ -2,6 +2,9 @@
 #define _RESOURCEMANAGER_H_
 
 #include <array>
+#include <map>
+#include <string>
+#include <tuple>
 #include <vector>
 
 #include <SDL.h>
@@ -61,6 +64,25 @@ class CResourceManager
     bool m_low_dpi_fonts;
     Fonts m_fonts;
 
+    // Opened fonts by (path, size, horizontal DPI, vertical DPI).
+    // The fonts of the previous scale are kept open so that switching back
+    // to it does not reload them. Older ones are closed.
+    using FontKey = std::tuple<std::string, int, unsigned int, unsigned int>;
+    struct CachedFont
+    {
+        TTF_Font *font;
+        // The value of `m_font_generation` when it was last used.
+        unsigned int generation;
+    };
+    std::map<FontKey, CachedFont> m_font_cache;
+    // Incremented when the fonts are replaced, e.g. on a scale change.
+    unsigned int m_font_generation = 0;
+
+    TTF_Font *openFont(const FontKey &p_key);
+
+    // Closes the fonts not used at the current or previous scale.
+    void evictFonts();
+
     // PPU values when the resources were loaded.
     float m_ppu_x, m_ppu_y;
 };
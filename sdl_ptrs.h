@@ -18,6 +18,12 @@ struct SDLSurfaceDeleter {
 
 using SDLSurfaceUniquePtr = std::unique_ptr<SDL_Surface, SDLSurfaceDeleter>;
 
+/**
+ * @brief A shared SDL surface, e.g. held by a cache and a window at once.
+ * Construct from an `SDLSurfaceUniquePtr` to keep its deleter.
+ */
+using SDLSurfaceSharedPtr = std::shared_ptr<SDL_Surface>;
+
 /**
  * @brief Deletes the object using `SDL_free`.
  */
@@ -3,94 +3,325 @@
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <vector>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef SDL_TTF_VERSION_ATLEAST
+#if SDL_TTF_VERSION_ATLEAST(2, 0, 18)
+#define TTF_MULTIFONT_HAVE_GLYPH32
+#endif
+#if SDL_TTF_VERSION_ATLEAST(2, 0, 14)
+#define TTF_MULTIFONT_HAVE_KERNING_BY_CHAR
+#endif
+#endif
+
 namespace {
 
-/* This function is incorrect as it only supports BMP but that's all SDL_ttf
- * supports anyway. */
-std::vector<std::uint16_t> DecodeUtf8(const std::string &utf8) {
-  std::vector<std::uint16_t> result;
-  for (std::size_t i = 0; i < utf8.size(); ++i) {
-    std::uint16_t ch = static_cast<unsigned char>(utf8[i]);
-    if (ch >= 0xF0) {
-      if (i + 4 > utf8.size()) {
-        ch = 0xFFFD;
-        ++i;
-        continue;
-      }
-      ch = static_cast<std::uint16_t>(utf8[i] & 0x07) << 18;
-      ch |= static_cast<std::uint16_t>(utf8[++i] & 0x3F) << 12;
-      ch |= static_cast<std::uint16_t>(utf8[++i] & 0x3F) << 6;
-      ch |= static_cast<std::uint16_t>(utf8[++i] & 0x3F);
-    } else if (ch >= 0xE0) {
-      if (i + 3 > utf8.size()) {
-        ch = 0xFFFD;
-        ++i;
-        continue;
-      }
-      ch = static_cast<std::uint16_t>(utf8[i] & 0x0F) << 12;
-      ch |= static_cast<std::uint16_t>(utf8[++i] & 0x3F) << 6;
-      ch |= static_cast<std::uint16_t>(utf8[++i] & 0x3F);
-    } else if (ch >= 0xC0) {
-      if (i + 2 > utf8.size()) {
-        ch = 0xFFFD;
-        ++i;
-        continue;
-      }
-      ch = static_cast<std::uint16_t>(utf8[i] & 0x1F) << 6;
-      ch |= static_cast<std::uint16_t>(utf8[++i] & 0x3F);
-    }
-    result.push_back(ch);
+constexpr std::uint32_t kReplacementCharacter = 0xFFFD;
+constexpr std::uint32_t kMaxCodePoint = 0x10FFFF;
+
+/* Decodes the code point starting at `*i` and advances `*i` past it.
+ * Returns false if the sequence is truncated. */
+bool DecodeNextCodePoint(const std::string &utf8, std::size_t *i,
+                         std::uint32_t *cp) {
+  std::uint32_t ch = static_cast<unsigned char>(utf8[*i]);
+  std::size_t len = 1;
+  if (ch >= 0xF0) {
+    len = 4;
+  } else if (ch >= 0xE0) {
+    len = 3;
+  } else if (ch >= 0xC0) {
+    len = 2;
+  }
+  if (*i + len > utf8.size()) {
+    *i = utf8.size();
+    return false;
+  }
+  switch (len) {
+    case 4:
+      ch = static_cast<std::uint32_t>(utf8[*i] & 0x07) << 18;
+      ch |= static_cast<std::uint32_t>(utf8[*i + 1] & 0x3F) << 12;
+      ch |= static_cast<std::uint32_t>(utf8[*i + 2] & 0x3F) << 6;
+      ch |= static_cast<std::uint32_t>(utf8[*i + 3] & 0x3F);
+      break;
+    case 3:
+      ch = static_cast<std::uint32_t>(utf8[*i] & 0x0F) << 12;
+      ch |= static_cast<std::uint32_t>(utf8[*i + 1] & 0x3F) << 6;
+      ch |= static_cast<std::uint32_t>(utf8[*i + 2] & 0x3F);
+      break;
+    case 2:
+      ch = static_cast<std::uint32_t>(utf8[*i] & 0x1F) << 6;
+      ch |= static_cast<std::uint32_t>(utf8[*i + 1] & 0x3F);
+      break;
+  }
+  *i += len;
+  *cp = ch > kMaxCodePoint ? kReplacementCharacter : ch;
+  return true;
+}
+
+std::string EncodeUtf8(std::uint32_t cp) {
+  std::string result;
+  if (cp < 0x80) {
+    result.push_back(static_cast<char>(cp));
+  } else if (cp < 0x800) {
+    result.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+    result.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  } else if (cp < 0x10000) {
+    result.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+    result.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    result.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  } else {
+    result.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+    result.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+    result.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    result.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
   }
-  result.push_back(0);
   return result;
 }
 
+bool GlyphIsProvided(TTF_Font *font, std::uint32_t cp) {
+#ifdef TTF_MULTIFONT_HAVE_GLYPH32
+  return TTF_GlyphIsProvided32(font, cp);
+#else
+  // Older SDL_ttf only supports the BMP.
+  return cp <= 0xFFFF && TTF_GlyphIsProvided(font, static_cast<Uint16>(cp));
+#endif
+}
+
+void GlyphMetrics(TTF_Font *font, std::uint32_t cp, int *minx, int *maxx,
+                  int *advance) {
+  *minx = *maxx = *advance = 0;
+#ifdef TTF_MULTIFONT_HAVE_GLYPH32
+  if (TTF_GlyphMetrics32(font, cp, minx, maxx, nullptr, nullptr, advance) !=
+      0) {
+    *minx = *maxx = *advance = 0;
+  }
+#else
+  if (cp > 0xFFFF) {
+    // Measure whatever SDL_ttf renders in place of the code point.
+    int h;
+    if (TTF_SizeUTF8(font, EncodeUtf8(cp).c_str(), advance, &h) != 0)
+      *advance = 0;
+    *maxx = *advance;
+    return;
+  }
+  if (TTF_GlyphMetrics(font, static_cast<Uint16>(cp), minx, maxx, nullptr,
+                       nullptr, advance) != 0) {
+    *minx = *maxx = *advance = 0;
+  }
+#endif
+}
+
+int GetKerning(TTF_Font *font, std::uint32_t prev_cp, std::uint32_t cp) {
+#ifdef TTF_MULTIFONT_HAVE_KERNING_BY_CHAR
+  if (TTF_GetFontKerning(font)) {
+#ifdef TTF_MULTIFONT_HAVE_GLYPH32
+    return TTF_GetFontKerningSizeGlyphs32(font, prev_cp, cp);
+#else
+    if (prev_cp <= 0xFFFF && cp <= 0xFFFF) {
+      return TTF_GetFontKerningSizeGlyphs(font, static_cast<Uint16>(prev_cp),
+                                          static_cast<Uint16>(cp));
+    }
+#endif
+  }
+#endif
+  // Older SDL_ttf only provides kerning by glyph index, which is not exposed.
+  return 0;
+}
+
+bool IsAscii(const std::string &text) {
+  const char *data = text.data();
+  const std::size_t size = text.size();
+  std::size_t i = 0;
+#ifdef __SSE2__
+  for (; i + 16 <= size; i += 16) {
+    const __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    if (_mm_movemask_epi8(chunk) != 0) return false;
+  }
+#endif
+  for (; i + 8 <= size; i += 8) {
+    std::uint64_t chunk;
+    std::memcpy(&chunk, data + i, sizeof(chunk));
+    if ((chunk & 0x8080808080808080ULL) != 0) return false;
+  }
+  for (; i < size; ++i) {
+    if ((static_cast<unsigned char>(data[i]) & 0x80) != 0) return false;
+  }
+  return true;
+}
+
+/* A run of UTF-8 bytes `[begin, end)` rendered with the same font. */
 struct Slice {
-  std::uint16_t *text;
-  std::size_t text_size;
+  std::size_t begin;
+  std::size_t end;
   TTF_Font *font;
 };
 
-std::vector<Slice> SplitIntoSlices(
-    std::vector<std::uint16_t> &code_points,
-    const Fonts &fonts) {
+void SplitIntoSlices(const std::string &text, const Fonts &fonts,
+                     std::vector<Slice> &slices) {
   TTF_Font *prev_font = nullptr;
-  std::vector<Slice> slices;
-  for (auto &cp : code_points) {
-    if (cp == 0) break;
+  slices.clear();
+  std::size_t i = 0;
+  std::uint32_t cp;
+  while (i < text.size()) {
+    const std::size_t begin = i;
+    if (!DecodeNextCodePoint(text, &i, &cp)) break;
     TTF_Font *cur_font = fonts.GetFontForCodePoint(cp);
     if (cur_font == prev_font) {
-      ++slices.back().text_size;
+      slices.back().end = i;
     } else {
-      slices.push_back(Slice{&cp, 1, cur_font});
+      slices.push_back(Slice{begin, i, cur_font});
       prev_font = cur_font;
     }
   }
-  return slices;
 }
 
 }  // namespace
 
-Fonts::Fonts(std::vector<TTF_Font *> fonts)
-  : fonts_(std::move(fonts)),
-    glyph_index_cache_({0}) {}
-
-TTF_Font *Fonts::GetFontForCodePoint(std::uint16_t cp) const {
-  auto &result = glyph_index_cache_[cp];
-  if (result == 0) {
-    std::size_t i = 1;
-    result = fonts_[0];
-    for (TTF_Font *font : fonts_) {
-      if (TTF_GlyphIsProvided(font, cp)) {
-        result = font;
+Fonts::Fonts(std::size_t num_fonts, FontLoader loader)
+    : num_fonts_(num_fonts), loader_(std::move(loader)) {
+  while (fonts_.empty() && LoadNextFont()) {
+  }
+}
+
+bool Fonts::LoadNextFont() const {
+  if (next_font_ == num_fonts_) return false;
+  TTF_Font *font = loader_(next_font_++);
+  if (font == nullptr) return true;
+#if defined(SDL_TTF_VERSION_ATLEAST) && \
+    !defined(TTF_MULTIFONT_HAVE_KERNING_BY_CHAR)
+#if SDL_TTF_VERSION_ATLEAST(2, 0, 10)
+  // The kerning cannot be measured, so that text would be rendered wider or
+  // narrower than measured.
+  TTF_SetFontKerning(font, 0);
+#endif
+#endif
+  fonts_.push_back(font);
+  return true;
+}
+
+TTF_Font *Fonts::GetFontForAscii() const {
+  if (ascii_font_state_ == AsciiFontState::kUnknown) {
+    TTF_Font *font = GetFontForCodePoint(' ');
+    ascii_font_state_ = AsciiFontState::kSingle;
+    for (std::uint32_t cp = ' ' + 1; cp < 0x7F; ++cp) {
+      if (GetFontForCodePoint(cp) != font) {
+        ascii_font_state_ = AsciiFontState::kMultiple;
         break;
       }
     }
   }
-  return result;
+  return ascii_font_state_ == AsciiFontState::kSingle
+             ? GetFontForCodePoint(' ')
+             : nullptr;
+}
+
+Fonts::GlyphInfo &Fonts::GetGlyphInfo(std::uint32_t cp) const {
+  const std::size_t page_index = cp >> kPageBits;
+  if (page_index >= pages_.size()) pages_.resize(page_index + 1);
+  std::unique_ptr<Page> &page = pages_[page_index];
+  if (page == nullptr) {
+    page.reset(new Page);
+    page->fill(GlyphInfo{kUnknownFont, 0, 0, kUnknownAdvance});
+  }
+  return (*page)[cp & (kPageSize - 1)];
+}
+
+TTF_Font *Fonts::GetFontForCodePoint(std::uint32_t cp) const {
+  GlyphInfo &info = GetGlyphInfo(cp);
+  if (info.font_index == kUnknownFont) {
+    info.font_index = 0;
+    // Control characters are not worth loading fallback fonts for.
+    const bool is_control = cp < 0x20 || cp == 0x7F;
+    std::size_t i = 0;
+    while (true) {
+      for (; i < fonts_.size(); ++i) {
+        if (GlyphIsProvided(fonts_[i], cp)) {
+          info.font_index = static_cast<std::uint8_t>(i);
+          return fonts_[i];
+        }
+      }
+      if (is_control || !LoadNextFont()) break;
+    }
+  }
+  return fonts_[info.font_index];
+}
+
+int Fonts::GetAdvance(std::uint32_t cp) const {
+  int minx, maxx, advance;
+  GetHorizontalMetrics(cp, &minx, &maxx, &advance);
+  return advance;
+}
+
+void Fonts::GetHorizontalMetrics(std::uint32_t cp, int *minx, int *maxx,
+                                 int *advance) const {
+  TTF_Font *font = GetFontForCodePoint(cp);
+  GlyphInfo &info = GetGlyphInfo(cp);
+  if (info.advance == kUnknownAdvance) {
+    GlyphMetrics(font, cp, minx, maxx, advance);
+    info.minx = static_cast<std::int16_t>(*minx);
+    info.maxx = static_cast<std::int16_t>(*maxx);
+    info.advance = static_cast<std::int16_t>(*advance);
+  }
+  *minx = info.minx;
+  *maxx = info.maxx;
+  *advance = info.advance;
+}
+
+int Fonts::GetKerning(std::uint32_t prev_cp, std::uint32_t cp) const {
+  TTF_Font *font = GetFontForCodePoint(cp);
+  if (GetFontForCodePoint(prev_cp) != font) return 0;
+  return ::GetKerning(font, prev_cp, cp);
+}
+
+int TTFMultiFont_SizeUTF8(const Fonts &fonts, const std::string &text, int *w,
+                          int *h) {
+  // The runs of text in one font are rendered separately, each one as wide
+  // as TTF_SizeUTF8 measures it: from the leftmost to the rightmost extent
+  // of its glyphs, and at least to the pen position after the last one.
+  int width = 0;
+  int height = 0;
+  // The pen position and the extent of the glyphs in the current run.
+  int x = 0;
+  int run_minx = 0;
+  int run_maxx = 0;
+  TTF_Font *prev_font = nullptr;
+  std::uint32_t prev_cp = 0;
+  const bool ascii = IsAscii(text);
+  std::size_t i = 0;
+  std::uint32_t cp;
+  while (i < text.size()) {
+    if (ascii) {
+      cp = static_cast<unsigned char>(text[i++]);
+    } else if (!DecodeNextCodePoint(text, &i, &cp)) {
+      break;
+    }
+    TTF_Font *font = fonts.GetFontForCodePoint(cp);
+    if (font == prev_font) {
+      x += GetKerning(font, prev_cp, cp);
+    } else {
+      width += run_maxx - run_minx;
+      x = run_minx = run_maxx = 0;
+      height = std::max(height, TTF_FontHeight(font));
+      prev_font = font;
+    }
+    int minx, maxx, advance;
+    fonts.GetHorizontalMetrics(cp, &minx, &maxx, &advance);
+    run_minx = std::min(run_minx, x + minx);
+    run_maxx = std::max(run_maxx, x + std::max(advance, maxx));
+    x += advance;
+    prev_cp = cp;
+  }
+  width += run_maxx - run_minx;
+  if (w != nullptr) *w = width;
+  if (h != nullptr) *h = height;
+  return 0;
 }
 
 SDL_Surface *TTFMultiFont_RenderUTF8_Shaded(
@@ -100,24 +331,34 @@ SDL_Surface *TTFMultiFont_RenderUTF8_Shaded(
     return TTF_RenderUTF8_Shaded(fonts.GetFirstFont(), text.c_str(), fg, bg);
   }
 
-  auto code_points = DecodeUtf8(text);
-  const std::vector<Slice> slices = SplitIntoSlices(code_points, fonts);
+  if (IsAscii(text)) {
+    TTF_Font *ascii_font = fonts.GetFontForAscii();
+    if (ascii_font != nullptr)
+      return TTF_RenderUTF8_Shaded(ascii_font, text.c_str(), fg, bg);
+  }
+
+  // Scratch buffers reused across calls.
+  static thread_local std::vector<Slice> slices;
+  static thread_local std::vector<SDL_Surface *> surfaces;
+  static thread_local std::string buf;
+
+  SplitIntoSlices(text, fonts, slices);
 
   if (slices.empty()) return nullptr;
   if (slices.size() == 1)
-    return TTF_RenderUNICODE_Shaded(slices[0].font, slices[0].text, fg, bg);
+    return TTF_RenderUTF8_Shaded(slices[0].font, text.c_str(), fg, bg);
 
-  std::vector<SDL_Surface *> surfaces;
-  surfaces.reserve(slices.size());
+  surfaces.clear();
 
   // SDL_ttf API requires a 0-terminated buffer.
-  // To avoid excessive copying, we iterate in-reverse and modify the buffer
-  // in-place.
+  // To avoid excessive copying, we iterate in-reverse and terminate each
+  // slice in-place in a single copy of the text.
+  buf.assign(text);
   for (std::size_t i = slices.size(); i > 0; --i) {
-    auto &slice = slices[i - 1];
-    slice.text[slice.text_size] = 0;
+    const auto &slice = slices[i - 1];
+    buf[slice.end] = '\0';
     SDL_Surface *surface =
-        TTF_RenderUNICODE_Shaded(slice.font, slice.text, fg, bg);
+        TTF_RenderUTF8_Shaded(slice.font, &buf[slice.begin], fg, bg);
     if (surface == nullptr) {
       std::cerr << "TTFMultiFont_RenderUTF8_Shaded error: " << SDL_GetError()
                 << std::endl;
@@ -126,6 +367,7 @@ SDL_Surface *TTFMultiFont_RenderUTF8_Shaded(
     }
     surfaces.push_back(surface);
   }
+  if (surfaces.empty()) return nullptr;
 
   int width = 0;
   int height = 0;
@@ -135,7 +377,11 @@ SDL_Surface *TTFMultiFont_RenderUTF8_Shaded(
   }
 
   SDL_Surface *result = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, 8, 0, 0, 0, 0);
-  if (result == nullptr) return nullptr;
+  if (result == nullptr) {
+    for (auto *surface : surfaces) SDL_FreeSurface(surface);
+    surfaces.clear();
+    return nullptr;
+  }
 #ifdef USE_SDL2
   SDL_SetPaletteColors(result->format->palette,
       surfaces[0]->format->palette->colors, 0,
@@ -156,6 +402,7 @@ SDL_Surface *TTFMultiFont_RenderUTF8_Shaded(
   }
 
   for (auto *surface : surfaces) SDL_FreeSurface(surface);
+  surfaces.clear();
 
   return result;
 }
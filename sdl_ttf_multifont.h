@@ -7,7 +7,9 @@
 #include <array>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <limits>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -15,30 +17,101 @@
 
 class Fonts {
  public:
-  explicit Fonts(std::vector<TTF_Font *> fonts);
+  // Opens the font at the given index of the fallback chain.
+  // Returns nullptr if the font cannot be opened.
+  using FontLoader = std::function<TTF_Font *(std::size_t index)>;
+
+  Fonts() = default;
+
+  // The first font that can be opened is loaded immediately.
+  // The fallback fonts are loaded in order on the first code point that
+  // none of the already loaded fonts provide.
+  // The loader owns the fonts it returns.
+  Fonts(std::size_t num_fonts, FontLoader loader);
+
   Fonts(Fonts &&) = default;
   Fonts &operator=(Fonts &&) noexcept = default;
 
   // Not thread-safe.
-  TTF_Font *GetFontForCodePoint(std::uint16_t code_point) const;
+  TTF_Font *GetFontForCodePoint(std::uint32_t code_point) const;
+
+  // Horizontal advance of the code point's glyph in the font returned by
+  // `GetFontForCodePoint`, in pixels.
+  // Not thread-safe.
+  int GetAdvance(std::uint32_t code_point) const;
+
+  // As `GetAdvance`, along with the horizontal extent of the glyph relative
+  // to the pen position, as given by `TTF_GlyphMetrics`.
+  // Not thread-safe.
+  void GetHorizontalMetrics(std::uint32_t code_point, int *minx, int *maxx,
+                            int *advance) const;
+
+  // Kerning between two consecutive code points, in pixels, as applied when
+  // rendering: 0 if their glyphs come from different fonts.
+  // Not thread-safe.
+  int GetKerning(std::uint32_t prev_code_point, std::uint32_t code_point) const;
+
+  // Returns the font that provides all of the ASCII glyphs, or nullptr if
+  // they come from different fonts.
+  // Not thread-safe.
+  TTF_Font *GetFontForAscii() const;
 
   bool IsSingle() const {
-    return fonts_.size() == 1;
+    return fonts_.size() == 1 && next_font_ == num_fonts_;
   }
 
+  // Returns nullptr if none of the fonts could be opened.
   TTF_Font *GetFirstFont() const {
-      return fonts_[0];
-  }
-
-  std::vector<TTF_Font *> &fonts() {
-    return fonts_;
+    return fonts_.empty() ? nullptr : fonts_[0];
   }
 
  private:
-  std::vector<TTF_Font *> fonts_;
-  mutable std::array<TTF_Font *, std::numeric_limits<std::uint16_t>::max() + 1> glyph_index_cache_;
+  struct GlyphInfo {
+    std::uint8_t font_index;
+    std::int16_t minx;
+    std::int16_t maxx;
+    std::int16_t advance;
+  };
+  static constexpr std::uint8_t kUnknownFont =
+      std::numeric_limits<std::uint8_t>::max();
+  static constexpr std::int16_t kUnknownAdvance =
+      std::numeric_limits<std::int16_t>::min();
+
+  // Glyph lookups are cached in a two-level table: the directory is indexed
+  // by the high bits of the code point and only grows as far as needed, while
+  // pages of 256 entries are allocated on first use.
+  // Mostly-ASCII text only ever allocates the first page.
+  static constexpr std::size_t kPageBits = 8;
+  static constexpr std::size_t kPageSize = std::size_t{1} << kPageBits;
+  using Page = std::array<GlyphInfo, kPageSize>;
+
+  GlyphInfo &GetGlyphInfo(std::uint32_t code_point) const;
+
+  // Opens the next font in the fallback chain.
+  // Returns false if all of the fonts have already been tried.
+  bool LoadNextFont() const;
+
+  enum class AsciiFontState { kUnknown, kSingle, kMultiple };
+
+  std::size_t num_fonts_ = 0;
+  FontLoader loader_;
+
+  // Loaded fonts, in fallback order.
+  mutable std::vector<TTF_Font *> fonts_;
+  mutable std::size_t next_font_ = 0;
+
+  mutable std::vector<std::unique_ptr<Page>> pages_;
+  mutable AsciiFontState ascii_font_state_ = AsciiFontState::kUnknown;
 };
 
+/* Like TTF_SizeUTF8 but supports multiple fonts.
+ * Only uses glyph metrics, nothing is rendered. The width is that of the
+ * surface returned by TTFMultiFont_RenderUTF8_Shaded, including the parts of
+ * the glyphs that extend past the pen positions.
+ * Returns 0 on success. */
+int TTFMultiFont_SizeUTF8(const Fonts &fonts, const std::string &text, int *w,
+                          int *h);
+
 /* Like TTF_RenderUTF8_Shaded but supports multiple fonts. */
 SDL_Surface *TTFMultiFont_RenderUTF8_Shaded(const Fonts &fonts,
                                             const std::string &text,
@@ -4,13 +4,12 @@
 #include <iostream>
 
 #include <SDL_image.h>
-#ifdef USE_SDL2
-#include <SDL2_rotozoom.h>
-#else
-#include <SDL_rotozoom.h>
-#endif
+#include "config.h"
 #include "def.h"
 #include "fileutils.h"
+#include "image_cache.h"
+#include "image_scaler.h"
+#include "imageutils.h"
 #include "resourceManager.h"
 #include "screen.h"
 #include "sdl_ttf_multifont.h"
@@ -18,52 +17,195 @@
 
 namespace SDL_utils {
 
+namespace {
+
+// Composited pixels of all the windows underneath the topmost window,
+// used while the topmost window is not full-screen (e.g. a dialog).
+struct UnderlayCache
+{
+    SDLSurfaceUniquePtr surface;
+    bool valid = false;
+};
+UnderlayCache underlay_cache;
+
+// The image formats shown in the panel and the image viewer.
+struct ImageFormat {
+    const char *ext;
+    bool supports_alpha;
+};
+constexpr ImageFormat kImageFormats[] = {
+    { "jpg", false },
+    { "jpeg", false },
+    { "png", true },
+    { "gif", true },
+    { "bmp", true },
+    { "ico", true },
+    { "xcf", false },
+};
+
+const ImageFormat *findImageFormat(const std::string &ext)
+{
+    for (const ImageFormat &format : kImageFormats)
+        if (ext == format.ext) return &format;
+    return nullptr;
+}
+
+bool imageSupportsAlpha(const std::string &p_filename)
+{
+    // Formats that SDL_image can decode are assumed to have alpha unless
+    // listed otherwise.
+    const ImageFormat *format = findImageFormat(
+        File_utils::getLowercaseFileExtension(p_filename));
+    return format == nullptr || format->supports_alpha;
+}
+
+// Fits the original image size into the viewport without enlarging it,
+// and converts the result to physical pixels.
+Image_utils::TargetSizeFn fitTargetSize(int fit_w, int fit_h, float ppu_x, float ppu_y)
+{
+    return [fit_w, fit_h, ppu_x, ppu_y](
+               int w, int h, int *p_target_w, int *p_target_h) {
+        const double aspect_ratio = static_cast<double>(w) / h;
+        int target_w, target_h;
+        if (fit_w * h <= fit_h * w) {
+            target_w = std::min(w, fit_w);
+            target_h = target_w / aspect_ratio;
+        } else {
+            target_h = std::min(h, fit_h);
+            target_w = target_h * aspect_ratio;
+        }
+        *p_target_w = std::max(1, static_cast<int>(target_w * ppu_x));
+        *p_target_h = std::max(1, static_cast<int>(target_h * ppu_y));
+    };
+}
+
+// Scales straight into the screen's pixel format unless we need alpha.
+// Never returns a surface larger than the target size.
+SDLSurfaceUniquePtr scaleForDisplay(SDLSurfaceUniquePtr p_img,
+    const std::string &p_filename, int p_w, int p_h,
+    const Image_utils::PixelLayout &p_screen_layout)
+{
+    if (p_img == nullptr) return nullptr;
+    const Image_utils::PixelLayout l_layout
+        = imageLayout(p_filename, p_screen_layout);
+    SDLSurfaceUniquePtr l_scaled
+        = Image_utils::scale(p_img.get(), p_w, p_h, l_layout);
+    if (l_scaled != nullptr) return l_scaled;
+    std::cerr << "Could not scale " << p_filename << " to " << p_w << "x"
+              << p_h << ": " << SDL_GetError() << std::endl;
+    SDL_ClearError();
+    // The scaler only writes 16 and 32-bit pixels. The result is converted
+    // to the display format later.
+    if (l_layout.bpp != 32) {
+        l_scaled = Image_utils::scale(
+            p_img.get(), p_w, p_h, Image_utils::PixelLayout::rgba32());
+        if (l_scaled != nullptr) return l_scaled;
+    }
+    // Keeping a larger image around could run out of memory.
+    if (p_img->w <= p_w && p_img->h <= p_h) return p_img;
+    return nullptr;
+}
+
+bool underlayCacheMatches(const SDL_Surface *p_screen)
+{
+    const SDL_Surface *l_cache = underlay_cache.surface.get();
+    return l_cache != nullptr && l_cache->w == p_screen->w
+        && l_cache->h == p_screen->h
+        && l_cache->format->BitsPerPixel == p_screen->format->BitsPerPixel;
+}
+
+} // namespace
+
 void setMouseCursorEnabled(bool enabled) {
     SDL_ShowCursor(enabled ? 1 : 0);
 }
 
+std::size_t fullDecodeBudget()
+{
+    return static_cast<std::size_t>(std::max(config().zoom_image_kb, 0)) * 1024;
+}
+
 bool isSupportedImageExt(const std::string &ext) {
-    return ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "ico" || ext == "bmp" || ext == "xcf";
+    return findImageFormat(ext) != nullptr;
+}
+
+Image_utils::PixelLayout imageLayout(const std::string &p_filename,
+    const Image_utils::PixelLayout &p_screen_layout)
+{
+    return imageSupportsAlpha(p_filename) ? Image_utils::PixelLayout::rgba32()
+                                          : p_screen_layout;
 }
 
 SDLSurfaceUniquePtr loadImageToFit(
     const std::string &p_filename, int fit_w, int fit_h)
 {
-    // Load image
-    SDL_Surface *l_img = IMG_Load(p_filename.c_str());
-    if (IMG_GetError() != nullptr && *IMG_GetError() != '\0') {
-        if (!strcmp(IMG_GetError(), "Unsupported image format") == 0)
-            std::cerr << "loadImageToFit: " << IMG_GetError() << std::endl;
-        SDL_ClearError();
-        return nullptr;
+    return convertImageToDisplayFormat(
+        decodeImageToFit(p_filename, fit_w, fit_h, screen.ppu_x, screen.ppu_y,
+            Image_utils::PixelLayout::of(screen.surface->format)),
+        p_filename);
+}
+
+SDLSurfaceUniquePtr decodeImageToFit(const std::string &p_filename, int fit_w,
+    int fit_h, float ppu_x, float ppu_y,
+    const Image_utils::PixelLayout &p_screen_layout)
+{
+    const Image_utils::TargetSizeFn target_size
+        = fitTargetSize(fit_w, fit_h, ppu_x, ppu_y);
+
+    // Decode at a reduced size if possible, otherwise at full size.
+    int orig_w, orig_h;
+    SDLSurfaceUniquePtr l_img = Image_utils::decodeReduced(
+        p_filename, target_size, fullDecodeBudget(), &orig_w, &orig_h);
+    if (l_img == nullptr) {
+        l_img = Image_utils::loadFull(p_filename, fullDecodeBudget());
+        if (l_img == nullptr) {
+            if (!strcmp(IMG_GetError(), "Unsupported image format") == 0)
+                std::cerr << "loadImageToFit: " << IMG_GetError() << std::endl;
+            SDL_ClearError();
+            return nullptr;
+        }
+        orig_w = l_img->w;
+        orig_h = l_img->h;
     }
-    const double aspect_ratio = static_cast<double>(l_img->w) / l_img->h;
     int target_w, target_h;
-    if (fit_w * l_img->h <= fit_h * l_img->w) {
-        target_w = std::min(l_img->w, fit_w);
-        target_h = target_w / aspect_ratio;
-    } else {
-        target_h = std::min(l_img->h, fit_h);
-        target_w = target_h * aspect_ratio;
-    }
-    target_w *= screen.ppu_x;
-    target_h *= screen.ppu_y;
-    SDLSurfaceUniquePtr l_img2 { zoomSurface(l_img,
-        static_cast<double>(target_w) / l_img->w,
-        static_cast<double>(target_h) / l_img->h, SMOOTHING_ON) };
-    SDL_FreeSurface(l_img);
-
-    const std::string ext = File_utils::getLowercaseFileExtension(p_filename);
-    const bool supports_alpha = ext != "xcf" && ext != "jpg" && ext != "jpeg";
+    target_size(orig_w, orig_h, &target_w, &target_h);
+    return scaleForDisplay(
+        std::move(l_img), p_filename, target_w, target_h, p_screen_layout);
+}
+
+SDLSurfaceUniquePtr decodeImagePreviewToFit(const std::string &p_filename,
+    int fit_w, int fit_h, float ppu_x, float ppu_y,
+    const Image_utils::PixelLayout &p_screen_layout)
+{
+    int orig_w, orig_h;
+    SDLSurfaceUniquePtr l_img
+        = Image_utils::decodeExifThumbnail(p_filename, &orig_w, &orig_h);
+    if (l_img == nullptr) return nullptr;
+    int target_w, target_h;
+    fitTargetSize(fit_w, fit_h, ppu_x, ppu_y)(
+        orig_w, orig_h, &target_w, &target_h);
+    return scaleForDisplay(
+        std::move(l_img), p_filename, target_w, target_h, p_screen_layout);
+}
+
+SDLSurfaceUniquePtr convertImageToDisplayFormat(
+    SDLSurfaceUniquePtr p_img, const std::string &p_filename)
+{
+    if (p_img == nullptr) return nullptr;
+    const bool supports_alpha = imageSupportsAlpha(p_filename);
+    if (!supports_alpha
+        && Image_utils::PixelLayout::of(p_img->format)
+               .matches(screen.surface->format))
+        return p_img;
 #ifdef USE_SDL2
     auto l_img3 = supports_alpha
-        ? std::move(l_img2)
+        ? std::move(p_img)
         : SDLSurfaceUniquePtr { SDL_ConvertSurface(
-            l_img2.get(), screen.surface->format, SDL_SWSURFACE) };
+            p_img.get(), screen.surface->format, SDL_SWSURFACE) };
 #else
     SDLSurfaceUniquePtr l_img3 { supports_alpha
-            ? SDL_DisplayFormatAlpha(l_img2.get())
-            : SDL_DisplayFormat(l_img2.get()) };
+            ? SDL_DisplayFormatAlpha(p_img.get())
+            : SDL_DisplayFormat(p_img.get()) };
 #endif
     return l_img3;
 }
@@ -85,10 +227,15 @@ void applySurface(const Sint16 p_x, const Sint16 p_y, SDL_Surface* p_source, SDL
 }
 
 TTF_Font *loadFont(const std::string &p_font, const int p_size)
+{
+    return loadFont(p_font, p_size, 72 * screen.ppu_x, 72 * screen.ppu_y);
+}
+
+TTF_Font *loadFont(const std::string &p_font, const int p_size, const unsigned int p_hdpi, const unsigned int p_vdpi)
 {
     INHIBIT(std::cout << "loadFont(" << p_font << ", " << p_size << ")" << std::endl;)
 #ifdef USE_TTF_OPENFONT_DPI
-    TTF_Font *l_font = TTF_OpenFontDPI(p_font.c_str(), p_size, 72 * screen.ppu_x, 72 * screen.ppu_y);
+    TTF_Font *l_font = TTF_OpenFontDPI(p_font.c_str(), p_size, p_hdpi, p_vdpi);
 #else
     TTF_Font *l_font = TTF_OpenFont(p_font.c_str(), p_size);
 #endif
@@ -111,14 +258,10 @@ SDL_Surface *renderText(const Fonts &p_fonts, const std::string &p_text, const S
 
 std::pair<int, int> measureText(const Fonts &fonts, const std::string &text) {
     if (text.empty()) return {0, 0};
-    SDLSurfaceUniquePtr surface { TTFMultiFont_RenderUTF8_Shaded(
-        fonts, text, SDL_Color { 0, 0, 0, 0 }, SDL_Color { 0, 0, 0, 0 }) };
-    if (surface == nullptr && SDL_GetError() != nullptr && SDL_GetError()[0] != '\0') {
-        std::cerr << "TTFMultiFont_RenderUTF8_Shaded: " << SDL_GetError() << std::endl;
-        SDL_ClearError();
+    int width, height;
+    if (TTFMultiFont_SizeUTF8(fonts, text, &width, &height) != 0)
         return {0, 0};
-    }
-    return {surface->w, surface->h};
+    return {width, height};
 }
 
 void applyPpuScaledText(Sint16 p_x, Sint16 p_y, SDL_Surface* p_destination, const Fonts &p_fonts, const std::string &p_text, const SDL_Color &p_fg, const SDL_Color &p_bg, const T_TEXT_ALIGN p_align)
@@ -207,6 +350,11 @@ SDL_Surface *createImage(const int p_width, const int p_height, const Uint32 p_c
     return l_ret;
 }
 
+void invalidateRenderCache(void)
+{
+    underlay_cache.valid = false;
+}
+
 void renderAll(void)
 {
     if (Globals::g_windows.empty())
@@ -215,17 +363,51 @@ void renderAll(void)
     unsigned int l_i = Globals::g_windows.size() - 1;
     while (l_i && !Globals::g_windows[l_i]->isFullScreen())
         --l_i;
-    // Draw windows
-    for (std::vector<CWindow *>::iterator l_it = Globals::g_windows.begin() + l_i; l_it != Globals::g_windows.end(); ++l_it)
-        (*l_it)->render(l_it + 1 == Globals::g_windows.end());
+    CWindow *l_top = Globals::g_windows.back();
+    if (l_i + 1 == Globals::g_windows.size())
+    {
+        // Nothing is drawn underneath the top window: no need for a cache.
+        underlay_cache.surface = nullptr;
+        underlay_cache.valid = false;
+        l_top->render(true);
+        return;
+    }
+    // The windows underneath a non-fullscreen window (e.g. a dialog) do not
+    // change while it is open, so we composite them once and reuse the result.
+    SDL_Surface *l_screen = screen.surface;
+    if (!underlay_cache.valid || !underlayCacheMatches(l_screen))
+    {
+        for (std::vector<CWindow *>::iterator l_it = Globals::g_windows.begin() + l_i; l_it + 1 != Globals::g_windows.end(); ++l_it)
+            (*l_it)->render(false);
+        if (!underlayCacheMatches(l_screen))
+        {
+            underlay_cache.surface = SDLSurfaceUniquePtr { SDL_CreateRGBSurface(
+                SDL_SWSURFACE, l_screen->w, l_screen->h,
+                l_screen->format->BitsPerPixel, l_screen->format->Rmask,
+                l_screen->format->Gmask, l_screen->format->Bmask,
+                l_screen->format->Amask) };
+        }
+        if (underlay_cache.surface != nullptr)
+        {
+            SDL_BlitSurface(l_screen, nullptr, underlay_cache.surface.get(), nullptr);
+            underlay_cache.valid = true;
+        }
+    }
+    else
+    {
+        SDL_BlitSurface(underlay_cache.surface.get(), nullptr, l_screen, nullptr);
+    }
+    l_top->render(true);
 }
 
 void hastalavista(void)
 {
+    underlay_cache.surface = nullptr;
     // Destroy all dialogs except the first one (the commander)
     while (Globals::g_windows.size() > 1)
         delete Globals::g_windows.back();
     // Free resources
+    ImageCache::instance().clear();
     CResourceManager::instance().sdlCleanup();
     // Quit SDL
     TTF_Quit();
@@ -1,6 +1,7 @@
 #ifndef _SDLUTILS_H_
 #define _SDLUTILS_H_
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -9,6 +10,7 @@
 #include <SDL.h>
 #include <SDL_ttf.h>
 
+#include "image_scaler.h"
 #include "sdl_ptrs.h"
 #include "sdl_ttf_multifont.h"
 #include "window.h"
@@ -34,11 +36,41 @@ namespace SDL_utils
     // Load an image to fit the given viewport size.
     SDLSurfaceUniquePtr loadImageToFit(const std::string &p_filename, int fit_w, int fit_h);
 
-    bool isSupportedImageExt(const std::string &filename);
+    // Load an image to fit the given viewport size (logical units) at the
+    // given scaling factors. Images without alpha are scaled straight into
+    // the given screen layout, so that they usually need no conversion.
+    // Can be called from any thread.
+    SDLSurfaceUniquePtr decodeImageToFit(const std::string &p_filename, int fit_w, int fit_h, float ppu_x, float ppu_y, const Image_utils::PixelLayout &p_screen_layout);
+
+    // Like `decodeImageToFit`, but decodes the low-resolution thumbnail
+    // embedded in a JPEG's EXIF data, scaled to the same size as the full
+    // image would be. Returns nullptr if there is no usable thumbnail.
+    // Much faster than `decodeImageToFit`, e.g. for a first display.
+    // Can be called from any thread.
+    SDLSurfaceUniquePtr decodeImagePreviewToFit(const std::string &p_filename, int fit_w, int fit_h, float ppu_x, float ppu_y, const Image_utils::PixelLayout &p_screen_layout);
+
+    // The layout that `decodeImageToFit` decodes the given image to:
+    // the screen layout, or RGBA if the image may have transparency.
+    Image_utils::PixelLayout imageLayout(const std::string &p_filename, const Image_utils::PixelLayout &p_screen_layout);
+
+    // Convert an image returned by `decodeImageToFit` or
+    // `decodeImagePreviewToFit` to the display format.
+    // Must be called from the main thread.
+    SDLSurfaceUniquePtr convertImageToDisplayFormat(SDLSurfaceUniquePtr p_img, const std::string &p_filename);
+
+    // Memory budget in bytes for an image that can only be decoded at full
+    // size, e.g. a GIF or an interlaced PNG.
+    std::size_t fullDecodeBudget();
+
+    // Whether files with the given lowercase extension are shown as images.
+    bool isSupportedImageExt(const std::string &ext);
 
     // Load a TTF font
     TTF_Font *loadFont(const std::string &p_font, const int p_size);
 
+    // Load a font at the given DPI (only if supported by SDL_ttf)
+    TTF_Font *loadFont(const std::string &p_font, const int p_size, const unsigned int p_hdpi, const unsigned int p_vdpi);
+
     // Apply a surface on another surface (logical coordinates)
     void applySurface(const Sint16 p_x, const Sint16 p_y, SDL_Surface* p_source, SDL_Surface* p_destination, SDL_Rect *p_clip = NULL);
 
@@ -54,7 +86,7 @@ namespace SDL_utils
     // Render a text and apply on a given surface (actual coordinates)
     void applyPpuScaledText(Sint16 p_x, Sint16 p_y, SDL_Surface* p_destination, const Fonts &p_fonts, const std::string &p_text, const SDL_Color &p_fg, const SDL_Color &p_bg, const T_TEXT_ALIGN p_align = T_TEXT_ALIGN_LEFT);
 
-    // Get text dimensions (expensive).
+    // Get text dimensions from cached glyph metrics (nothing is rendered).
     std::pair<int, int> measureText(const Fonts &fonts, const std::string &text);
 
     // Equivalent to SDL_Rect { ... } but avoids -Wnarrowing.
@@ -98,6 +130,11 @@ namespace SDL_utils
     // Render all opened windows
     void renderAll(void);
 
+    // Discard the cached rendering of the windows underneath a dialog.
+    // Must be called when their contents change while a dialog is open.
+    // Opening or closing a window does this automatically.
+    void invalidateRenderCache(void);
+
     // Cleanup and quit
     void hastalavista(void);
 
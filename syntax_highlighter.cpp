@@ -0,0 +1,516 @@
+#include "syntax_highlighter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+constexpr SyntaxHighlighter::State SyntaxHighlighter::kInitialState;
+
+namespace {
+
+using Span = SyntaxHighlighter::Span;
+using Style = SyntaxHighlighter::Style;
+
+// Lines further below the lexed ones are lexed from a guessed state.
+constexpr std::size_t kMaxLexAhead = 1000;
+// The number of lines above such a line that are lexed from the initial
+// state, so that e.g. strings opened above it are still seen.
+constexpr std::size_t kGuessLines = 200;
+
+inline bool isSpace(char c) { return c == ' ' || c == '\t'; }
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+inline bool isWordChar(char c)
+{
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+void addSpan(std::size_t begin, std::size_t end, Style style,
+    std::vector<Span> *spans)
+{
+    if (begin < end) spans->push_back(Span { begin, end, style });
+}
+
+std::size_t skipSpaces(const std::string &line, std::size_t i)
+{
+    while (i < line.size() && isSpace(line[i])) ++i;
+    return i;
+}
+
+std::size_t trimEnd(
+    const std::string &line, std::size_t begin, std::size_t end)
+{
+    while (end > begin && isSpace(line[end - 1])) --end;
+    return end;
+}
+
+bool isNumber(const std::string &line, std::size_t begin, std::size_t end)
+{
+    if (begin < end && (line[begin] == '-' || line[begin] == '+')) ++begin;
+    if (begin == end || !isDigit(line[begin])) return false;
+    for (std::size_t i = begin; i < end; ++i) {
+        const char c = line[i];
+        if (!std::isxdigit(static_cast<unsigned char>(c)) && c != '.'
+            && c != 'x' && c != 'X')
+            return false;
+    }
+    return true;
+}
+
+bool equalsIgnoreCase(const std::string &line, std::size_t begin,
+    std::size_t end, const char *word)
+{
+    if (end - begin != std::strlen(word)) return false;
+    for (std::size_t i = begin; i < end; ++i) {
+        const int c = std::tolower(static_cast<unsigned char>(line[i]));
+        if (c != word[i - begin]) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief `key = value` lines with `#` comments, as in commander.cfg, and
+ * INI files, which also have `[sections]`, `:` separators and `;` comments.
+ */
+class KeyValueHighlighter : public SyntaxHighlighter {
+  public:
+    explicit KeyValueHighlighter(bool ini)
+        : ini_(ini)
+    {
+    }
+
+  protected:
+    State lex(const std::string &line, State state,
+        std::vector<Span> *spans) override
+    {
+        const std::size_t n = line.size();
+        const std::size_t i = skipSpaces(line, 0);
+        if (i == n) return state;
+        if (isComment(line[i])) {
+            addSpan(i, n, Style::COMMENT, spans);
+            return state;
+        }
+        if (ini_ && line[i] == '[') {
+            const std::size_t close = line.find(']', i);
+            const std::size_t end = close == std::string::npos ? n : close + 1;
+            addSpan(i, end, Style::KEYWORD, spans);
+            const std::size_t rest = skipSpaces(line, end);
+            if (rest < n && isComment(line[rest]))
+                addSpan(rest, n, Style::COMMENT, spans);
+            return state;
+        }
+        const std::size_t separator = line.find_first_of(ini_ ? "=:" : "=", i);
+        if (separator == std::string::npos) return state;
+        addSpan(i, trimEnd(line, i, separator), Style::KEY, spans);
+        lexValue(line, separator + 1, spans);
+        return state;
+    }
+
+  private:
+    bool isComment(char c) const { return c == '#' || (ini_ && c == ';'); }
+
+    void lexValue(
+        const std::string &line, std::size_t from, std::vector<Span> *spans)
+    {
+        const std::size_t begin = skipSpaces(line, from);
+        std::size_t end = line.size();
+        if (ini_) {
+            // Comments can follow the value after a space.
+            for (std::size_t i = begin + 1; i < end; ++i) {
+                if (isComment(line[i]) && isSpace(line[i - 1])) {
+                    end = i;
+                    break;
+                }
+            }
+        }
+        const std::size_t comment = end;
+        end = trimEnd(line, begin, end);
+        if (begin < end) {
+            if (line[begin] == '"' || line[begin] == '\'') {
+                addSpan(begin, end, Style::STRING, spans);
+            } else if (isNumber(line, begin, end)) {
+                addSpan(begin, end, Style::NUMBER, spans);
+            } else if (ini_) {
+                static const char *const kKeywords[]
+                    = { "true", "false", "yes", "no", "on", "off" };
+                for (const char *keyword : kKeywords) {
+                    if (equalsIgnoreCase(line, begin, end, keyword)) {
+                        addSpan(begin, end, Style::KEYWORD, spans);
+                        break;
+                    }
+                }
+            }
+        }
+        addSpan(comment, line.size(), Style::COMMENT, spans);
+    }
+
+    bool ini_;
+};
+
+/**
+ * @brief JSON, including the line and block comments that many
+ * configuration files written in it have.
+ */
+class JsonHighlighter : public SyntaxHighlighter {
+  protected:
+    State lex(const std::string &line, State state,
+        std::vector<Span> *spans) override
+    {
+        const std::size_t n = line.size();
+        std::size_t i = 0;
+        if (state == kBlockComment) {
+            i = commentEnd(line, 0);
+            addSpan(0, std::min(i, n), Style::COMMENT, spans);
+            if (i == std::string::npos) return state;
+        }
+        while (i < n) {
+            const char c = line[i];
+            if (c == '"') {
+                std::size_t j = i + 1;
+                while (j < n && line[j] != '"') j += line[j] == '\\' ? 2 : 1;
+                j = std::min(j + 1, n);
+                // Object keys are the strings followed by a colon.
+                const std::size_t next = skipSpaces(line, j);
+                addSpan(i, j,
+                    next < n && line[next] == ':' ? Style::KEY : Style::STRING,
+                    spans);
+                i = j;
+            } else if (c == '/' && i + 1 < n && line[i + 1] == '/') {
+                addSpan(i, n, Style::COMMENT, spans);
+                break;
+            } else if (c == '/' && i + 1 < n && line[i + 1] == '*') {
+                const std::size_t end = commentEnd(line, i + 2);
+                addSpan(i, std::min(end, n), Style::COMMENT, spans);
+                if (end == std::string::npos) return kBlockComment;
+                i = end;
+            } else if (c == '-' || isDigit(c)) {
+                std::size_t j = i + 1;
+                while (j < n
+                    && (std::isalnum(static_cast<unsigned char>(line[j]))
+                        || line[j] == '.' || line[j] == '+' || line[j] == '-'))
+                    ++j;
+                addSpan(i, j, Style::NUMBER, spans);
+                i = j;
+            } else if (std::isalpha(static_cast<unsigned char>(c))) {
+                std::size_t j = i + 1;
+                while (j < n && isWordChar(line[j])) ++j;
+                if (line.compare(i, j - i, "true") == 0
+                    || line.compare(i, j - i, "false") == 0
+                    || line.compare(i, j - i, "null") == 0)
+                    addSpan(i, j, Style::KEYWORD, spans);
+                i = j;
+            } else {
+                ++i;
+            }
+        }
+        return kInitialState;
+    }
+
+  private:
+    static constexpr State kBlockComment = 1;
+
+    // The offset after the `*/` at or after `from`, or npos.
+    static std::size_t commentEnd(const std::string &line, std::size_t from)
+    {
+        const std::size_t end = line.find("*/", from);
+        return end == std::string::npos ? end : end + 2;
+    }
+};
+
+constexpr SyntaxHighlighter::State JsonHighlighter::kBlockComment;
+
+/**
+ * @brief POSIX shell and bash scripts.
+ *
+ * Strings and here documents can span lines. The delimiters of the here
+ * documents seen so far are kept, and the state of a line within one is
+ * the index of its delimiter.
+ */
+class ShellHighlighter : public SyntaxHighlighter {
+  protected:
+    State lex(const std::string &line, State state,
+        std::vector<Span> *spans) override
+    {
+        const std::size_t n = line.size();
+        std::size_t i = 0;
+        if (state >= kHereDocument) {
+            const std::string &delimiter = delimiters_[state - kHereDocument];
+            std::size_t begin = 0;
+            // `<<-` strips leading tabs, which is marked by a '-' prefix.
+            if (delimiter[0] == '-')
+                while (begin < n && line[begin] == '\t') ++begin;
+            if (line.compare(begin, std::string::npos, delimiter, 1,
+                    std::string::npos)
+                == 0)
+                return kInitialState;
+            addSpan(0, n, Style::STRING, spans);
+            return state;
+        }
+        if (state == kSingleQuoted) {
+            const std::size_t end = line.find('\'');
+            if (end == std::string::npos) {
+                addSpan(0, n, Style::STRING, spans);
+                return state;
+            }
+            addSpan(0, end + 1, Style::STRING, spans);
+            i = end + 1;
+        } else if (state == kDoubleQuoted) {
+            i = lexDoubleQuoted(line, 0, 0, spans);
+            if (i == std::string::npos) return state;
+        }
+
+        State next = kInitialState;
+        // At the start of a word, and of a command.
+        bool word_start = true;
+        bool command = true;
+        // After `for`, `case` and `select`.
+        bool expect_in = false;
+        while (i < n) {
+            const char c = line[i];
+            if (isSpace(c)) {
+                word_start = true;
+                ++i;
+            } else if (c == '#' && word_start) {
+                addSpan(i, n, Style::COMMENT, spans);
+                break;
+            } else if (c == '\\') {
+                word_start = false;
+                i += 2;
+            } else if (c == '\'') {
+                const std::size_t end = line.find('\'', i + 1);
+                if (end == std::string::npos) {
+                    addSpan(i, n, Style::STRING, spans);
+                    return kSingleQuoted;
+                }
+                addSpan(i, end + 1, Style::STRING, spans);
+                word_start = false;
+                i = end + 1;
+            } else if (c == '"') {
+                i = lexDoubleQuoted(line, i, i + 1, spans);
+                if (i == std::string::npos) return kDoubleQuoted;
+                word_start = false;
+            } else if (c == '$') {
+                const std::size_t end = variableEnd(line, i);
+                addSpan(i, end, Style::VARIABLE, spans);
+                word_start = false;
+                i = std::max(end, i + 1);
+            } else if (c == '<' && line.compare(i, 2, "<<") == 0
+                && line.compare(i, 3, "<<<") != 0) {
+                i = lexHereDocument(line, i + 2, &next);
+            } else if (isWordChar(c) && word_start) {
+                std::size_t end = i + 1;
+                while (end < n && isWordChar(line[end])) ++end;
+                word_start = false;
+                if (command && end < n && line[end] == '=' && !isDigit(c)) {
+                    // An assignment.
+                    addSpan(i, end, Style::KEY, spans);
+                    i = end + 1;
+                    continue;
+                }
+                const std::string word = line.substr(i, end - i);
+                if ((command && isKeyword(word))
+                    || (expect_in && word == "in")) {
+                    addSpan(i, end, Style::KEYWORD, spans);
+                    expect_in
+                        = word == "for" || word == "case" || word == "select";
+                    // E.g. `then` and `do` are followed by a command.
+                    command = !expect_in;
+                } else {
+                    command = false;
+                }
+                i = end;
+            } else if (std::strchr(";|&(){}`", c) != nullptr) {
+                word_start = command = true;
+                ++i;
+            } else {
+                word_start = false;
+                ++i;
+            }
+        }
+        return next;
+    }
+
+  private:
+    static constexpr State kSingleQuoted = 1;
+    static constexpr State kDoubleQuoted = 2;
+    static constexpr State kHereDocument = 3;
+
+    static bool isKeyword(const std::string &word)
+    {
+        static const char *const kKeywords[] = { "if", "then", "else", "elif",
+            "fi", "case", "esac", "for", "select", "while", "until", "do",
+            "done", "function", "time", "return", "exit", "export", "local",
+            "readonly", "declare", "unset", "break", "continue", "shift",
+            "source", "eval", "exec", "trap", "set" };
+        for (const char *keyword : kKeywords)
+            if (word == keyword) return true;
+        return false;
+    }
+
+    // The offset after the variable reference at `i`, e.g. `$HOME`,
+    // `${x:-y}` or `$1`, or `i` if there is none.
+    static std::size_t variableEnd(const std::string &line, std::size_t i)
+    {
+        const std::size_t n = line.size();
+        std::size_t j = i + 1;
+        if (j == n) return i;
+        const char c = line[j];
+        if (c == '{') {
+            const std::size_t close = line.find('}', j);
+            return close == std::string::npos ? n : close + 1;
+        }
+        if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            while (j < n && isWordChar(line[j])) ++j;
+            return j;
+        }
+        if (isDigit(c) || std::strchr("@*#?$!-", c) != nullptr) return j + 1;
+        return i;
+    }
+
+    // Lexes a double-quoted string that starts at `begin`, from `i` on, with
+    // the variables in it. Returns the offset after the closing quote, or
+    // npos if the string continues on the next line.
+    static std::size_t lexDoubleQuoted(const std::string &line,
+        std::size_t begin, std::size_t i, std::vector<Span> *spans)
+    {
+        const std::size_t n = line.size();
+        while (i < n) {
+            const char c = line[i];
+            if (c == '\\') {
+                i += 2;
+            } else if (c == '"') {
+                addSpan(begin, i + 1, Style::STRING, spans);
+                return i + 1;
+            } else if (c == '$' && variableEnd(line, i) > i) {
+                const std::size_t end = variableEnd(line, i);
+                addSpan(begin, i, Style::STRING, spans);
+                addSpan(i, end, Style::VARIABLE, spans);
+                begin = i = end;
+            } else {
+                ++i;
+            }
+        }
+        addSpan(begin, n, Style::STRING, spans);
+        return std::string::npos;
+    }
+
+    // Reads the delimiter of a here document after `<<` at `i`, setting
+    // `next` to the state of the following lines. Returns the offset after
+    // the delimiter.
+    std::size_t lexHereDocument(
+        const std::string &line, std::size_t i, State *next)
+    {
+        const std::size_t n = line.size();
+        std::string delimiter(1, ' ');
+        if (i < n && line[i] == '-') {
+            delimiter[0] = '-';
+            ++i;
+        }
+        i = skipSpaces(line, i);
+        while (i < n && !isSpace(line[i])
+            && std::strchr(";|&<>()", line[i]) == nullptr) {
+            // Quoting the delimiter only disables expansion in the body.
+            if (line[i] != '\'' && line[i] != '"' && line[i] != '\\')
+                delimiter += line[i];
+            ++i;
+        }
+        if (delimiter.size() == 1 || *next != kInitialState) return i;
+        auto it = std::find(delimiters_.begin(), delimiters_.end(), delimiter);
+        if (it == delimiters_.end())
+            it = delimiters_.insert(delimiters_.end(), delimiter);
+        *next = kHereDocument + static_cast<State>(it - delimiters_.begin());
+        return i;
+    }
+
+    // With a '-' prefix for `<<-` and a ' ' prefix otherwise.
+    std::vector<std::string> delimiters_;
+};
+
+constexpr SyntaxHighlighter::State ShellHighlighter::kSingleQuoted;
+constexpr SyntaxHighlighter::State ShellHighlighter::kDoubleQuoted;
+constexpr SyntaxHighlighter::State ShellHighlighter::kHereDocument;
+
+// E.g. `#!/bin/sh` or `#!/usr/bin/env bash`.
+bool isShellShebang(const std::string &line)
+{
+    if (line.compare(0, 2, "#!") != 0) return false;
+    std::size_t begin = skipSpaces(line, 2);
+    std::size_t end = begin;
+    while (end < line.size() && !isSpace(line[end])) ++end;
+    std::string program = line.substr(begin, end - begin);
+    program.erase(0, program.rfind('/') + 1);
+    if (program == "env") {
+        begin = skipSpaces(line, end);
+        end = begin;
+        while (end < line.size() && !isSpace(line[end])) ++end;
+        program = line.substr(begin, end - begin);
+    }
+    // sh, bash, dash, ash, ksh, zsh...
+    return program.size() >= 2
+        && program.compare(program.size() - 2, 2, "sh") == 0;
+}
+
+} // namespace
+
+std::unique_ptr<SyntaxHighlighter> SyntaxHighlighter::forFile(
+    const std::string &path, const std::string &first_line)
+{
+    const std::size_t name = path.rfind('/') + 1;
+    const std::size_t dot = path.rfind('.');
+    std::string extension;
+    if (dot != std::string::npos && dot > name) {
+        extension = path.substr(dot + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+            [](char c) { return std::tolower(static_cast<unsigned char>(c)); });
+    }
+    if (extension == "cfg")
+        return std::unique_ptr<SyntaxHighlighter> { new KeyValueHighlighter(
+            /*ini=*/false) };
+    if (extension == "ini")
+        return std::unique_ptr<SyntaxHighlighter> { new KeyValueHighlighter(
+            /*ini=*/true) };
+    if (extension == "json")
+        return std::unique_ptr<SyntaxHighlighter> { new JsonHighlighter() };
+    if (extension == "sh" || extension == "bash" || isShellShebang(first_line))
+        return std::unique_ptr<SyntaxHighlighter> { new ShellHighlighter() };
+    return nullptr;
+}
+
+std::vector<Span> SyntaxHighlighter::highlight(std::size_t index,
+    const std::string &text, const LineReader &read_line)
+{
+    // The lexed lines have caught up with the guessed ones.
+    if (guess_first_ < states_.size()) guess_states_.clear();
+    std::vector<State> *states = &states_;
+    std::size_t first = 0;
+    if (index >= states_.size() + kMaxLexAhead) {
+        if (guess_states_.empty() || index < guess_first_
+            || index >= guess_first_ + guess_states_.size() + kMaxLexAhead) {
+            guess_first_ = index - kGuessLines;
+            guess_states_.assign(1, kInitialState);
+        }
+        states = &guess_states_;
+        first = guess_first_;
+    }
+    std::vector<Span> spans;
+    while (first + states->size() <= index) {
+        spans.clear();
+        const State state = states->back();
+        states->push_back(
+            lex(read_line(first + states->size() - 1), state, &spans));
+    }
+    spans.clear();
+    const State end = lex(text, (*states)[index - first], &spans);
+    if (index + 1 == first + states->size()) states->push_back(end);
+    return spans;
+}
+
+void SyntaxHighlighter::invalidate(std::size_t index)
+{
+    if (index + 1 < states_.size()) states_.resize(index + 1);
+    if (index < guess_first_)
+        guess_states_.clear();
+    else if (index - guess_first_ + 1 < guess_states_.size())
+        guess_states_.resize(index - guess_first_ + 1);
+}
@@ -0,0 +1,74 @@
+#ifndef SYNTAX_HIGHLIGHTER_H_
+#define SYNTAX_HIGHLIGHTER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Highlights the syntax of configuration files, JSON and shell
+ * scripts, one line at a time.
+ *
+ * What a line carries over to the next, e.g. an open string or a here
+ * document, is the lexer state that it ends in. The state at the start of
+ * each line lexed so far is cached, so that a line is highlighted from the
+ * nearest known state above it, and an edit only drops the states from the
+ * edited line downward.
+ *
+ * Lines far below the lexed ones, e.g. after a jump to the end of a large
+ * file, are lexed from the initial state a few screens above them instead
+ * of from the start of the file.
+ */
+class SyntaxHighlighter {
+  public:
+    enum class Style { COMMENT, KEYWORD, KEY, STRING, NUMBER, VARIABLE };
+
+    // A highlighted part of a line, by byte offsets.
+    struct Span {
+        std::size_t begin, end;
+        Style style;
+    };
+
+    // Returns the lines of the file with the given index.
+    using LineReader = std::function<std::string(std::size_t)>;
+
+    // Picks a highlighter by file extension, or by the `#!` line for shell
+    // scripts. Returns nullptr for other files.
+    static std::unique_ptr<SyntaxHighlighter> forFile(
+        const std::string &path, const std::string &first_line);
+
+    virtual ~SyntaxHighlighter() = default;
+
+    // Returns the spans of the line, sorted. `text` is the line at `index`,
+    // and the lines above it are read with `read_line` as needed.
+    std::vector<Span> highlight(std::size_t index, const std::string &text,
+        const LineReader &read_line);
+
+    // Drops the states from the line at `index` downward, after it has
+    // changed or lines have been inserted or removed there.
+    void invalidate(std::size_t index);
+
+  protected:
+    using State = std::uint32_t;
+    static constexpr State kInitialState = 0;
+
+    SyntaxHighlighter() = default;
+
+    // Lexes a line that starts in `state`, appending its spans to `spans`.
+    // Returns the state at the end of the line.
+    virtual State lex(
+        const std::string &line, State state, std::vector<Span> *spans)
+        = 0;
+
+  private:
+    // The state at the start of each line from the start of the file, and
+    // from `guess_first_` for the lines far below those.
+    std::vector<State> states_ { kInitialState };
+    std::size_t guess_first_ = 0;
+    std::vector<State> guess_states_;
+};
+
+#endif // SYNTAX_HIGHLIGHTER_H_
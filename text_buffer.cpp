@@ -0,0 +1,217 @@
+#include "text_buffer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+#include "utf8.h"
+
+namespace {
+
+// Saving writes in chunks of this size.
+constexpr std::size_t kWriteChunkBytes = 256 * 1024;
+
+bool writeAll(int fd, const char *data, std::size_t size)
+{
+    while (size > 0) {
+        const ssize_t n = ::write(fd, data, size);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+TextBuffer::TextBuffer(const TextFile &file)
+    : file_(file)
+    , newline_("\n")
+{
+    pieces_.push_back(Piece { /*added=*/false, 0, file_.numLines() });
+    updateEnds();
+    const std::uint64_t second_line = file_.lineOffset(1);
+    if (file_.numLines() > 1 && second_line >= 2) {
+        char terminator[2];
+        if (file_.read(second_line - 2, 2, terminator) == 2
+            && terminator[0] == '\r')
+            newline_ = "\r\n";
+    }
+}
+
+std::string TextBuffer::line(std::size_t index, std::size_t max_bytes) const
+{
+    if (index >= numLines()) return {};
+    const std::size_t k
+        = std::upper_bound(ends_.begin(), ends_.end(), index) - ends_.begin();
+    const Piece &piece = pieces_[k];
+    const std::size_t line_index
+        = piece.start + index - (ends_[k] - piece.count);
+    if (!piece.added) return file_.line(line_index, max_bytes);
+    const std::string &text = added_[line_index];
+    if (text.size() <= max_bytes) return text;
+    std::string result = text.substr(0, max_bytes);
+    // Do not leave a partial code point at the end.
+    utf8::removePartialCodePoint(&result);
+    return result;
+}
+
+void TextBuffer::replaceLine(std::size_t index, std::string text)
+{
+    const std::size_t k = split(index);
+    split(index + 1);
+    Piece &piece = pieces_[k];
+    if (piece.added) {
+        added_[piece.start] = std::move(text);
+        return;
+    }
+    piece = Piece { /*added=*/true, added_.size(), 1 };
+    added_.push_back(std::move(text));
+}
+
+void TextBuffer::insertLine(std::size_t index, std::string text)
+{
+    const std::size_t k = split(index);
+    pieces_.insert(
+        pieces_.begin() + k, Piece { /*added=*/true, added_.size(), 1 });
+    added_.push_back(std::move(text));
+    updateEnds();
+}
+
+void TextBuffer::eraseLine(std::size_t index)
+{
+    const std::size_t k = split(index);
+    split(index + 1);
+    // The added text is not needed anymore.
+    if (pieces_[k].added) std::string().swap(added_[pieces_[k].start]);
+    pieces_.erase(pieces_.begin() + k);
+    updateEnds();
+}
+
+std::size_t TextBuffer::split(std::size_t index)
+{
+    const std::size_t k
+        = std::upper_bound(ends_.begin(), ends_.end(), index) - ends_.begin();
+    if (k == pieces_.size()) return k;
+    Piece &piece = pieces_[k];
+    const std::size_t offset = index - (ends_[k] - piece.count);
+    if (offset == 0) return k;
+    const Piece tail { piece.added, piece.start + offset, piece.count - offset };
+    piece.count = offset;
+    pieces_.insert(pieces_.begin() + k + 1, tail);
+    updateEnds();
+    return k + 1;
+}
+
+void TextBuffer::updateEnds()
+{
+    ends_.resize(pieces_.size());
+    std::size_t end = 0;
+    for (std::size_t k = 0; k < pieces_.size(); ++k) {
+        end += pieces_[k].count;
+        ends_[k] = end;
+    }
+}
+
+bool TextBuffer::writeTo(int fd) const
+{
+    std::vector<char> buffer(kWriteChunkBytes);
+    std::size_t used = 0;
+    const auto flush = [&]() {
+        if (!writeAll(fd, buffer.data(), used)) return false;
+        used = 0;
+        return true;
+    };
+    const auto append = [&](const std::string &text) {
+        if (used + text.size() > buffer.size()) {
+            if (!flush()) return false;
+            if (text.size() > buffer.size())
+                return writeAll(fd, text.data(), text.size());
+        }
+        std::copy(text.begin(), text.end(), buffer.begin() + used);
+        used += text.size();
+        return true;
+    };
+    for (std::size_t k = 0; k < pieces_.size(); ++k) {
+        const Piece &piece = pieces_[k];
+        if (piece.added) {
+            for (std::size_t i = piece.start; i < piece.start + piece.count;
+                 ++i) {
+                if (!append(added_[i]) || !append(newline_)) return false;
+            }
+            continue;
+        }
+        // The original lines are copied with their line terminators.
+        std::uint64_t offset = file_.lineOffset(piece.start);
+        const std::uint64_t end = file_.lineOffset(piece.start + piece.count);
+        char last = '\n';
+        while (offset < end) {
+            if (used == buffer.size() && !flush()) return false;
+            const std::size_t n = file_.read(offset,
+                static_cast<std::size_t>(std::min<std::uint64_t>(
+                    end - offset, buffer.size() - used)),
+                buffer.data() + used);
+            if (n == 0) {
+                errno = EIO;
+                return false;
+            }
+            used += n;
+            offset += n;
+            last = buffer[used - 1];
+        }
+        // The last line of the file may have no terminator.
+        const bool terminated
+            = end > file_.lineOffset(piece.start) && last == '\n';
+        if (!terminated && k + 1 < pieces_.size() && !append(newline_))
+            return false;
+    }
+    return flush();
+}
+
+bool TextBuffer::save(const std::string &path) const
+{
+    // Replaces the target of a symbolic link rather than the link.
+    char *resolved = realpath(path.c_str(), nullptr);
+    const std::string target = resolved != nullptr ? resolved : path;
+    std::free(resolved);
+    const std::size_t slash = target.rfind('/');
+    const std::string dir = slash == std::string::npos
+        ? "."
+        : (slash == 0 ? "/" : target.substr(0, slash));
+    std::string tmp_path = target.substr(0, slash + 1) + "."
+        + target.substr(slash + 1) + ".XXXXXX";
+    const int fd = mkstemp(&tmp_path[0]);
+    if (fd == -1) return false;
+
+    // `mkstemp` creates the file only readable by the user.
+    struct stat st;
+    if (stat(target.c_str(), &st) == 0) fchmod(fd, st.st_mode & 07777);
+    bool ok = writeTo(fd) && fsync(fd) == 0;
+    int error = ok ? 0 : errno;
+    if (::close(fd) == -1 && ok) {
+        ok = false;
+        error = errno;
+    }
+    if (ok && std::rename(tmp_path.c_str(), target.c_str()) == -1) {
+        ok = false;
+        error = errno;
+    }
+    if (!ok) {
+        unlink(tmp_path.c_str());
+        errno = error;
+        return false;
+    }
+    // Makes the rename itself durable.
+    const int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd != -1) {
+        fsync(dir_fd);
+        ::close(dir_fd);
+    }
+    return true;
+}
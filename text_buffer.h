@@ -0,0 +1,68 @@
+#ifndef TEXT_BUFFER_H_
+#define TEXT_BUFFER_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "text_file.h"
+
+/**
+ * @brief The lines of a `TextFile` with edits on top, as a piece table.
+ *
+ * The buffer is a sequence of pieces, each of which is either a range of
+ * lines of the original file or a range of added lines. The original lines
+ * are read from the file as needed, so only the edited lines are held in
+ * memory, and an edit only splits the pieces around it.
+ */
+class TextBuffer {
+  public:
+    // `file` must be fully indexed and must outlive the buffer.
+    explicit TextBuffer(const TextFile &file);
+
+    TextBuffer(const TextBuffer &) = delete;
+    TextBuffer &operator=(const TextBuffer &) = delete;
+
+    std::size_t numLines() const { return ends_.empty() ? 0 : ends_.back(); }
+
+    // See `TextFile::line`.
+    std::string line(std::size_t index,
+        std::size_t max_bytes = TextFile::kMaxLineBytes) const;
+
+    void replaceLine(std::size_t index, std::string text);
+    void insertLine(std::size_t index, std::string text);
+    void eraseLine(std::size_t index);
+
+    // Writes the lines to a temporary file next to `path`, flushes it to
+    // the disk and renames it over `path`, so that `path` is either fully
+    // written or unchanged. The unedited lines are copied as is.
+    // Returns false and sets `errno` on failure.
+    bool save(const std::string &path) const;
+
+  private:
+    struct Piece {
+        // Whether the lines are in `added_` rather than in the file.
+        bool added;
+        std::size_t start;
+        std::size_t count;
+    };
+
+    // Splits the pieces so that one starts at line `index`.
+    // Returns the index of that piece, or the number of pieces if `index`
+    // is the number of lines.
+    std::size_t split(std::size_t index);
+
+    void updateEnds();
+
+    bool writeTo(int fd) const;
+
+    const TextFile &file_;
+    // Line terminator for the added lines, the same as the file's.
+    std::string newline_;
+    std::vector<std::string> added_;
+    std::vector<Piece> pieces_;
+    // The number of lines up to the end of each piece.
+    std::vector<std::size_t> ends_;
+};
+
+#endif // TEXT_BUFFER_H_
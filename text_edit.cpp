@@ -1,5 +1,6 @@
 #include "text_edit.h"
 
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
 
@@ -15,6 +16,26 @@ using SDL_utils::renderBorder;
 using SDL_utils::renderRectWithBorder;
 
 bool is_ascii(unsigned char c) { return c <= 0x7f; }
+
+// As in `utf8::replaceTabsWithSpaces`.
+constexpr std::size_t kTabWidth = 4;
+
+int glyphWidth(const Fonts &fonts, const char *data, std::size_t len)
+{
+    // The glyph advances are cached by `Fonts`. Measuring the code point
+    // as text would include the overhangs of its glyph.
+    return fonts.GetAdvance(utf8::decodeCodePoint(data, len));
+}
+
+// Copies `w` pixels wide from `src` at `src_x` to `dst` at `dst_x`.
+void copyColumns(SDL_Surface *src, int src_x, int w, SDL_Surface *dst,
+    int dst_x)
+{
+    if (src == nullptr || w <= 0) return;
+    SDL_Rect src_rect = makeRect(src_x, 0, w, src->h);
+    SDL_Rect dst_rect = makeRect(dst_x, 0, 0, 0);
+    SDL_BlitSurface(src, &src_rect, dst, &dst_rect);
+}
 } // namespace
 
 void TextEdit::setDimensions(int width, int height)
@@ -36,6 +57,8 @@ void TextEdit::setDimensions(int width, int height)
     prepareSurfaces();
     prepareColors();
     updateBackground();
+    // The scale may have changed.
+    layout_valid_ = false;
     update_foreground_ = true;
 }
 
@@ -69,41 +92,172 @@ void TextEdit::updateForeground() const
 {
     update_foreground_ = false;
     SDL_FillRect(foreground_.get(), nullptr, bg_color_);
+    if (!layout_valid_) layoutAll();
     if (text_.empty()) {
         text_x_ = cursor_x_ = 0;
         return;
     }
     const int max_w = foreground_rect_.w - 2 * padding_x_;
 
-    std::string text_buf;
-    const auto text_for_render
-        = [this, &text_buf](const std::string &str) -> const std::string & {
-        if (!support_tabs_) return str;
-        text_buf = str;
-        utf8::replaceTabsWithSpaces(&text_buf);
-        return text_buf;
-    };
-
-    const auto &fonts = CResourceManager::instance().getFonts();
-    SDLSurfaceUniquePtr tmp_surface { SDL_utils::renderText(fonts,
-        text_for_render(text_), Globals::g_colorTextNormal, { COLOR_BG_1 }) };
-    const int cursor_x = cursor_pos_ == text_.size()
-        ? tmp_surface->w
-        : SDL_utils::measureText(
-            fonts, text_for_render(text_.substr(0, cursor_pos_)))
-              .first;
+    // The text is already rendered, and the cursor position is a lookup.
+    const int cursor_x = xs_[codePointAt(cursor_pos_)];
     if (cursor_x < text_x_) text_x_ = cursor_x;
     if (cursor_x > text_x_ + max_w) text_x_ = cursor_x - max_w;
 
     cursor_x_ = cursor_x - text_x_;
 
+    if (text_surface_ == nullptr) return;
     SDL_Rect rect;
     rect.x = text_x_;
     rect.y = 0;
     rect.w = max_w;
-    rect.h = tmp_surface->h;
+    rect.h = text_surface_->h;
     SDL_utils::applyPpuScaledSurface(
-        padding_x_, padding_y_, tmp_surface.get(), foreground_.get(), &rect);
+        padding_x_, padding_y_, text_surface_.get(), foreground_.get(), &rect);
+}
+
+void TextEdit::replaceText(
+    std::size_t begin, std::size_t end, const std::string &text)
+{
+    if (!layout_valid_) {
+        // Laid out in full when it is first shown.
+        text_.replace(begin, end - begin, text);
+        return;
+    }
+    const std::size_t first = codePointAt(begin);
+    const std::size_t last = codePointAt(end);
+    text_.replace(begin, end - begin, text);
+
+    const auto &fonts = CResourceManager::instance().getFonts();
+    std::vector<std::size_t> starts;
+    std::vector<int> widths;
+    for (std::size_t i = 0; i < text.size();) {
+        const std::size_t len = std::min(
+            utf8::codePointLen(text.data() + i), text.size() - i);
+        starts.push_back(begin + i);
+        widths.push_back(glyphWidth(fonts, text.data() + i, len));
+        i += len;
+    }
+    const std::size_t added = starts.size();
+    for (std::size_t k = last; k < starts_.size(); ++k)
+        starts_[k] = starts_[k] - end + begin + text.size();
+    starts_.erase(starts_.begin() + first, starts_.begin() + last);
+    starts_.insert(starts_.begin() + first, starts.begin(), starts.end());
+    widths_.erase(widths_.begin() + first, widths_.begin() + last);
+    widths_.insert(widths_.begin() + first, widths.begin(), widths.end());
+    const std::vector<int> old_xs = std::move(xs_);
+    updateOffsets();
+
+    SDLSurfaceUniquePtr old_surface = std::move(text_surface_);
+    auto runs = renderRuns(first, first + added);
+    int height = old_surface != nullptr ? old_surface->h : 0;
+    for (const auto &run : runs) height = std::max(height, run.second->h);
+    if (xs_.back() == 0 || height == 0) return;
+    text_surface_.reset(SDL_utils::createSurface(xs_.back(), height));
+    if (text_surface_ == nullptr) return;
+    SDL_FillRect(text_surface_.get(), nullptr, bg_color_);
+
+    // The text before the change stays where it was.
+    copyColumns(old_surface.get(), 0, xs_[first], text_surface_.get(), 0);
+    for (const auto &run : runs) {
+        copyColumns(run.second.get(), 0, run.second->w, text_surface_.get(),
+            xs_[run.first]);
+    }
+    // The text after it is moved, in runs that have moved by the same
+    // distance. Tabs after the change may have changed width.
+    const std::size_t old_offset = last - first;
+    for (std::size_t k = first + added; k < widths_.size();) {
+        const std::size_t old_k = k - added + old_offset;
+        const int delta = xs_[k] - old_xs[old_k];
+        std::size_t run_end = k + 1;
+        while (run_end < widths_.size()
+            && xs_[run_end] - old_xs[run_end - added + old_offset] == delta)
+            ++run_end;
+        const int w = std::min(xs_[run_end] - xs_[k],
+            old_xs[run_end - added + old_offset] - old_xs[old_k]);
+        copyColumns(old_surface.get(), old_xs[old_k], w, text_surface_.get(),
+            xs_[k]);
+        k = run_end;
+    }
+}
+
+void TextEdit::layoutAll() const
+{
+    const auto &fonts = CResourceManager::instance().getFonts();
+    starts_.clear();
+    widths_.clear();
+    for (std::size_t i = 0; i < text_.size();) {
+        const std::size_t len = std::min(
+            utf8::codePointLen(text_.data() + i), text_.size() - i);
+        starts_.push_back(i);
+        widths_.push_back(glyphWidth(fonts, text_.data() + i, len));
+        i += len;
+    }
+    starts_.push_back(text_.size());
+    space_width_ = glyphWidth(fonts, " ", 1);
+    updateOffsets();
+    layout_valid_ = true;
+
+    text_surface_ = nullptr;
+    auto runs = renderRuns(0, widths_.size());
+    int height = 0;
+    for (const auto &run : runs) height = std::max(height, run.second->h);
+    if (xs_.back() == 0 || height == 0) return;
+    text_surface_.reset(SDL_utils::createSurface(xs_.back(), height));
+    if (text_surface_ == nullptr) return;
+    SDL_FillRect(text_surface_.get(), nullptr, bg_color_);
+    for (const auto &run : runs) {
+        copyColumns(run.second.get(), 0, run.second->w, text_surface_.get(),
+            xs_[run.first]);
+    }
+}
+
+void TextEdit::updateOffsets() const
+{
+    xs_.resize(widths_.size() + 1);
+    int x = 0;
+    std::size_t column = 0;
+    for (std::size_t k = 0; k < widths_.size(); ++k) {
+        xs_[k] = x;
+        if (support_tabs_ && text_[starts_[k]] == '\t') {
+            const std::size_t num_spaces = kTabWidth - column % kTabWidth;
+            x += static_cast<int>(num_spaces) * space_width_;
+            column += num_spaces;
+        } else {
+            x += widths_[k];
+            ++column;
+        }
+    }
+    xs_.back() = x;
+}
+
+std::size_t TextEdit::codePointAt(std::size_t byte) const
+{
+    return std::lower_bound(starts_.begin(), starts_.end(), byte)
+        - starts_.begin();
+}
+
+std::vector<std::pair<std::size_t, SDLSurfaceUniquePtr>> TextEdit::renderRuns(
+    std::size_t begin, std::size_t end) const
+{
+    const auto &fonts = CResourceManager::instance().getFonts();
+    std::vector<std::pair<std::size_t, SDLSurfaceUniquePtr>> runs;
+    for (std::size_t k = begin; k < end;) {
+        if (support_tabs_ && text_[starts_[k]] == '\t') {
+            ++k;
+            continue;
+        }
+        std::size_t run_end = k + 1;
+        while (run_end < end
+            && !(support_tabs_ && text_[starts_[run_end]] == '\t'))
+            ++run_end;
+        SDLSurfaceUniquePtr surface { SDL_utils::renderText(fonts,
+            text_.substr(starts_[k], starts_[run_end] - starts_[k]),
+            Globals::g_colorTextNormal, { COLOR_BG_1 }) };
+        if (surface != nullptr) runs.emplace_back(k, std::move(surface));
+        k = run_end;
+    }
+    return runs;
 }
 
 void TextEdit::blitBackground(SDL_Surface &out, int x, int y) const
@@ -169,17 +323,31 @@ bool TextEdit::setCursorToEnd()
     return true;
 }
 
+void TextEdit::setText(const std::string &text)
+{
+    // Only the part after the common prefix is replaced.
+    std::size_t common = 0;
+    const std::size_t max_common = std::min(text.size(), text_.size());
+    while (common < max_common && text[common] == text_[common]) ++common;
+    while (common > 0 && common < text_.size()
+        && utf8::isTrailByte(text_[common]))
+        --common;
+    replaceText(common, text_.size(), text.substr(common));
+    cursor_pos_ = text_.size();
+    update_foreground_ = true;
+}
+
 void TextEdit::typeText(const std::string &text)
 {
     if (text.empty()) return;
-    text_.insert(cursor_pos_, text);
+    replaceText(cursor_pos_, cursor_pos_, text);
     cursor_pos_ += text.size();
     update_foreground_ = true;
 }
 
 void TextEdit::typeText(char c)
 {
-    text_.insert(cursor_pos_, 1, c);
+    replaceText(cursor_pos_, cursor_pos_, std::string(1, c));
     ++cursor_pos_;
     update_foreground_ = true;
 }
@@ -189,7 +357,7 @@ bool TextEdit::backspace()
     if (cursor_pos_ == 0) return false;
     std::size_t left = cursor_pos_ - 1;
     while (left > 0 && utf8::isTrailByte(text_[left])) --left;
-    text_.erase(left, cursor_pos_ - left);
+    replaceText(left, cursor_pos_, {});
     cursor_pos_ = left;
     update_foreground_ = true;
     return true;
@@ -198,7 +366,10 @@ bool TextEdit::backspace()
 bool TextEdit::del()
 {
     if (cursor_pos_ == text_.size()) return false;
-    text_.erase(cursor_pos_, utf8::codePointLen(text_.data() + cursor_pos_));
+    replaceText(cursor_pos_,
+        std::min(text_.size(),
+            cursor_pos_ + utf8::codePointLen(text_.data() + cursor_pos_)),
+        {});
     update_foreground_ = true;
     return true;
 }
@@ -1,8 +1,11 @@
 #ifndef TEXT_EDIT_H_
 #define TEXT_EDIT_H_
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <SDL.h>
 
@@ -24,6 +27,8 @@ class TextEdit {
     void blitForeground(SDL_Surface &out, int x, int y) const;
 
     const std::string &text() const { return text_; }
+    // Replaces the text and moves the cursor to its end.
+    void setText(const std::string &text);
     void typeText(const std::string &text);
     void typeText(char c);
     bool backspace();
@@ -46,6 +51,22 @@ class TextEdit {
     void updateBackground();
     void updateForeground() const;
 
+    // Replaces the bytes [begin, end) of the text. Only the new code points
+    // are measured and rendered, the rest of the rendered text is moved.
+    void replaceText(
+        std::size_t begin, std::size_t end, const std::string &text);
+    // Measures and renders the whole text, e.g. after the scale has changed.
+    void layoutAll() const;
+    // Computes `xs_` from the glyph widths.
+    void updateOffsets() const;
+    // The index of the code point that starts at the given byte offset.
+    std::size_t codePointAt(std::size_t byte) const;
+    // Renders the code points [begin, end) into surfaces, one per run
+    // between tabs, and returns them with the index of their first code
+    // point.
+    std::vector<std::pair<std::size_t, SDLSurfaceUniquePtr>> renderRuns(
+        std::size_t begin, std::size_t end) const;
+
     std::string text_;
     std::size_t cursor_pos_ = 0;
     bool focused_ = false;
@@ -57,6 +78,17 @@ class TextEdit {
     mutable int cursor_x_, text_x_ = 0;
     mutable bool update_foreground_ = false;
 
+    // The layout of the text, with the byte offset and x offset of each
+    // code point and of the end. Tabs have no width in `widths_`, as it
+    // depends on their column.
+    mutable bool layout_valid_ = false;
+    mutable std::vector<std::size_t> starts_;
+    mutable std::vector<int> widths_;
+    mutable std::vector<int> xs_;
+    mutable int space_width_;
+    // The whole text, rendered.
+    mutable SDLSurfaceUniquePtr text_surface_;
+
     SDL_Rect foreground_rect_;
 
     int width_, height_;
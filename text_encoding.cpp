@@ -0,0 +1,319 @@
+#include "text_encoding.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "utf8.h"
+
+namespace {
+
+constexpr char32_t kReplacementCharacter = 0xFFFD;
+
+// Windows-1252 code points for 0x80-0x9F. The 5 unassigned bytes map to
+// the C1 controls, as in Latin-1.
+constexpr char16_t kWindows1252[32] = { 0x20AC, 0x0081, 0x201A, 0x0192,
+    0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152,
+    0x008D, 0x017D, 0x008F, 0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022,
+    0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E,
+    0x0178 };
+
+inline unsigned char byteAt(const char *data, std::size_t i)
+{
+    return static_cast<unsigned char>(data[i]);
+}
+
+inline char16_t unitAt(const char *data, std::size_t i, bool big_endian)
+{
+    return big_endian ? (byteAt(data, i) << 8) | byteAt(data, i + 1)
+                      : (byteAt(data, i + 1) << 8) | byteAt(data, i);
+}
+
+// Mostly ASCII text in UTF-16 has a NUL in every other byte. Binary data
+// can have that pattern too, e.g. arrays of small numbers, but then it
+// also has NUL and control code units.
+bool looksUtf16(const char *data, std::size_t size, bool big_endian)
+{
+    const std::size_t units = size / 2;
+    if (units < 2) return false;
+    std::size_t ascii = 0;
+    std::size_t control = 0;
+    for (std::size_t i = 0; i + 1 < size; i += 2) {
+        const char16_t unit = unitAt(data, i, big_endian);
+        if (unit == 0) return false;
+        if (unit < 0x20 && unit != '\t' && unit != '\n' && unit != '\r')
+            ++control;
+        if (unit < 0x80) ++ascii;
+    }
+    return ascii * 10 >= units * 6 && control * 20 <= units;
+}
+
+// Allows an incomplete sequence at the end, where the sample may be cut.
+bool validUtf8(const char *data, std::size_t size)
+{
+    std::size_t i = 0;
+    while (i < size) {
+        const unsigned char c = byteAt(data, i);
+        std::size_t len;
+        if (c < 0x80)
+            len = 1;
+        else if (c >= 0xC2 && c <= 0xDF)
+            len = 2;
+        else if (c >= 0xE0 && c <= 0xEF)
+            len = 3;
+        else if (c >= 0xF0 && c <= 0xF4)
+            len = 4;
+        else
+            return false;
+        for (std::size_t k = 1; k < len; ++k) {
+            if (i + k == size) return true;
+            if ((byteAt(data, i + k) & 0xC0) != 0x80) return false;
+        }
+        i += len;
+    }
+    return true;
+}
+
+#ifdef HAVE_ICONV
+// Japanese text is mostly kana and common kanji, whose lead bytes are
+// 0x81-0x9F. Accented Latin-1 letters can form valid pairs too, but with
+// lead bytes of 0xE0 and above.
+bool looksShiftJis(const char *data, std::size_t size)
+{
+    std::size_t common = 0;
+    std::size_t rare = 0;
+    for (std::size_t i = 0; i < size;) {
+        const unsigned char c = byteAt(data, i);
+        if (c < 0x80 || (c >= 0xA1 && c <= 0xDF)) {
+            ++i;
+            continue;
+        }
+        if (!((c >= 0x81 && c <= 0x9F) || (c >= 0xE0 && c <= 0xFC)))
+            return false;
+        if (i + 1 == size) break;
+        const unsigned char trail = byteAt(data, i + 1);
+        if (trail < 0x40 || trail == 0x7F || trail > 0xFC) return false;
+        if (c <= 0x9F)
+            ++common;
+        else
+            ++rare;
+        i += 2;
+    }
+    return common > 0 && common >= rare;
+}
+#endif
+
+void decodeUtf16(
+    const char *data, std::size_t size, bool big_endian, std::string *out)
+{
+    for (std::size_t i = 0; i + 1 < size; i += 2) {
+        const char16_t unit = unitAt(data, i, big_endian);
+        if (unit < 0xD800 || unit > 0xDFFF) {
+            utf8::appendCodePoint(unit, out);
+            continue;
+        }
+        if (unit <= 0xDBFF) {
+            if (i + 3 >= size) break;
+            const char16_t low = unitAt(data, i + 2, big_endian);
+            if (low >= 0xDC00 && low <= 0xDFFF) {
+                utf8::appendCodePoint(
+                    0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00), out);
+                i += 2;
+                continue;
+            }
+        }
+        utf8::appendCodePoint(kReplacementCharacter, out);
+    }
+}
+
+void decodeWindows1252(const char *data, std::size_t size, std::string *out)
+{
+    for (std::size_t i = 0; i < size; ++i) {
+        const unsigned char c = byteAt(data, i);
+        if (c < 0x80)
+            out->push_back(static_cast<char>(c));
+        else if (c < 0xA0)
+            utf8::appendCodePoint(kWindows1252[c - 0x80], out);
+        else
+            utf8::appendCodePoint(c, out);
+    }
+}
+
+} // namespace
+
+namespace Text_utils {
+
+TextEncoding detectEncoding(const char *p_data, std::size_t p_size)
+{
+    if (bomSize(p_data, p_size, TextEncoding::UTF16LE) != 0)
+        return TextEncoding::UTF16LE;
+    if (bomSize(p_data, p_size, TextEncoding::UTF16BE) != 0)
+        return TextEncoding::UTF16BE;
+    if (bomSize(p_data, p_size, TextEncoding::UTF8) != 0)
+        return TextEncoding::UTF8;
+    if (looksUtf16(p_data, p_size, /*big_endian=*/false))
+        return TextEncoding::UTF16LE;
+    if (looksUtf16(p_data, p_size, /*big_endian=*/true))
+        return TextEncoding::UTF16BE;
+    if (validUtf8(p_data, p_size)) return TextEncoding::UTF8;
+#ifdef HAVE_ICONV
+    if (looksShiftJis(p_data, p_size)) return TextEncoding::SHIFT_JIS;
+#endif
+    return TextEncoding::WINDOWS_1252;
+}
+
+const char *encodingName(TextEncoding p_encoding)
+{
+    switch (p_encoding) {
+        case TextEncoding::UTF8: return "UTF-8";
+        case TextEncoding::UTF16LE: return "UTF-16LE";
+        case TextEncoding::UTF16BE: return "UTF-16BE";
+        case TextEncoding::WINDOWS_1252: return "Windows-1252";
+        case TextEncoding::SHIFT_JIS: return "Shift_JIS";
+    }
+    return "";
+}
+
+std::size_t bomSize(
+    const char *p_data, std::size_t p_size, TextEncoding p_encoding)
+{
+    const char *bom;
+    std::size_t size;
+    switch (p_encoding) {
+        case TextEncoding::UTF8:
+            bom = "\xEF\xBB\xBF";
+            size = 3;
+            break;
+        case TextEncoding::UTF16LE:
+            bom = "\xFF\xFE";
+            size = 2;
+            break;
+        case TextEncoding::UTF16BE:
+            bom = "\xFE\xFF";
+            size = 2;
+            break;
+        default: return 0;
+    }
+    return p_size >= size && std::memcmp(p_data, bom, size) == 0 ? size : 0;
+}
+
+std::size_t newlineBytes(TextEncoding p_encoding)
+{
+    return p_encoding == TextEncoding::UTF16LE
+            || p_encoding == TextEncoding::UTF16BE
+        ? 2
+        : 1;
+}
+
+std::size_t lastNewlineEnd(
+    const char *p_data, std::size_t p_size, TextEncoding p_encoding)
+{
+    if (newlineBytes(p_encoding) == 1) {
+        for (std::size_t i = p_size; i > 0; --i)
+            if (p_data[i - 1] == '\n') return i;
+        return 0;
+    }
+    const bool big_endian = p_encoding == TextEncoding::UTF16BE;
+    for (std::size_t i = p_size & ~static_cast<std::size_t>(1); i >= 2;
+         i -= 2) {
+        if (unitAt(p_data, i - 2, big_endian) == '\n') return i;
+    }
+    return 0;
+}
+
+void fixUtf16LineStarts(const char *p_data, std::size_t p_size,
+    std::uint64_t p_offset, TextEncoding p_encoding,
+    std::vector<std::uint64_t> *p_line_starts, std::size_t p_first)
+{
+    const bool big_endian = p_encoding == TextEncoding::UTF16BE;
+    std::size_t kept = p_first;
+    for (std::size_t k = p_first; k < p_line_starts->size(); ++k) {
+        const std::uint64_t start = (*p_line_starts)[k];
+        // The 0x0A byte is the low byte of the code unit: the first one in
+        // UTF-16LE and the second one in UTF-16BE.
+        const std::uint64_t newline = start - 1;
+        if ((newline % 2 == 1) != big_endian) continue;
+        const std::size_t i = static_cast<std::size_t>(newline - p_offset);
+        // The other byte may be in the next or previous chunk. It is then
+        // assumed to be 0.
+        const std::size_t other = big_endian ? i - 1 : i + 1;
+        if ((big_endian ? i > 0 : other < p_size) && p_data[other] != 0)
+            continue;
+        (*p_line_starts)[kept++] = big_endian ? start : start + 1;
+    }
+    p_line_starts->resize(kept);
+}
+
+} // namespace Text_utils
+
+TextDecoder::TextDecoder(TextEncoding encoding)
+    : encoding_(encoding)
+{
+#ifdef HAVE_ICONV
+    if (encoding_ == TextEncoding::SHIFT_JIS) {
+        // CP932 is the Windows superset of Shift_JIS that most files use.
+        iconv_ = iconv_open("UTF-8", "CP932");
+        if (iconv_ == reinterpret_cast<iconv_t>(-1))
+            iconv_ = iconv_open("UTF-8", "SHIFT_JIS");
+    }
+#endif
+}
+
+TextDecoder::~TextDecoder()
+{
+#ifdef HAVE_ICONV
+    if (iconv_ != reinterpret_cast<iconv_t>(-1)) iconv_close(iconv_);
+#endif
+}
+
+std::string TextDecoder::toUtf8(const char *data, std::size_t size)
+{
+    std::string result;
+    switch (encoding_) {
+        case TextEncoding::UTF8: result.assign(data, size); break;
+        case TextEncoding::UTF16LE:
+        case TextEncoding::UTF16BE:
+            result.reserve(size);
+            decodeUtf16(
+                data, size, encoding_ == TextEncoding::UTF16BE, &result);
+            break;
+        case TextEncoding::WINDOWS_1252:
+            result.reserve(size);
+            decodeWindows1252(data, size, &result);
+            break;
+        case TextEncoding::SHIFT_JIS: {
+#ifdef HAVE_ICONV
+            if (iconv_ == reinterpret_cast<iconv_t>(-1)) {
+                decodeWindows1252(data, size, &result);
+                break;
+            }
+            iconv(iconv_, nullptr, nullptr, nullptr, nullptr);
+            // At most 3 UTF-8 bytes per Shift_JIS byte.
+            result.resize(size * 3);
+            char *in = const_cast<char *>(data);
+            std::size_t in_left = size;
+            char *out = &result[0];
+            std::size_t out_left = result.size();
+            while (in_left > 0) {
+                if (iconv(iconv_, &in, &in_left, &out, &out_left)
+                    != static_cast<std::size_t>(-1))
+                    break;
+                // An incomplete sequence at the end.
+                if (errno != EILSEQ) break;
+                ++in;
+                --in_left;
+                // U+FFFD
+                if (out_left < 3) break;
+                std::memcpy(out, "\xEF\xBF\xBD", 3);
+                out += 3;
+                out_left -= 3;
+            }
+            result.resize(result.size() - out_left);
+#else
+            decodeWindows1252(data, size, &result);
+#endif
+            break;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,74 @@
+#ifndef TEXT_ENCODING_H_
+#define TEXT_ENCODING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_ICONV
+#include <iconv.h>
+#endif
+
+enum class TextEncoding { UTF8, UTF16LE, UTF16BE, WINDOWS_1252, SHIFT_JIS };
+
+namespace Text_utils {
+
+// Guesses the encoding of a file from its first bytes: from the byte order
+// mark if there is one, then from the pattern of NUL bytes for UTF-16, then
+// from which encodings the bytes are valid in. Windows-1252, a superset of
+// the printable Latin-1 range, is the fallback.
+TextEncoding detectEncoding(const char *p_data, std::size_t p_size);
+
+// E.g. "UTF-16LE".
+const char *encodingName(TextEncoding p_encoding);
+
+// The size of the byte order mark at the start of the given bytes, or 0.
+std::size_t bomSize(
+    const char *p_data, std::size_t p_size, TextEncoding p_encoding);
+
+// The size of a newline: 2 in UTF-16, 1 otherwise.
+std::size_t newlineBytes(TextEncoding p_encoding);
+
+// Returns the offset after the last newline in the given bytes, or 0 if
+// there is none. For UTF-16, the bytes must start at an even file offset.
+std::size_t lastNewlineEnd(
+    const char *p_data, std::size_t p_size, TextEncoding p_encoding);
+
+// `findLineStarts` finds the 0x0A bytes, but in UTF-16 only some of them
+// are newlines. Keeps the line starts from `p_first` on that follow a
+// newline, moved past its second byte for UTF-16LE. `p_data` holds the
+// bytes from `p_offset` that the line starts were found in.
+void fixUtf16LineStarts(const char *p_data, std::size_t p_size,
+    std::uint64_t p_offset, TextEncoding p_encoding,
+    std::vector<std::uint64_t> *p_line_starts, std::size_t p_first);
+
+} // namespace Text_utils
+
+/**
+ * @brief Converts text in a given encoding to UTF-8.
+ *
+ * Invalid sequences become U+FFFD, and an incomplete sequence at the end is
+ * dropped, e.g. in a truncated line. Shift_JIS is converted with iconv
+ * (HAVE_ICONV), and is never detected without it.
+ */
+class TextDecoder {
+  public:
+    explicit TextDecoder(TextEncoding encoding);
+    ~TextDecoder();
+
+    TextDecoder(const TextDecoder &) = delete;
+    TextDecoder &operator=(const TextDecoder &) = delete;
+
+    TextEncoding encoding() const { return encoding_; }
+
+    std::string toUtf8(const char *data, std::size_t size);
+
+  private:
+    TextEncoding encoding_;
+#ifdef HAVE_ICONV
+    iconv_t iconv_ = reinterpret_cast<iconv_t>(-1);
+#endif
+};
+
+#endif // TEXT_ENCODING_H_
@@ -0,0 +1,384 @@
+#include "text_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+
+#include "text_scan.h"
+#include "utf8.h"
+
+constexpr std::size_t TextFile::kMaxLineBytes;
+
+namespace {
+
+// Indexed synchronously, so that the first page can be shown right away.
+constexpr std::size_t kInitialIndexBytes = 64 * 1024;
+
+// The encoding is detected from this many bytes at the start of the file.
+constexpr std::size_t kEncodingSniffBytes = 4096;
+
+// The background indexer publishes its results in chunks of this size.
+constexpr std::size_t kIndexChunkBytes = 1024 * 1024;
+
+// How often a followed file is checked for replacement, and for changes if
+// inotify is not available.
+constexpr int kFollowPollMs = 250;
+
+} // namespace
+
+std::unique_ptr<TextFile> TextFile::open(const std::string &path)
+{
+    std::unique_ptr<TextFile> file { new TextFile(path) };
+    if (!file->openFile()) return nullptr;
+    file->startIndexing();
+    return file;
+}
+
+TextFile::~TextFile()
+{
+    stop_ = true;
+    if (indexer_.joinable()) indexer_.join();
+    closeFile();
+}
+
+bool TextFile::openFile()
+{
+    fd_ = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ == -1) return false;
+    struct stat st;
+    int error = 0;
+    if (fstat(fd_, &st) == -1)
+        error = errno;
+    else if (S_ISDIR(st.st_mode))
+        error = EISDIR;
+    if (error != 0) {
+        closeFile();
+        errno = error;
+        return false;
+    }
+    size_ = S_ISREG(st.st_mode) ? st.st_size : 0;
+
+    const CompressedFile::Format format = S_ISREG(st.st_mode)
+        ? CompressedFile::detect(fd_)
+        : CompressedFile::Format::NONE;
+    if (format != CompressedFile::Format::NONE) {
+        compressed_ = CompressedFile::open(fd_, format);
+        if (compressed_ == nullptr) {
+            closeFile();
+            errno = ENOMEM;
+            return false;
+        }
+        // Offsets are in the decompressed data, which is never mapped.
+        follow_ = false;
+        return true;
+    }
+
+    // Mapping may fail, e.g. for files larger than the address space on
+    // 32-bit systems. Such files are read with `pread` instead.
+    // A followed file may be truncated, and reading a truncated mapping
+    // would crash, so it is always read with `pread`.
+    if (!follow_ && size_ > 0 && size_ <= SIZE_MAX) {
+        void *data = mmap(nullptr, static_cast<std::size_t>(size_), PROT_READ,
+            MAP_PRIVATE, fd_, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, static_cast<std::size_t>(size_), MADV_SEQUENTIAL);
+            data_ = static_cast<const char *>(data);
+        }
+    }
+    return true;
+}
+
+void TextFile::closeFile()
+{
+    compressed_ = nullptr;
+    if (data_ != nullptr)
+        munmap(const_cast<char *>(data_), static_cast<std::size_t>(size_));
+    data_ = nullptr;
+    if (fd_ != -1) ::close(fd_);
+    fd_ = -1;
+}
+
+void TextFile::startIndexing()
+{
+    line_starts_.assign(1, 0);
+    std::vector<char> buffer;
+    const char *initial = data_;
+    std::size_t len;
+    bool at_end;
+    if (initial != nullptr) {
+        len = static_cast<std::size_t>(
+            std::min<std::uint64_t>(size_, kInitialIndexBytes));
+        at_end = (len == size_);
+    } else {
+        buffer.resize(kInitialIndexBytes);
+        len = compressed_ != nullptr
+            ? compressed_->readNext(buffer.data(), buffer.size())
+            : read(0, buffer.size(), buffer.data());
+        initial = buffer.data();
+        at_end = (len < buffer.size());
+    }
+    encoding_ = Text_utils::detectEncoding(
+        initial, std::min(len, kEncodingSniffBytes));
+    decoder_.reset(encoding_ != TextEncoding::UTF8
+            ? new TextDecoder(encoding_)
+            : nullptr);
+    findLineStarts(initial, len, 0, &line_starts_);
+    indexed_ = len;
+    indexing_ = !at_end;
+    if (indexing_ || follow_) startIndexer();
+}
+
+void TextFile::startIndexer()
+{
+    stop_ = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_line_starts_.clear();
+        pending_indexed_ = indexed_;
+        pending_done_ = pending_reopen_ = false;
+    }
+    indexer_ = std::thread(&TextFile::index, this, indexed_, follow_);
+}
+
+void TextFile::stopIndexer()
+{
+    if (!indexer_.joinable()) return;
+    stop_ = true;
+    indexer_.join();
+    bool done, reopen;
+    takePending(&done, &reopen);
+    // A pending reopen is detected again when following resumes.
+    if (done) indexing_ = false;
+}
+
+void TextFile::takePending(bool *done, bool *reopen)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    line_starts_.insert(line_starts_.end(), pending_line_starts_.begin(),
+        pending_line_starts_.end());
+    pending_line_starts_.clear();
+    indexed_ = pending_indexed_;
+    *done = pending_done_;
+    *reopen = pending_reopen_;
+}
+
+void TextFile::setFollow(bool follow)
+{
+    if (follow == follow_ || compressed_ != nullptr) return;
+    stopIndexer();
+    follow_ = follow;
+    if (follow_ && data_ != nullptr) {
+        munmap(const_cast<char *>(data_), static_cast<std::size_t>(size_));
+        data_ = nullptr;
+    }
+    if (indexing_ || follow_) startIndexer();
+}
+
+void TextFile::index(std::uint64_t offset, bool follow)
+{
+    int inotify_fd = -1;
+#if defined(__linux__)
+    if (follow) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd != -1
+            && inotify_add_watch(inotify_fd, path_.c_str(),
+                   IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+                == -1) {
+            ::close(inotify_fd);
+            inotify_fd = -1;
+        }
+    }
+#endif
+
+    std::vector<char> buffer;
+    std::vector<std::uint64_t> line_starts;
+    bool reopen = false;
+    bool replaced = false;
+    while (!stop_) {
+        const char *chunk;
+        std::size_t len;
+        if (data_ != nullptr && offset < size_) {
+            len = static_cast<std::size_t>(
+                std::min<std::uint64_t>(size_ - offset, kIndexChunkBytes));
+            chunk = data_ + offset;
+        } else {
+            buffer.resize(kIndexChunkBytes);
+            // Compressed data can only be indexed as it is decompressed.
+            len = compressed_ != nullptr
+                ? compressed_->readNext(buffer.data(), buffer.size())
+                : read(offset, buffer.size(), buffer.data());
+            chunk = buffer.data();
+        }
+        if (len > 0) {
+            line_starts.clear();
+            findLineStarts(chunk, len, offset, &line_starts);
+            offset += len;
+            publish(line_starts, offset);
+            continue;
+        }
+        if (!follow) break;
+        // As `tail -F` does, read what was appended to the old file after
+        // the last read before reopening.
+        if (replaced) {
+            reopen = true;
+            break;
+        }
+        replaced = !waitForChange(inotify_fd, offset);
+    }
+    if (inotify_fd != -1) ::close(inotify_fd);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (reopen)
+        pending_reopen_ = true;
+    else if (!stop_)
+        pending_done_ = true;
+}
+
+void TextFile::findLineStarts(const char *data, std::size_t size,
+    std::uint64_t offset, std::vector<std::uint64_t> *line_starts) const
+{
+    const std::size_t first = line_starts->size();
+    Text_utils::findLineStarts(data, size, offset, line_starts);
+    if (Text_utils::newlineBytes(encoding_) == 2) {
+        Text_utils::fixUtf16LineStarts(
+            data, size, offset, encoding_, line_starts, first);
+    }
+}
+
+bool TextFile::waitForChange(int inotify_fd, std::uint64_t offset)
+{
+    if (inotify_fd != -1) {
+        struct pollfd pfd = { inotify_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, kFollowPollMs) > 0) {
+            // Only the fact that something happened matters.
+            char events[4096];
+            while (::read(inotify_fd, events, sizeof(events)) > 0) { }
+        }
+    } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(kFollowPollMs));
+    }
+    struct stat st;
+    if (fstat(fd_, &st) == -1) return true;
+    if (S_ISREG(st.st_mode) && static_cast<std::uint64_t>(st.st_size) < offset)
+        return false;
+    // Replaced, e.g. by log rotation. While there is nothing at the path,
+    // keep following the old file.
+    struct stat path_st;
+    return stat(path_.c_str(), &path_st) == -1
+        || (path_st.st_ino == st.st_ino && path_st.st_dev == st.st_dev);
+}
+
+void TextFile::publish(
+    const std::vector<std::uint64_t> &line_starts, std::uint64_t indexed)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_line_starts_.insert(
+        pending_line_starts_.end(), line_starts.begin(), line_starts.end());
+    pending_indexed_ = indexed;
+}
+
+bool TextFile::collectLines()
+{
+    if (!indexer_.joinable()) return false;
+    const std::size_t old_num_lines = numLines();
+    const std::uint64_t old_indexed = indexed_;
+    bool done, reopen;
+    takePending(&done, &reopen);
+    if (done) {
+        indexer_.join();
+        indexing_ = false;
+        line_starts_.shrink_to_fit();
+    }
+    if (reopen) {
+        indexer_.join();
+        closeFile();
+        if (openFile()) {
+            startIndexing();
+        } else {
+            line_starts_.assign(1, 0);
+            indexed_ = 0;
+            indexing_ = false;
+        }
+        return true;
+    }
+    return numLines() != old_num_lines || indexed_ != old_indexed;
+}
+
+void TextFile::waitForIndex()
+{
+    setFollow(false);
+    if (!indexer_.joinable()) return;
+    // Without following, the indexer stops at the end of the file.
+    indexer_.join();
+    bool done, reopen;
+    takePending(&done, &reopen);
+    indexing_ = false;
+}
+
+std::size_t TextFile::numLines() const
+{
+    // A final line terminator does not start a new line.
+    if (line_starts_.size() > 1 && line_starts_.back() == indexed_)
+        return line_starts_.size() - 1;
+    return line_starts_.size();
+}
+
+std::uint64_t TextFile::lineOffset(std::size_t index) const
+{
+    return index < line_starts_.size() ? line_starts_[index] : indexed_;
+}
+
+std::size_t TextFile::read(
+    std::uint64_t offset, std::size_t len, char *out) const
+{
+    if (compressed_ != nullptr) return compressed_->read(offset, len, out);
+    std::size_t total = 0;
+    if (data_ != nullptr && offset < size_) {
+        total = static_cast<std::size_t>(
+            std::min<std::uint64_t>(len, size_ - offset));
+        std::copy(data_ + offset, data_ + offset + total, out);
+    }
+    while (total < len) {
+        const ssize_t n = pread(fd_, out + total, len - total,
+            static_cast<off_t>(offset + total));
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        total += static_cast<std::size_t>(n);
+    }
+    return total;
+}
+
+std::string TextFile::line(std::size_t index, std::size_t max_bytes) const
+{
+    std::string result;
+    if (index >= numLines()) return result;
+    const std::uint64_t start = line_starts_[index];
+    std::uint64_t end = index + 1 < line_starts_.size()
+        ? line_starts_[index + 1] - Text_utils::newlineBytes(encoding_)
+        : indexed_;
+    // The second byte of a UTF-16LE newline may not be indexed yet.
+    end = std::max(end, start);
+    const bool truncated = end - start > max_bytes;
+    if (truncated) end = start + max_bytes;
+    result.resize(static_cast<std::size_t>(end - start));
+    result.resize(read(start, result.size(), &result[0]));
+    if (decoder_ != nullptr) {
+        // Only the lines that are read are converted.
+        result = decoder_->toUtf8(result.data(), result.size());
+    } else if (truncated) {
+        // Do not leave a partial code point at the end.
+        utf8::removePartialCodePoint(&result);
+    }
+    if (!result.empty() && result.back() == '\r') result.pop_back();
+    if (index == 0) utf8::removeBom(&result);
+    return result;
+}
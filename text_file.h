@@ -0,0 +1,148 @@
+#ifndef TEXT_FILE_H_
+#define TEXT_FILE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "compressed_file.h"
+#include "text_encoding.h"
+
+/**
+ * @brief A read-only text file, accessed by line.
+ *
+ * The file is memory-mapped (or read with `pread` if it cannot be mapped),
+ * so only the lines that are read are resident. The line offsets are
+ * indexed on a background thread, and the lines become available as the
+ * index grows.
+ *
+ * In follow mode, the file keeps being watched for appended data, like
+ * `tail -f`. Only the new bytes are indexed. If the file is truncated or
+ * replaced (e.g. by log rotation), it is reopened and indexed from the
+ * start.
+ *
+ * The encoding is detected from the first bytes, and lines in other
+ * encodings than UTF-8 are converted as they are read.
+ *
+ * gzip, xz and zstd files are decompressed as they are indexed, and lines
+ * are then read through `CompressedFile`. They cannot be followed.
+ */
+class TextFile {
+  public:
+    // Lines are truncated to this many bytes by default.
+    static constexpr std::size_t kMaxLineBytes = 64 * 1024;
+
+    // Returns nullptr and sets `errno` if the file cannot be opened.
+    // The first lines are indexed before this returns.
+    static std::unique_ptr<TextFile> open(const std::string &path);
+
+    ~TextFile();
+
+    TextFile(const TextFile &) = delete;
+    TextFile &operator=(const TextFile &) = delete;
+
+    // The number of lines indexed so far. At least 1, even if the file is
+    // empty. The last line may be incomplete while indexing or following.
+    std::size_t numLines() const;
+
+    bool indexing() const { return indexing_; }
+
+    // Size of the file when it was opened.
+    std::uint64_t size() const { return size_; }
+
+    // Picks up the lines indexed in the background.
+    // Returns true if the lines have changed.
+    bool collectLines();
+
+    // Blocks until the whole file is indexed. Stops following.
+    void waitForIndex();
+
+    void setFollow(bool follow);
+    bool following() const { return follow_; }
+
+    bool compressed() const { return compressed_ != nullptr; }
+
+    TextEncoding encoding() const { return encoding_; }
+
+    // Returns the line in UTF-8, without its line terminator or the byte
+    // order mark, truncated to `max_bytes` of the file.
+    std::string line(
+        std::size_t index, std::size_t max_bytes = kMaxLineBytes) const;
+
+    // The offset of the start of the line, or of the end of the indexed
+    // bytes for `numLines()`.
+    std::uint64_t lineOffset(std::size_t index) const;
+
+    // Reads up to `len` bytes at `offset`, from the mapping if possible.
+    std::size_t read(std::uint64_t offset, std::size_t len, char *out) const;
+
+  private:
+    explicit TextFile(std::string path)
+        : path_(std::move(path))
+    {
+    }
+
+    // Opens and maps `path_`. Returns false and sets `errno` on failure.
+    bool openFile();
+    void closeFile();
+
+    // Indexes the first bytes synchronously, then starts the indexer if
+    // there is more to index.
+    void startIndexing();
+
+    void startIndexer();
+    void stopIndexer();
+
+    // Runs on `indexer_`.
+    void index(std::uint64_t offset, bool follow);
+
+    // Appends the starts of the lines that follow the newlines in the
+    // given bytes, which are at `offset` in the file.
+    void findLineStarts(const char *data, std::size_t size,
+        std::uint64_t offset, std::vector<std::uint64_t> *line_starts) const;
+
+    // Waits for the file to change. Runs on `indexer_`.
+    // Returns false if the file has been truncated or replaced.
+    bool waitForChange(int inotify_fd, std::uint64_t offset);
+
+    void publish(const std::vector<std::uint64_t> &line_starts,
+        std::uint64_t indexed);
+
+    // Moves the results of `indexer_` to the main thread.
+    void takePending(bool *done, bool *reopen);
+
+    std::string path_;
+    int fd_ = -1;
+    std::uint64_t size_ = 0;
+    // Null if the file is not mapped. Maps the first `size_` bytes.
+    const char *data_ = nullptr;
+    // Set if the file is compressed.
+    std::unique_ptr<CompressedFile> compressed_;
+    TextEncoding encoding_ = TextEncoding::UTF8;
+    // Set if the encoding is not UTF-8.
+    std::unique_ptr<TextDecoder> decoder_;
+
+    // Offsets of the line starts, the first one being 0.
+    std::vector<std::uint64_t> line_starts_;
+    // The number of bytes indexed so far.
+    std::uint64_t indexed_ = 0;
+    bool indexing_ = false;
+    bool follow_ = false;
+
+    // Results from `indexer_`, guarded by `mutex_`.
+    std::mutex mutex_;
+    std::vector<std::uint64_t> pending_line_starts_;
+    std::uint64_t pending_indexed_ = 0;
+    bool pending_done_ = false;
+    bool pending_reopen_ = false;
+
+    std::atomic<bool> stop_ { false };
+    std::thread indexer_;
+};
+
+#endif // TEXT_FILE_H_
@@ -0,0 +1,248 @@
+#include "text_line_cache.h"
+
+#include <algorithm>
+
+#include "sdlutils.h"
+#include "utf8.h"
+
+namespace {
+
+bool operator!=(const SDL_Color &a, const SDL_Color &b)
+{
+    return a.r != b.r || a.g != b.g || a.b != b.b;
+}
+
+bool operator!=(const TextLineCache::Span &a, const TextLineCache::Span &b)
+{
+    return a.begin != b.begin || a.end != b.end || a.fg != b.fg;
+}
+
+bool operator!=(const std::vector<TextLineCache::Span> &a,
+    const std::vector<TextLineCache::Span> &b)
+{
+    if (a.size() != b.size()) return true;
+    for (std::size_t i = 0; i < a.size(); ++i)
+        if (a[i] != b[i]) return true;
+    return false;
+}
+
+} // namespace
+
+void TextLineCache::clear()
+{
+    lines_.clear();
+    glyph_widths_.clear();
+}
+
+void TextLineCache::draw(const Key &key, const std::string &text,
+    SDL_Color fg, SDL_Color bg, int scroll_x, int width, int x, int y,
+    SDL_Surface *dst)
+{
+    draw(key, text, fg, bg, {}, scroll_x, width, x, y, dst);
+}
+
+void TextLineCache::draw(const Key &key, const std::string &text,
+    SDL_Color fg, SDL_Color bg, const std::vector<Span> &spans, int scroll_x,
+    int width, int x, int y, SDL_Surface *dst)
+{
+    Line &line = lines_[key];
+    line.used = true;
+    if (line.xs.empty() || line.text != text) {
+        line.text = text;
+        layout(&line);
+        line.surface = nullptr;
+    }
+    if (line.surface != nullptr
+        && (line.fg != fg || line.bg != bg || line.spans != spans))
+        line.surface = nullptr;
+    line.fg = fg;
+    line.bg = bg;
+    if (line.surface == nullptr) line.spans = spans;
+    if (line.xs.back() <= scroll_x) return;
+
+    const int view_end = scroll_x + width;
+    if (line.surface == nullptr || line.surface_x > scroll_x
+        || (line.surface_x + line.surface->w < view_end
+            && !line.surface_to_end)) {
+        // Half a viewport on each side, so that scrolling by small steps
+        // reuses the surface.
+        render(&line, scroll_x - width / 2, view_end + width / 2);
+        if (line.surface == nullptr) return;
+    }
+    const int src_x = scroll_x - line.surface_x;
+    const int w = std::min(width, line.surface->w - src_x);
+    if (w <= 0) return;
+    SDL_Rect clip = SDL_utils::makeRect(src_x, 0, w, line.surface->h);
+    SDL_utils::applyPpuScaledSurface(x, y, line.surface.get(), dst, &clip);
+}
+
+int TextLineCache::xAt(const Key &key, std::size_t byte) const
+{
+    const auto it = lines_.find(key);
+    if (it == lines_.end() || it->second.xs.empty()) return 0;
+    const Line &line = it->second;
+    const std::size_t k
+        = std::lower_bound(line.starts.begin(), line.starts.end(), byte)
+        - line.starts.begin();
+    return k < line.xs.size() ? line.xs[k] : line.xs.back();
+}
+
+std::vector<std::size_t> TextLineCache::wrap(
+    const std::string &text, int width)
+{
+    std::vector<std::size_t> starts { 0 };
+    int x = 0;
+    // The byte offset after the last space in the current row, and the x
+    // offset at that point.
+    std::size_t space_end = 0;
+    int space_end_x = 0;
+    std::uint32_t prev_code_point = 0;
+    for (std::size_t i = 0; i < text.size();) {
+        const std::size_t len = std::min(
+            utf8::codePointLen(text.data() + i), text.size() - i);
+        const std::uint32_t code_point
+            = utf8::decodeCodePoint(text.data() + i, len);
+        const int w = glyphWidth(text.data() + i, len);
+        const int kerning = i > starts.back()
+            ? fonts_.GetKerning(prev_code_point, code_point)
+            : 0;
+        prev_code_point = code_point;
+        // Spaces can hang past the end of the row.
+        if (x + kerning + w > width && i > starts.back() && text[i] != ' ') {
+            if (space_end > starts.back()) {
+                starts.push_back(space_end);
+                x -= space_end_x;
+            } else {
+                starts.push_back(i);
+                x = 0;
+            }
+        }
+        if (i > starts.back()) x += kerning;
+        x += w;
+        i += len;
+        if (text[i - len] == ' ') {
+            space_end = i;
+            space_end_x = x;
+        }
+    }
+    return starts;
+}
+
+void TextLineCache::endFrame()
+{
+    for (auto it = lines_.begin(); it != lines_.end();) {
+        if (it->second.used) {
+            it->second.used = false;
+            ++it;
+        } else {
+            it = lines_.erase(it);
+        }
+    }
+}
+
+void TextLineCache::layout(Line *line)
+{
+    const std::string &text = line->text;
+    line->starts.clear();
+    line->xs.clear();
+    int x = 0;
+    std::uint32_t prev_code_point = 0;
+    for (std::size_t i = 0; i < text.size();) {
+        const std::size_t len = std::min(
+            utf8::codePointLen(text.data() + i), text.size() - i);
+        const std::uint32_t code_point
+            = utf8::decodeCodePoint(text.data() + i, len);
+        // Kerned as when rendered.
+        if (i > 0) x += fonts_.GetKerning(prev_code_point, code_point);
+        line->starts.push_back(i);
+        line->xs.push_back(x);
+        x += glyphWidth(text.data() + i, len);
+        prev_code_point = code_point;
+        i += len;
+    }
+    line->starts.push_back(text.size());
+    line->xs.push_back(x);
+}
+
+void TextLineCache::render(Line *line, int from, int to) const
+{
+    line->surface = nullptr;
+    const std::size_t n = line->xs.size() - 1;
+    if (n == 0) return;
+    // The last code point that starts at or before `from`.
+    std::size_t begin = std::upper_bound(line->xs.begin(),
+                            line->xs.begin() + n, std::max(0, from))
+        - line->xs.begin();
+    if (begin > 0) --begin;
+    // The first code point that starts at or after `to`.
+    std::size_t end
+        = std::lower_bound(line->xs.begin() + begin + 1, line->xs.end(), to)
+        - line->xs.begin();
+    end = std::min(end, n);
+    if (!line->spans.empty()) {
+        line->surface
+            = SDLSurfaceUniquePtr { renderSpans(*line, begin, end) };
+    } else {
+        line->surface = SDLSurfaceUniquePtr { SDL_utils::renderText(fonts_,
+            line->text.substr(line->starts[begin],
+                line->starts[end] - line->starts[begin]),
+            line->fg, line->bg) };
+    }
+    line->surface_x = line->xs[begin];
+    line->surface_to_end = end == n;
+}
+
+SDL_Surface *TextLineCache::renderSpans(
+    const Line &line, std::size_t begin, std::size_t end) const
+{
+    // Runs of code points of one color, each rendered where the layout
+    // puts it.
+    std::vector<std::pair<std::size_t, SDL_Color>> runs;
+    auto span = line.spans.begin();
+    for (std::size_t k = begin; k < end; ++k) {
+        const std::size_t byte = line.starts[k];
+        while (span != line.spans.end() && span->end <= byte) ++span;
+        const SDL_Color fg = span != line.spans.end() && span->begin <= byte
+            ? span->fg
+            : line.fg;
+        if (runs.empty() || runs.back().second != fg) runs.emplace_back(k, fg);
+    }
+    std::vector<SDLSurfaceUniquePtr> surfaces;
+    int height = 0;
+    for (std::size_t r = 0; r < runs.size(); ++r) {
+        const std::size_t run_end
+            = r + 1 < runs.size() ? runs[r + 1].first : end;
+        const std::size_t from = line.starts[runs[r].first];
+        surfaces.emplace_back(SDL_utils::renderText(fonts_,
+            line.text.substr(from, line.starts[run_end] - from),
+            runs[r].second, line.bg));
+        if (surfaces.back() != nullptr)
+            height = std::max(height, surfaces.back()->h);
+    }
+    const int width = line.xs[end] - line.xs[begin];
+    if (width <= 0 || height == 0) return nullptr;
+    SDL_Surface *result = SDL_utils::createSurface(width, height);
+    if (result == nullptr) return nullptr;
+    SDL_FillRect(result, nullptr,
+        SDL_MapRGB(result->format, line.bg.r, line.bg.g, line.bg.b));
+    for (std::size_t r = 0; r < runs.size(); ++r) {
+        if (surfaces[r] == nullptr) continue;
+        SDL_Rect dst = SDL_utils::makeRect(
+            line.xs[runs[r].first] - line.xs[begin], 0, 0, 0);
+        SDL_BlitSurface(surfaces[r].get(), nullptr, result, &dst);
+    }
+    return result;
+}
+
+int TextLineCache::glyphWidth(const char *data, std::size_t len)
+{
+    std::uint32_t key = 0;
+    for (std::size_t i = 0; i < len; ++i)
+        key = (key << 8) | static_cast<unsigned char>(data[i]);
+    const auto it = glyph_widths_.find(key);
+    if (it != glyph_widths_.end()) return it->second;
+    // Only the advance, as the kerning is added by the layout.
+    const int width = fonts_.GetAdvance(utf8::decodeCodePoint(data, len));
+    glyph_widths_.emplace(key, width);
+    return width;
+}
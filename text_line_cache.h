@@ -0,0 +1,109 @@
+#ifndef TEXT_LINE_CACHE_H_
+#define TEXT_LINE_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <SDL.h>
+
+#include "sdl_ptrs.h"
+#include "sdl_ttf_multifont.h"
+
+/**
+ * @brief Draws lines of text into a horizontally scrolled viewport, keeping
+ * what it renders for the next frames.
+ *
+ * Each line is laid out once, measuring the position of each code point
+ * from cached glyph advances and the kerning that rendering applies. Only
+ * the part of a line around the viewport is rendered, and it is reused as
+ * long as the viewport stays within it, so scrolling a long line does not
+ * render it in full on every step.
+ *
+ * The lines are cached by key, with their text and colors. Lines that are
+ * not drawn in a frame are dropped at the end of the frame. Lines with
+ * colored spans are rendered one span at a time into the cached surface,
+ * so they cost no more to draw than plain lines once rendered.
+ */
+class TextLineCache {
+  public:
+    // A line index and a wrapped row within that line.
+    using Key = std::pair<std::size_t, std::size_t>;
+
+    // Text drawn in another color than the line's, by byte offsets.
+    struct Span {
+        std::size_t begin, end;
+        SDL_Color fg;
+    };
+
+    explicit TextLineCache(const Fonts &fonts)
+        : fonts_(fonts)
+    {
+    }
+
+    TextLineCache(const TextLineCache &) = delete;
+    TextLineCache &operator=(const TextLineCache &) = delete;
+
+    // Drops everything, e.g. after the scale has changed.
+    void clear();
+
+    // Draws the part of the line that is within [scroll_x, scroll_x + width)
+    // at (x, y) on `dst`. `text` must not contain tabs.
+    void draw(const Key &key, const std::string &text, SDL_Color fg,
+        SDL_Color bg, int scroll_x, int width, int x, int y, SDL_Surface *dst);
+    // As above, with the given spans, sorted and not overlapping.
+    void draw(const Key &key, const std::string &text, SDL_Color fg,
+        SDL_Color bg, const std::vector<Span> &spans, int scroll_x, int width,
+        int x, int y, SDL_Surface *dst);
+
+    // The x offset within the line of the given byte offset of its text.
+    // The line must have been drawn in this frame.
+    int xAt(const Key &key, std::size_t byte) const;
+
+    // Returns the byte offsets at which the rows of `text` start when it is
+    // wrapped to `width`, the first one being 0. Rows are broken after the
+    // last space that fits, or between code points within long words.
+    // `text` must not contain tabs.
+    std::vector<std::size_t> wrap(const std::string &text, int width);
+
+    // Drops the lines that have not been drawn since the last call.
+    void endFrame();
+
+  private:
+    struct Line {
+        std::string text;
+        // Byte offset and x offset of each code point, and of the end.
+        std::vector<std::size_t> starts;
+        std::vector<int> xs;
+
+        SDL_Color fg, bg;
+        std::vector<Span> spans;
+        // The rendered part of the line, starting at `surface_x`.
+        SDLSurfaceUniquePtr surface;
+        int surface_x;
+        bool surface_to_end;
+
+        bool used;
+    };
+
+    void layout(Line *line);
+
+    // Renders the code points that intersect [from, to).
+    void render(Line *line, int from, int to) const;
+    // Renders the code points [begin, end) of a line that has spans.
+    SDL_Surface *renderSpans(
+        const Line &line, std::size_t begin, std::size_t end) const;
+
+    int glyphWidth(const char *data, std::size_t len);
+
+    const Fonts &fonts_;
+    std::map<Key, Line> lines_;
+    // By the bytes of the code point.
+    std::unordered_map<std::uint32_t, int> glyph_widths_;
+};
+
+#endif // TEXT_LINE_CACHE_H_
@@ -0,0 +1,181 @@
+#include "text_scan.h"
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define TEXT_SCAN_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TEXT_SCAN_NEON
+#endif
+
+namespace Text_utils {
+
+void findLineStarts(const char *p_data, std::size_t p_size,
+    std::uint64_t p_offset, std::vector<std::uint64_t> *p_line_starts)
+{
+    std::size_t i = 0;
+#if defined(TEXT_SCAN_SSE2)
+    // Short lines are common, so a whole block of newlines is handled at
+    // once rather than with a `memchr` call per line.
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= p_size; i += 16) {
+        const __m128i v
+            = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p_data + i));
+        unsigned mask = static_cast<unsigned>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)));
+        while (mask != 0) {
+            p_line_starts->push_back(p_offset + i + __builtin_ctz(mask) + 1);
+            mask &= mask - 1;
+        }
+    }
+#elif defined(TEXT_SCAN_NEON)
+    const uint8x16_t newline = vdupq_n_u8('\n');
+    for (; i + 16 <= p_size; i += 16) {
+        const uint8x16_t eq = vceqq_u8(
+            vld1q_u8(reinterpret_cast<const std::uint8_t *>(p_data + i)),
+            newline);
+        const uint8x8_t any = vorr_u8(vget_low_u8(eq), vget_high_u8(eq));
+        if (vget_lane_u64(vreinterpret_u64_u8(any), 0) == 0) continue;
+        for (std::size_t j = i; j < i + 16; ++j)
+            if (p_data[j] == '\n') p_line_starts->push_back(p_offset + j + 1);
+    }
+#endif
+    while (i < p_size) {
+        const void *newline = std::memchr(p_data + i, '\n', p_size - i);
+        if (newline == nullptr) break;
+        i = static_cast<const char *>(newline) - p_data + 1;
+        p_line_starts->push_back(p_offset + i);
+    }
+}
+
+std::size_t countNewlines(const char *p_data, std::size_t p_size)
+{
+    std::size_t count = 0;
+    std::size_t i = 0;
+#if defined(TEXT_SCAN_SSE2)
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= p_size; i += 16) {
+        const __m128i v
+            = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p_data + i));
+        count += __builtin_popcount(static_cast<unsigned>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(v, newline))));
+    }
+#elif defined(TEXT_SCAN_NEON)
+    const uint8x16_t newline = vdupq_n_u8('\n');
+    for (; i + 16 <= p_size; i += 16) {
+        // Each match is 0xFF, i.e. -1 as a signed byte.
+        const int8x16_t eq = vreinterpretq_s8_u8(vceqq_u8(
+            vld1q_u8(reinterpret_cast<const std::uint8_t *>(p_data + i)),
+            newline));
+        const int16x8_t sums = vpaddlq_s8(eq);
+        const int32x4_t sums32 = vpaddlq_s16(sums);
+        const int64x2_t sums64 = vpaddlq_s32(sums32);
+        count -= vgetq_lane_s64(sums64, 0) + vgetq_lane_s64(sums64, 1);
+    }
+#endif
+    for (; i < p_size; ++i) count += (p_data[i] == '\n');
+    return count;
+}
+
+namespace {
+
+inline char lowerAscii(char c)
+{
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+inline bool isAsciiLetter(char c)
+{
+    return lowerAscii(c) >= 'a' && lowerAscii(c) <= 'z';
+}
+
+bool equalsCaseInsensitive(const char *p_data, const char *p_lower, std::size_t p_size)
+{
+    for (std::size_t i = 0; i < p_size; ++i)
+        if (lowerAscii(p_data[i]) != p_lower[i]) return false;
+    return true;
+}
+
+} // namespace
+
+std::size_t findCaseInsensitive(const char *p_data, std::size_t p_size,
+    const std::string &p_needle)
+{
+    const std::size_t n = p_needle.size();
+    if (n > p_size) return p_size;
+    const char first = p_needle.front();
+    const char last = p_needle.back();
+    std::size_t i = 0;
+#if defined(TEXT_SCAN_SSE2)
+    // Candidates are the positions where both the first and the last byte
+    // of the needle match, which filters out most of them for any text.
+    // Setting bit 5 folds ASCII letters to lowercase.
+    const __m128i first_v = _mm_set1_epi8(first);
+    const __m128i last_v = _mm_set1_epi8(last);
+    const __m128i first_fold = _mm_set1_epi8(isAsciiLetter(first) ? 0x20 : 0);
+    const __m128i last_fold = _mm_set1_epi8(isAsciiLetter(last) ? 0x20 : 0);
+    for (; i + n - 1 + 16 <= p_size; i += 16) {
+        const __m128i a = _mm_or_si128(first_fold,
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(p_data + i)));
+        const __m128i b = _mm_or_si128(last_fold,
+            _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(p_data + i + n - 1)));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(a, first_v), _mm_cmpeq_epi8(b, last_v))));
+        while (mask != 0) {
+            const std::size_t j = i + __builtin_ctz(mask);
+            if (equalsCaseInsensitive(p_data + j, p_needle.data(), n)) return j;
+            mask &= mask - 1;
+        }
+    }
+#elif defined(TEXT_SCAN_NEON)
+    const uint8x16_t first_v = vdupq_n_u8(static_cast<std::uint8_t>(first));
+    const uint8x16_t last_v = vdupq_n_u8(static_cast<std::uint8_t>(last));
+    const uint8x16_t first_fold = vdupq_n_u8(isAsciiLetter(first) ? 0x20 : 0);
+    const uint8x16_t last_fold = vdupq_n_u8(isAsciiLetter(last) ? 0x20 : 0);
+    for (; i + n - 1 + 16 <= p_size; i += 16) {
+        const uint8x16_t a = vorrq_u8(first_fold,
+            vld1q_u8(reinterpret_cast<const std::uint8_t *>(p_data + i)));
+        const uint8x16_t b = vorrq_u8(last_fold,
+            vld1q_u8(reinterpret_cast<const std::uint8_t *>(p_data + i + n - 1)));
+        const uint8x16_t eq
+            = vandq_u8(vceqq_u8(a, first_v), vceqq_u8(b, last_v));
+        const uint8x8_t any = vorr_u8(vget_low_u8(eq), vget_high_u8(eq));
+        if (vget_lane_u64(vreinterpret_u64_u8(any), 0) == 0) continue;
+        for (std::size_t j = i; j < i + 16; ++j) {
+            if (equalsCaseInsensitive(p_data + j, p_needle.data(), n)) return j;
+        }
+    }
+#endif
+    for (; i + n <= p_size; ++i) {
+        if (lowerAscii(p_data[i]) == first
+            && equalsCaseInsensitive(p_data + i, p_needle.data(), n))
+            return i;
+    }
+    return p_size;
+}
+
+std::string asciiToLower(std::string p_text)
+{
+    for (char &c : p_text) c = lowerAscii(c);
+    return p_text;
+}
+
+bool looksBinary(const char *p_data, std::size_t p_size)
+{
+    if (std::memchr(p_data, '\0', p_size) != nullptr) return true;
+    std::size_t control = 0;
+    for (std::size_t i = 0; i < p_size; ++i) {
+        const unsigned char c = static_cast<unsigned char>(p_data[i]);
+        // Tabs, line and page breaks, backspaces and escape sequences are
+        // common in text files and logs.
+        if (c < 0x20 && c != '\t' && c != '\n' && c != '\r' && c != '\f'
+            && c != '\v' && c != '\b' && c != 0x1B)
+            ++control;
+    }
+    return control * 10 > p_size;
+}
+
+} // namespace Text_utils
@@ -0,0 +1,35 @@
+#ifndef TEXT_SCAN_H_
+#define TEXT_SCAN_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Text_utils {
+
+// Appends `p_offset + i + 1` to `p_line_starts` for every '\n' at index `i`
+// of the given bytes, i.e. the file offsets of the lines that follow them.
+void findLineStarts(const char *p_data, std::size_t p_size,
+    std::uint64_t p_offset, std::vector<std::uint64_t> *p_line_starts);
+
+// Returns the number of '\n' in the given bytes.
+std::size_t countNewlines(const char *p_data, std::size_t p_size);
+
+// Returns the index of the first occurrence of `p_needle` in the given
+// bytes, ignoring ASCII case, or `p_size` if there is none.
+// `p_needle` must be non-empty and lowercase.
+std::size_t findCaseInsensitive(const char *p_data, std::size_t p_size,
+    const std::string &p_needle);
+
+// Lowercases ASCII letters.
+std::string asciiToLower(std::string p_text);
+
+// Returns true if the given bytes from the start of a file look like binary
+// data rather than text, i.e. they contain a NUL byte or too many control
+// characters.
+bool looksBinary(const char *p_data, std::size_t p_size);
+
+} // namespace Text_utils
+
+#endif // TEXT_SCAN_H_
@@ -0,0 +1,289 @@
+#include "text_search.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <unistd.h>
+
+#include "compressed_file.h"
+#include "text_scan.h"
+
+namespace {
+
+// The file is read and the results are published in chunks of this size.
+// Lines longer than this are searched in pieces.
+constexpr std::size_t kSearchChunkBytes = 1024 * 1024;
+
+constexpr std::size_t kNoLine = std::numeric_limits<std::size_t>::max();
+
+// The regex matcher uses a few hundred bytes of stack per character for
+// patterns like `a.*b`, and more for alternations, so lines are matched in
+// windows of this size on a thread with a stack of `kSearcherStackBytes`.
+// The default thread stack on musl is only 128 KiB.
+constexpr std::size_t kRegexWindowBytes = 1024;
+constexpr std::size_t kRegexWindowOverlap = 256;
+constexpr std::size_t kSearcherStackBytes = 8 * 1024 * 1024;
+
+// Calls `on_match` with the [begin, end) offsets of the matches in the line
+// [begin, end), in order, until it returns false. `continued` is true if
+// the line starts before `begin`. Stops between windows once `stop` is set.
+template <typename OnMatch>
+void forEachRegexMatch(const std::regex &re, const char *begin,
+    const char *end, bool continued, const std::atomic<bool> *stop,
+    OnMatch on_match)
+{
+    std::size_t next = 0;
+    for (const char *window = begin;;
+         window += kRegexWindowBytes - kRegexWindowOverlap) {
+        const bool last
+            = static_cast<std::size_t>(end - window) <= kRegexWindowBytes;
+        const char *window_end = last ? end : window + kRegexWindowBytes;
+        auto flags = window != begin ? std::regex_constants::match_prev_avail
+            : continued              ? std::regex_constants::match_not_bol
+                                     : std::regex_constants::match_default;
+        if (!last) flags |= std::regex_constants::match_not_eol;
+        // Matches that start in the overlap are left to the next window,
+        // which sees more of them.
+        const char *take_end = last ? end : window_end - kRegexWindowOverlap;
+        for (std::cregex_iterator it { window, window_end, re, flags }, it_end;
+             it != it_end; ++it) {
+            const std::size_t match_begin = window + it->position() - begin;
+            if (begin + match_begin >= take_end) break;
+            // Found again by the previous window.
+            if (match_begin < next) continue;
+            next = match_begin + it->length();
+            if (!on_match(match_begin, next)) return;
+        }
+        if (last || (stop != nullptr && *stop)) return;
+    }
+}
+
+} // namespace
+
+std::unique_ptr<TextSearch> TextSearch::start(const std::string &path,
+    const std::string &pattern, bool regex, TextEncoding encoding,
+    std::string *error)
+{
+    std::unique_ptr<TextSearch> search { new TextSearch(
+        path, pattern, regex, encoding) };
+    if (regex) {
+        try {
+            search->re_ = std::regex(pattern,
+                std::regex_constants::ECMAScript | std::regex_constants::icase
+                    | std::regex_constants::optimize);
+        } catch (const std::regex_error &e) {
+            *error = e.what();
+            return nullptr;
+        }
+    } else {
+        search->needle_ = Text_utils::asciiToLower(pattern);
+    }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, kSearcherStackBytes);
+    const int result = pthread_create(
+        &search->searcher_, &attr, &TextSearch::runSearcher, search.get());
+    pthread_attr_destroy(&attr);
+    if (result != 0) {
+        *error = std::strerror(result);
+        return nullptr;
+    }
+    search->searcher_started_ = true;
+    return search;
+}
+
+TextSearch::~TextSearch()
+{
+    stop_ = true;
+    if (searcher_started_) pthread_join(searcher_, nullptr);
+}
+
+void *TextSearch::runSearcher(void *search)
+{
+    static_cast<TextSearch *>(search)->search();
+    return nullptr;
+}
+
+bool TextSearch::collectMatches()
+{
+    if (!searching_) return false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_lines_.empty() && !pending_done_) return false;
+    lines_.insert(lines_.end(), pending_lines_.begin(), pending_lines_.end());
+    pending_lines_.clear();
+    searching_ = !pending_done_;
+    return true;
+}
+
+bool TextSearch::lineMatches(std::size_t line) const
+{
+    return std::binary_search(lines_.begin(), lines_.end(), line);
+}
+
+std::vector<std::pair<std::size_t, std::size_t>> TextSearch::findInLine(
+    const std::string &line) const
+{
+    std::vector<std::pair<std::size_t, std::size_t>> result;
+    if (regex_) {
+        forEachRegexMatch(re_, line.data(), line.data() + line.size(),
+            /*continued=*/false, /*stop=*/nullptr,
+            [&result](std::size_t begin, std::size_t end) {
+                // Empty matches are not highlighted.
+                if (end > begin) result.emplace_back(begin, end);
+                return true;
+            });
+        return result;
+    }
+    std::size_t pos = 0;
+    while (pos < line.size()) {
+        pos += Text_utils::findCaseInsensitive(
+            line.data() + pos, line.size() - pos, needle_);
+        if (pos == line.size()) break;
+        result.emplace_back(pos, pos + needle_.size());
+        pos += needle_.size();
+    }
+    return result;
+}
+
+void TextSearch::search()
+{
+    const int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        publish(/*done=*/true);
+        return;
+    }
+    // Compressed files are searched in their decompressed form, as they
+    // are shown.
+    const CompressedFile::Format format = CompressedFile::detect(fd);
+    std::unique_ptr<CompressedFile> compressed;
+    if (format != CompressedFile::Format::NONE) {
+        compressed = CompressedFile::open(fd, format);
+        if (compressed == nullptr) {
+            ::close(fd);
+            publish(/*done=*/true);
+            return;
+        }
+    }
+    std::vector<char> buf(kSearchChunkBytes);
+    std::size_t used = 0;
+    std::size_t line = 0;
+    // The offset of `buf[0]` within its line.
+    std::size_t column = 0;
+    bool first_read = true;
+    // Lines in other encodings are converted before they are searched.
+    TextDecoder decoder(encoding_);
+    const auto search_lines = [&](const char *data, std::size_t size) {
+        if (encoding_ == TextEncoding::UTF8) {
+            searchLines(data, size, column, &line);
+            return;
+        }
+        const std::string text = decoder.toUtf8(data, size);
+        searchLines(text.data(), text.size(), column, &line);
+    };
+    while (!stop_) {
+        const ssize_t n = compressed != nullptr
+            ? static_cast<ssize_t>(compressed->readNext(
+                buf.data() + used, buf.size() - used))
+            : ::read(fd, buf.data() + used, buf.size() - used);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        used += static_cast<std::size_t>(n);
+        const std::size_t bom
+            = first_read ? Text_utils::bomSize(buf.data(), used, encoding_) : 0;
+        if (bom > 0) {
+            // Skip the byte order mark, as `TextFile::line` does.
+            std::memmove(buf.data(), buf.data() + bom, used - bom);
+            used -= bom;
+        }
+        first_read = false;
+
+        // Only complete lines are searched, unless a line fills the buffer.
+        std::size_t end
+            = Text_utils::lastNewlineEnd(buf.data(), used, encoding_);
+        const bool complete = end > 0;
+        if (!complete) {
+            if (used < buf.size()) continue;
+            // Whole UTF-16 code units.
+            end = used - used % Text_utils::newlineBytes(encoding_);
+        }
+        search_lines(buf.data(), end);
+        column = complete ? 0 : column + end;
+        std::memmove(buf.data(), buf.data() + end, used - end);
+        used -= end;
+        publish(/*done=*/false);
+    }
+    if (!stop_ && used > 0) search_lines(buf.data(), used);
+    compressed = nullptr;
+    ::close(fd);
+    publish(/*done=*/true);
+}
+
+void TextSearch::searchLines(
+    const char *data, std::size_t size, std::size_t column, std::size_t *line)
+{
+    std::size_t last_line
+        = found_lines_.empty() ? kNoLine : found_lines_.back();
+    const auto add_line = [&]() {
+        if (*line != last_line) {
+            found_lines_.push_back(*line);
+            last_line = *line;
+        }
+    };
+    if (!regex_) {
+        // The chunk is scanned for the pattern rather than line by line,
+        // and the newlines are only counted up to each match.
+        std::size_t counted = 0;
+        std::size_t pos = 0;
+        while (pos < size) {
+            const std::size_t found = pos
+                + Text_utils::findCaseInsensitive(
+                    data + pos, size - pos, needle_);
+            if (found == size) break;
+            *line += Text_utils::countNewlines(data + counted, found - counted);
+            counted = found;
+            add_line();
+            // Skip to the next line.
+            const void *newline
+                = std::memchr(data + found, '\n', size - found);
+            if (newline == nullptr) break;
+            pos = static_cast<const char *>(newline) - data + 1;
+        }
+        *line += Text_utils::countNewlines(data + counted, size - counted);
+        return;
+    }
+    const char *begin = data;
+    const char *const data_end = data + size;
+    bool continued = column > 0;
+    while (begin < data_end && !stop_) {
+        const char *newline = static_cast<const char *>(
+            std::memchr(begin, '\n', data_end - begin));
+        const char *end = newline != nullptr ? newline : data_end;
+        const char *line_end = end;
+        if (line_end > begin && line_end[-1] == '\r') --line_end;
+        bool found = false;
+        forEachRegexMatch(re_, begin, line_end, continued, &stop_,
+            [&found](std::size_t, std::size_t) {
+                found = true;
+                return false;
+            });
+        if (found) add_line();
+        if (newline == nullptr) break;
+        ++*line;
+        begin = newline + 1;
+        continued = false;
+    }
+}
+
+void TextSearch::publish(bool done)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The last line can be continued in the next chunk, so it is kept to
+    // avoid publishing it twice.
+    const std::size_t keep = !done && !found_lines_.empty() ? 1 : 0;
+    pending_lines_.insert(pending_lines_.end(), found_lines_.begin(),
+        found_lines_.end() - keep);
+    found_lines_.erase(found_lines_.begin(), found_lines_.end() - keep);
+    pending_done_ = done;
+}
@@ -0,0 +1,111 @@
+#ifndef TEXT_SEARCH_H_
+#define TEXT_SEARCH_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <regex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "text_encoding.h"
+
+/**
+ * @brief Searches a file for a case-insensitive literal or regular
+ * expression, on a background thread.
+ *
+ * The file is read in chunks and the numbers of the matching lines are
+ * streamed in as they are found, so the results can be used while the rest
+ * of the file is being searched.
+ *
+ * Literals are found with a vectorized scan over the file bytes. Regular
+ * expressions are matched line by line, and long lines in overlapping
+ * windows, because libstdc++'s matcher recurses for every character. A
+ * match longer than the overlap can be missed or cut short. Files in other
+ * encodings than UTF-8 are converted in chunks as they are read.
+ */
+class TextSearch {
+  public:
+    // Returns nullptr and sets `error` if the regular expression is invalid.
+    static std::unique_ptr<TextSearch> start(const std::string &path,
+        const std::string &pattern, bool regex, TextEncoding encoding,
+        std::string *error);
+
+    ~TextSearch();
+
+    TextSearch(const TextSearch &) = delete;
+    TextSearch &operator=(const TextSearch &) = delete;
+
+    const std::string &pattern() const { return pattern_; }
+    bool regex() const { return regex_; }
+
+    // Picks up the matches found in the background.
+    // Returns true if there are new matching lines or the search has
+    // finished.
+    bool collectMatches();
+
+    bool searching() const { return searching_; }
+
+    // Ascending numbers of the lines found so far that have a match.
+    const std::vector<std::size_t> &lines() const { return lines_; }
+
+    bool lineMatches(std::size_t line) const;
+
+    // Returns the [begin, end) byte ranges of the matches in `line`.
+    std::vector<std::pair<std::size_t, std::size_t>> findInLine(
+        const std::string &line) const;
+
+  private:
+    TextSearch(std::string path, std::string pattern, bool regex,
+        TextEncoding encoding)
+        : path_(std::move(path))
+        , pattern_(std::move(pattern))
+        , regex_(regex)
+        , encoding_(encoding)
+    {
+    }
+
+    static void *runSearcher(void *search);
+
+    // Runs on `searcher_`.
+    void search();
+
+    // Adds the matching lines among the given complete lines, the first one
+    // of which is line number `*line` and starts `column` bytes into that
+    // line. Advances `*line` past them.
+    // Runs on `searcher_`.
+    void searchLines(const char *data, std::size_t size, std::size_t column,
+        std::size_t *line);
+
+    void publish(bool done);
+
+    std::string path_;
+    std::string pattern_;
+    bool regex_;
+    TextEncoding encoding_;
+    // The literal pattern in lowercase.
+    std::string needle_;
+    std::regex re_;
+
+    std::vector<std::size_t> lines_;
+    bool searching_ = true;
+
+    // Only used by `searcher_`.
+    std::vector<std::size_t> found_lines_;
+
+    // Results from `searcher_`, guarded by `mutex_`.
+    std::mutex mutex_;
+    std::vector<std::size_t> pending_lines_;
+    bool pending_done_ = false;
+
+    std::atomic<bool> stop_ { false };
+    // Has a larger stack than `std::thread` gives, for the regex matcher.
+    pthread_t searcher_;
+    bool searcher_started_ = false;
+};
+
+#endif // TEXT_SEARCH_H_
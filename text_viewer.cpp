@@ -2,10 +2,10 @@
 
 #include <algorithm>
 #include <cstring>
-#include <fstream>
 
 #include "config.h"
 #include "def.h"
+#include "dialog.h"
 #include "error_dialog.h"
 #include "keyboard.h"
 #include "resourceManager.h"
@@ -38,49 +38,76 @@ int numTotalViewportLines()
         + 1;
 }
 
+// Edits are saved once there have been none for this long.
+constexpr std::uint32_t kSaveDelayMs = 1000;
+
+// For reading whole lines for editing rather than truncated ones.
+constexpr std::size_t kFullLine = static_cast<std::size_t>(-1);
+
 void adjustLineForDisplay(std::string *line)
 {
     utf8::replaceTabsWithSpaces(line);
 }
 
+SDL_Color syntaxColor(SyntaxHighlighter::Style style)
+{
+    switch (style) {
+        case SyntaxHighlighter::Style::COMMENT:
+            return SDL_Color { COLOR_SYNTAX_COMMENT };
+        case SyntaxHighlighter::Style::KEYWORD:
+            return SDL_Color { COLOR_SYNTAX_KEYWORD };
+        case SyntaxHighlighter::Style::KEY:
+            return SDL_Color { COLOR_SYNTAX_KEY };
+        case SyntaxHighlighter::Style::STRING:
+            return SDL_Color { COLOR_SYNTAX_STRING };
+        case SyntaxHighlighter::Style::NUMBER:
+            return SDL_Color { COLOR_SYNTAX_NUMBER };
+        case SyntaxHighlighter::Style::VARIABLE:
+            return SDL_Color { COLOR_SYNTAX_VARIABLE };
+    }
+    return SDL_Color { COLOR_TEXT_NORMAL };
+}
+
+// The spans within the bytes [begin, end) of a line, relative to `begin`.
+std::vector<TextLineCache::Span> spansInRow(
+    const std::vector<TextLineCache::Span> &spans, std::size_t begin,
+    std::size_t end)
+{
+    std::vector<TextLineCache::Span> result;
+    for (const auto &span : spans) {
+        if (span.end <= begin || span.begin >= end) continue;
+        result.push_back({ std::max(span.begin, begin) - begin,
+            std::min(span.end, end) - begin, span.fg });
+    }
+    return result;
+}
+
 } // namespace
 
 TextViewer::TextViewer(std::string filename)
     : fonts_(CResourceManager::instance().getFonts())
     , filename_(std::move(filename))
+    , line_cache_(fonts_)
     , first_line_(0)
     , current_line_(0)
 {
-    std::ifstream input_file(filename_.c_str());
-    if (!input_file.is_open()) {
+    file_ = TextFile::open(filename_);
+    if (file_ == nullptr) {
         ErrorDialog(
             "Unable to open file", filename_ + "\n" + std::strerror(errno));
         m_retVal = -1;
         return;
     }
-    while (!input_file.eof()) {
-        lines_.emplace_back();
-        auto &line = lines_.back();
-        std::getline(input_file, line);
-        if (!line.empty() && line.back() == '\r') line.pop_back();
-    }
-
-    if (!lines_.empty()) {
-        utf8::removeBom(&lines_[0]);
-
-        // Remove EOL at the end of the file.
-        // We'll add it back when saving.
-        if (lines_.back().empty()) lines_.pop_back();
-    }
-    if (lines_.empty()) lines_.emplace_back();
-
-    input_file.close();
-    lines_for_display_ = lines_;
-    for (auto &line : lines_for_display_) { adjustLineForDisplay(&line); }
+    highlighter_ = SyntaxHighlighter::forFile(filename_, file_->line(0));
     clip_.x = clip_.y = 0;
     init();
 }
 
+TextViewer::~TextViewer()
+{
+    if (save_pending_) saveFile();
+}
+
 void TextViewer::init()
 {
     const auto &fonts = CResourceManager::instance().getFonts();
@@ -91,6 +118,7 @@ void TextViewer::init()
     bg_color_ = SDL_MapRGB(pixel_format, COLOR_BG_1);
     sdl_highlight_color_ = SDL_Color { COLOR_CURSOR_1 };
     highlight_color_ = SDL_MapRGB(pixel_format, COLOR_CURSOR_1);
+    sdl_match_color_ = SDL_Color { COLOR_SEARCH_MATCH };
 
     // Create background image
     background_ = SDLSurfaceUniquePtr { SDL_utils::createImage(
@@ -101,8 +129,15 @@ void TextViewer::init()
     }
     // Print title
     {
+        std::string title = filename_;
+        if (file_ != nullptr && file_->encoding() != TextEncoding::UTF8) {
+            title += " (";
+            title += Text_utils::encodingName(file_->encoding());
+            title += ")";
+        }
+        if (file_ != nullptr && file_->following()) title += " (following)";
         SDLSurfaceUniquePtr tmp { SDL_utils::renderText(
-            fonts, filename_, Globals::g_colorTextTitle, { COLOR_TITLE_BG }) };
+            fonts, title, Globals::g_colorTextTitle, { COLOR_TITLE_BG }) };
         SDL_Rect rect;
         SDL_Rect *clip_rect = nullptr;
         if (tmp->w > background_->w - 2 * VIEWER_PADDING_X_PHYS) {
@@ -116,48 +151,178 @@ void TextViewer::init()
             HEADER_PADDING_TOP_PHYS, tmp.get(), background_.get(), clip_rect);
     }
     clip_.w = screen.actual_w - 2 * VIEWER_PADDING_X_PHYS;
+    // The scale may have changed.
+    line_cache_.clear();
 }
 
 void TextViewer::onResize()
 {
-    const int max_first_line = maxFirstLine();
-    if (current_line_ > first_line_ + numFullViewportLines() - 1) {
-        first_line_ = std::min(
-            static_cast<int>(current_line_ - numFullViewportLines() + 1),
-            max_first_line);
-    }
     init();
+    // The rows are measured again as the lines are shown.
+    if (wrapping_) wrap_layout_.invalidateAll();
+    scrollToCurrentLine();
 }
 
 void TextViewer::render(const bool focused) const
 {
     SDL_utils::applyPpuScaledSurface(0, 0, background_.get(), screen.surface);
+    if (wrapping_) {
+        renderWrapped();
+        line_cache_.endFrame();
+        if (search_ != nullptr) renderMatchCounter();
+        return;
+    }
 
     std::size_t i = std::min(
-        first_line_ + numTotalViewportLines() + 1, lines_for_display_.size());
-    SDL_Rect clip = clip_;
+        first_line_ + numTotalViewportLines() + 1, numLines());
     const int y0 = VIEWER_Y_LIST_PHYS;
     const int line_height = VIEWER_LINE_HEIGHT_PHYS;
     while (i-- > first_line_) {
-        const std::string &line = lines_for_display_[i];
+        // Tabs are only expanded for the visible lines.
+        const std::string raw_line = this->line(i);
+        std::string line = raw_line;
+        adjustLineForDisplay(&line);
         const int viewport_line_i = static_cast<int>(i - first_line_);
-        SDLSurfaceUniquePtr tmp;
-        if (!line.empty()) {
-            tmp = SDLSurfaceUniquePtr { SDL_utils::renderText(fonts_, line,
-                Globals::g_colorTextNormal,
-                i == current_line_ ? sdl_highlight_color_ : sdl_bg_color_) };
-        }
         const int y = y0 + viewport_line_i * line_height;
         if (i == current_line_) {
             SDL_Rect hl_rect
                 = SDL_utils::makeRect(0, y, screen.actual_w, line_height);
             SDL_FillRect(screen.surface, &hl_rect, highlight_color_);
         }
+        // Only the part around the viewport is rendered, and it is kept
+        // for the next frames.
+        line_cache_.draw({ i, 0 }, line, Globals::g_colorTextNormal,
+            i == current_line_ ? sdl_highlight_color_ : sdl_bg_color_,
+            syntaxSpans(i, raw_line), clip_.x, clip_.w, VIEWER_PADDING_X_PHYS,
+            y, screen.surface);
+        if (search_ != nullptr && search_->lineMatches(i))
+            renderMatches({ i, 0 }, raw_line, 0, line.size(), clip_.x, y);
+    }
+    line_cache_.endFrame();
+    if (search_ != nullptr) renderMatchCounter();
+}
+
+void TextViewer::renderWrapped() const
+{
+    const int line_height = VIEWER_LINE_HEIGHT_PHYS;
+    int y = VIEWER_Y_LIST_PHYS;
+    for (std::size_t i = first_line_; i < numLines() && y < screen.actual_h;
+         ++i) {
+        const std::string raw_line = this->line(i);
+        std::string line = raw_line;
+        adjustLineForDisplay(&line);
+        // Measured anyway to be drawn, so the layout is kept up to date.
+        const std::vector<std::size_t> rows = wrapLine(line);
+        wrap_layout_.setRows(i, rows.size());
+        const bool matches = search_ != nullptr && search_->lineMatches(i);
+        const std::vector<TextLineCache::Span> spans
+            = syntaxSpans(i, raw_line);
+        for (std::size_t row = i == first_line_ ? first_row_ : 0;
+             row < rows.size() && y < screen.actual_h; ++row) {
+            const std::size_t begin = rows[row];
+            const std::size_t end
+                = row + 1 < rows.size() ? rows[row + 1] : line.size();
+            if (i == current_line_) {
+                SDL_Rect hl_rect
+                    = SDL_utils::makeRect(0, y, screen.actual_w, line_height);
+                SDL_FillRect(screen.surface, &hl_rect, highlight_color_);
+            }
+            line_cache_.draw({ i, row }, line.substr(begin, end - begin),
+                Globals::g_colorTextNormal,
+                i == current_line_ ? sdl_highlight_color_ : sdl_bg_color_,
+                spansInRow(spans, begin, end), /*scroll_x=*/0, clip_.w,
+                VIEWER_PADDING_X_PHYS, y, screen.surface);
+            if (matches)
+                renderMatches({ i, row }, raw_line, begin, end, 0, y);
+            y += line_height;
+        }
+    }
+}
+
+void TextViewer::renderMatches(const TextLineCache::Key &key,
+    const std::string &line, std::size_t begin, std::size_t end, int scroll_x,
+    int y) const
+{
+    for (const auto &match : search_->findInLine(line)) {
+        // Tabs before the match affect its position and width.
+        std::string prefix = line.substr(0, match.first);
+        std::string text = line.substr(0, match.second);
+        adjustLineForDisplay(&prefix);
+        adjustLineForDisplay(&text);
+        // The part of the match within this row.
+        const std::size_t from = std::max(prefix.size(), begin);
+        const std::size_t to = std::min(text.size(), end);
+        if (from >= to) continue;
+        const int x = line_cache_.xAt(key, from - begin);
+        if (x >= scroll_x + clip_.w
+            || line_cache_.xAt(key, to - begin) <= scroll_x)
+            continue;
+        text = text.substr(from, to - from);
+        SDLSurfaceUniquePtr tmp { SDL_utils::renderText(
+            fonts_, text, Globals::g_colorTextNormal, sdl_match_color_) };
         if (tmp == nullptr) continue;
-        clip.h = tmp->h;
+        // Clip to the horizontally scrolled text area.
+        const int src_x = std::max(0, scroll_x - x);
+        const int dst_x = VIEWER_PADDING_X_PHYS + std::max(0, x - scroll_x);
+        const int w = std::min(
+            tmp->w - src_x, VIEWER_PADDING_X_PHYS + clip_.w - dst_x);
+        if (w <= 0) continue;
+        SDL_Rect clip = SDL_utils::makeRect(src_x, 0, w, tmp->h);
         SDL_utils::applyPpuScaledSurface(
-            VIEWER_PADDING_X_PHYS, y, tmp.get(), screen.surface, &clip);
+            dst_x, y, tmp.get(), screen.surface, &clip);
+    }
+}
+
+std::vector<TextLineCache::Span> TextViewer::syntaxSpans(
+    std::size_t index, const std::string &raw_line) const
+{
+    std::vector<TextLineCache::Span> result;
+    if (highlighter_ == nullptr) return result;
+    // The lines are lexed before their tabs are expanded, e.g. for `<<-`
+    // here documents, and the spans are moved to the expanded line.
+    const auto read_line = [this](std::size_t i) { return this->line(i); };
+    const std::vector<std::size_t> offsets
+        = raw_line.find('\t') != std::string::npos
+        ? utf8::tabExpandedOffsets(raw_line)
+        : std::vector<std::size_t>();
+    for (const auto &span :
+        highlighter_->highlight(index, raw_line, read_line)) {
+        if (offsets.empty())
+            result.push_back({ span.begin, span.end, syntaxColor(span.style) });
+        else
+            result.push_back({ offsets[span.begin], offsets[span.end],
+                syntaxColor(span.style) });
     }
+    return result;
+}
+
+void TextViewer::renderMatchCounter() const
+{
+    // E.g. "3/120" on a matching line and "-/120" elsewhere, with a "+"
+    // while the rest of the file is being searched.
+    const auto &lines = search_->lines();
+    std::string text;
+    if (lines.empty() && !search_->searching()) {
+        text = "No matches";
+    } else {
+        text = search_->lineMatches(current_line_)
+            ? std::to_string(std::lower_bound(lines.begin(), lines.end(),
+                                  current_line_)
+                  - lines.begin() + 1)
+            : "-";
+        text += "/" + std::to_string(lines.size());
+        if (search_->searching()) text += "+";
+    }
+    SDLSurfaceUniquePtr tmp { SDL_utils::renderText(
+        fonts_, text, Globals::g_colorTextTitle, { COLOR_TITLE_BG }) };
+    if (tmp == nullptr) return;
+    const int x = screen.actual_w - tmp->w - VIEWER_PADDING_X_PHYS;
+    // Covers the end of a long title.
+    SDL_Rect rect = SDL_utils::makeRect(x - VIEWER_PADDING_X_PHYS, 0,
+        screen.actual_w - x + VIEWER_PADDING_X_PHYS, HEADER_H_PHYS);
+    SDL_FillRect(screen.surface, &rect, border_color_);
+    SDL_utils::applyPpuScaledSurface(
+        x, HEADER_PADDING_TOP_PHYS, tmp.get(), screen.surface);
 }
 
 bool TextViewer::keyPress(
@@ -177,24 +342,35 @@ bool TextViewer::keyPress(
     if (key == c.key_up || button == c.gamepad_up) return moveUp(1);
     if (key == c.key_down || button == c.gamepad_down) return moveDown(1);
     if (key == c.key_pageup || button == c.gamepad_pageup)
-        return moveUp(numFullViewportLines() - 1);
+        return pageUp();
     if (key == c.key_pagedown || button == c.gamepad_pagedown)
-        return moveDown(numFullViewportLines() - 1);
+        return pageDown();
     if (key == c.key_left || button == c.gamepad_left) return moveLeft();
     if (key == c.key_right || button == c.gamepad_right) return moveRight();
+    if (key == c.key_transfer || button == c.gamepad_transfer)
+        return toggleFollow();
+    if (key == c.key_select || button == c.gamepad_select)
+        return openMenu();
+    if (key == SDLK_F3)
+        return jumpToMatch((event.key.keysym.mod & KMOD_SHIFT) != 0 ? -1 : 1);
     return false;
 }
 
 bool TextViewer::keyHold()
 {
+    // Called every frame, so this is where newly indexed lines are picked up
+    // and pending edits are saved.
+    if (save_pending_ && SDL_GetTicks() >= save_at_) saveFile();
+    bool changed = collectLines();
+    changed = collectMatches() || changed;
     const auto &c = config();
-    if (tick(c.key_up)) return moveUp(1);
-    if (tick(c.key_down)) return moveDown(1);
-    if (tick(c.key_pageup)) return moveUp(numFullViewportLines() - 1);
-    if (tick(c.key_pagedown)) return moveDown(numFullViewportLines() - 1);
-    if (tick(c.key_left)) return moveLeft();
-    if (tick(c.key_right)) return moveRight();
-    return false;
+    if (tick(c.key_up)) return moveUp(1) || changed;
+    if (tick(c.key_down)) return moveDown(1) || changed;
+    if (tick(c.key_pageup)) return pageUp() || changed;
+    if (tick(c.key_pagedown)) return pageDown() || changed;
+    if (tick(c.key_left)) return moveLeft() || changed;
+    if (tick(c.key_right)) return moveRight() || changed;
+    return changed;
 }
 
 #if SDL_VERSION_ATLEAST(2, 0, 0)
@@ -204,9 +380,9 @@ bool TextViewer::gamepadHold(SDL_GameController *controller)
     if (tick(controller, c.gamepad_up)) return moveUp(1);
     if (tick(controller, c.gamepad_down)) return moveDown(1);
     if (tick(controller, c.gamepad_pageup))
-        return moveUp(numFullViewportLines() - 1);
+        return pageUp();
     if (tick(controller, c.gamepad_pagedown))
-        return moveDown(numFullViewportLines() - 1);
+        return pageDown();
     if (tick(controller, c.gamepad_left)) return moveLeft();
     if (tick(controller, c.gamepad_right)) return moveRight();
     return false;
@@ -218,15 +394,296 @@ int TextViewer::getLineAt(int x, int y) const
     const int y0 = VIEWER_Y_LIST_PHYS;
     if (y < y0) return -1;
     const int line_height = VIEWER_LINE_HEIGHT_PHYS;
-    const int line = (y - y0) / line_height;
-    if (first_line_ + line >= lines_.size()) return -1;
-    return line;
+    const std::size_t row = (y - y0) / line_height;
+    if (!wrapping_) {
+        if (first_line_ + row >= numLines()) return -1;
+        return static_cast<int>(first_line_ + row);
+    }
+    std::size_t line = first_line_;
+    std::size_t row_in_line = first_row_ + row;
+    while (line < numLines() && row_in_line >= wrappedRows(line)) {
+        row_in_line -= wrappedRows(line);
+        ++line;
+    }
+    return line < numLines() ? static_cast<int>(line) : -1;
 }
 
 int TextViewer::maxFirstLine() const
 {
     const int viewport_lines = numFullViewportLines();
-    return lines_.size() >= viewport_lines ? lines_.size() - viewport_lines : 0;
+    return numLines() >= viewport_lines ? numLines() - viewport_lines : 0;
+}
+
+bool TextViewer::collectLines()
+{
+    if (buffer_ != nullptr) return false;
+    const std::size_t old_num_lines = numLines();
+    const bool at_end = current_line_ + 1 >= old_num_lines;
+    if (!file_->collectLines()) return false;
+    if (highlighter_ != nullptr) {
+        // The last line may have been incomplete, or the file reopened.
+        highlighter_->invalidate(
+            numLines() < old_num_lines ? 0 : old_num_lines - 1);
+    }
+    if (wrapping_) {
+        if (numLines() < old_num_lines) {
+            wrap_layout_.reset(numLines());
+        } else {
+            wrap_layout_.resize(numLines());
+            // The last line may have been incomplete.
+            if (old_num_lines > 0) wrap_layout_.invalidate(old_num_lines - 1);
+        }
+    }
+    if (file_->following() && at_end) {
+        // Keep the view pinned to the end while following.
+        current_line_ = numLines() - 1;
+        if (wrapping_) {
+            scrollToCurrentLine();
+        } else {
+            first_line_ = maxFirstLine();
+        }
+        return true;
+    }
+    // The file may have been truncated.
+    current_line_ = std::min(current_line_, numLines() - 1);
+    if (wrapping_) {
+        if (first_line_ >= numLines()) {
+            first_line_ = numLines() - 1;
+            first_row_ = 0;
+        }
+    } else {
+        first_line_
+            = std::min(first_line_, static_cast<std::size_t>(maxFirstLine()));
+    }
+    // Only the last line can have changed.
+    return first_line_ + numTotalViewportLines() >= old_num_lines;
+}
+
+bool TextViewer::toggleFollow()
+{
+    // Edits are not saved to a followed file.
+    if (buffer_ != nullptr || file_->compressed()) return false;
+    file_->setFollow(!file_->following());
+    if (file_->following()) {
+        current_line_ = numLines() - 1;
+        if (wrapping_) {
+            scrollToCurrentLine();
+        } else {
+            first_line_ = maxFirstLine();
+        }
+    }
+    init();
+    return true;
+}
+
+bool TextViewer::toggleWrap()
+{
+    wrapping_ = !wrapping_;
+    clip_.x = 0;
+    first_row_ = 0;
+    if (wrapping_) {
+        wrap_layout_.reset(numLines());
+    } else {
+        wrap_layout_.reset(0);
+        first_line_
+            = std::min(first_line_, static_cast<std::size_t>(maxFirstLine()));
+    }
+    scrollToCurrentLine();
+    return true;
+}
+
+std::size_t TextViewer::wrappedRows(std::size_t line) const
+{
+    if (!wrap_layout_.measured(line)) {
+        std::string text = this->line(line);
+        adjustLineForDisplay(&text);
+        wrap_layout_.setRows(line, wrapLine(text).size());
+    }
+    return wrap_layout_.rows(line);
+}
+
+std::vector<std::size_t> TextViewer::wrapLine(const std::string &line) const
+{
+    return line_cache_.wrap(line, clip_.w);
+}
+
+void TextViewer::scrollRows(std::ptrdiff_t delta)
+{
+    if (delta > 0) {
+        std::size_t row = first_row_ + delta;
+        while (first_line_ + 1 < numLines()
+            && row >= wrappedRows(first_line_)) {
+            row -= wrappedRows(first_line_);
+            ++first_line_;
+        }
+        first_row_ = std::min(row, wrappedRows(first_line_) - 1);
+    } else {
+        std::size_t back = -delta;
+        while (back > first_row_ && first_line_ > 0) {
+            back -= first_row_ + 1;
+            --first_line_;
+            first_row_ = wrappedRows(first_line_) - 1;
+        }
+        first_row_ -= std::min(back, first_row_);
+    }
+}
+
+std::size_t TextViewer::rowsToCurrentLineEnd(std::size_t limit) const
+{
+    std::size_t rows = 0;
+    for (std::size_t i = first_line_; i <= current_line_ && rows < limit; ++i)
+        rows += wrappedRows(i) - (i == first_line_ ? first_row_ : 0);
+    return std::min(rows, limit);
+}
+
+bool TextViewer::openMenu()
+{
+    CDialog dialog { "View" };
+    std::vector<std::function<bool()>> handlers;
+    dialog.addOption(wrapping_ ? "Don't wrap lines" : "Wrap lines");
+    handlers.push_back([this]() { return toggleWrap(); });
+    if (search_ != nullptr) {
+        dialog.addLabel(search_->pattern());
+        dialog.addOption("Next match");
+        handlers.push_back([this]() { return jumpToMatch(1); });
+        dialog.addOption("Previous match");
+        handlers.push_back([this]() { return jumpToMatch(-1); });
+    }
+    dialog.addOption("Find text");
+    handlers.push_back([this]() { return startSearch(/*regex=*/false); });
+    dialog.addOption("Find regex");
+    handlers.push_back([this]() { return startSearch(/*regex=*/true); });
+    if (search_ != nullptr) {
+        dialog.addOption("Clear search");
+        handlers.push_back([this]() {
+            search_ = nullptr;
+            pending_jump_ = 0;
+            return true;
+        });
+    }
+    dialog.init();
+    const int dialog_result = dialog.execute();
+    if (dialog_result > 0 && dialog_result <= handlers.size())
+        handlers[dialog_result - 1]();
+    return true;
+}
+
+bool TextViewer::startSearch(bool regex)
+{
+    CKeyboard keyboard(search_ != nullptr ? search_->pattern() : "");
+    if (keyboard.execute() != 1 || keyboard.getInputText().empty())
+        return true;
+    std::string error;
+    std::unique_ptr<TextSearch> search = TextSearch::start(
+        filename_, keyboard.getInputText(), regex, file_->encoding(), &error);
+    if (search == nullptr) {
+        ErrorDialog("Invalid regex", error);
+        return true;
+    }
+    search_ = std::move(search);
+    jumpToMatch(1, /*include_current=*/true);
+    return true;
+}
+
+void TextViewer::restartSearch()
+{
+    if (search_ == nullptr) return;
+    std::string error;
+    search_ = TextSearch::start(filename_, search_->pattern(),
+        search_->regex(), file_->encoding(), &error);
+}
+
+bool TextViewer::collectMatches()
+{
+    if (search_ == nullptr || !search_->collectMatches()) return false;
+    if (pending_jump_ != 0)
+        jumpToMatch(pending_jump_, pending_jump_include_current_);
+    // For the match counter and highlighting.
+    return true;
+}
+
+bool TextViewer::jumpToMatch(int direction, bool include_current)
+{
+    if (search_ == nullptr) return false;
+    pending_jump_ = 0;
+    const auto &lines = search_->lines();
+    std::size_t line;
+    if (direction > 0) {
+        auto it = include_current
+            ? std::lower_bound(lines.begin(), lines.end(), current_line_)
+            : std::upper_bound(lines.begin(), lines.end(), current_line_);
+        if (it == lines.end()) {
+            if (search_->searching()) {
+                pending_jump_ = direction;
+                pending_jump_include_current_ = include_current;
+                return false;
+            }
+            if (lines.empty()) return false;
+            it = lines.begin();
+        }
+        line = *it;
+    } else {
+        auto it = std::lower_bound(lines.begin(), lines.end(), current_line_);
+        if (it == lines.begin()) {
+            // Wrapping around needs the last match in the file.
+            if (search_->searching()) {
+                pending_jump_ = direction;
+                pending_jump_include_current_ = false;
+                return false;
+            }
+            if (lines.empty()) return false;
+            it = lines.end();
+        }
+        line = *--it;
+    }
+    if (line >= numLines()) {
+        // Not indexed yet.
+        pending_jump_ = direction;
+        pending_jump_include_current_ = include_current;
+        return false;
+    }
+    return jumpToLine(line);
+}
+
+bool TextViewer::jumpToLine(std::size_t line)
+{
+    if (line == current_line_) return false;
+    current_line_ = line;
+    if (wrapping_) {
+        scrollToCurrentLine();
+        return true;
+    }
+    const std::size_t viewport_lines = numFullViewportLines();
+    if (current_line_ < first_line_
+        || current_line_ >= first_line_ + viewport_lines) {
+        // Show the line in the middle of the viewport.
+        first_line_ = std::min(
+            current_line_ > viewport_lines / 2
+                ? current_line_ - viewport_lines / 2
+                : 0,
+            static_cast<std::size_t>(maxFirstLine()));
+    }
+    return true;
+}
+
+std::size_t TextViewer::numLines() const
+{
+    return buffer_ != nullptr ? buffer_->numLines() : file_->numLines();
+}
+
+std::string TextViewer::line(std::size_t index) const
+{
+    return buffer_ != nullptr ? buffer_->line(index) : file_->line(index);
+}
+
+void TextViewer::startEditing()
+{
+    if (buffer_ != nullptr) return;
+    // The buffer refers to the lines of the file, which is no longer
+    // followed. It stays open after saving, as its lines are still valid:
+    // the saved file replaces it rather than overwriting it.
+    file_->waitForIndex();
+    buffer_.reset(new TextBuffer(*file_));
 }
 
 bool TextViewer::mouseWheel(int dx, int dy)
@@ -251,14 +708,13 @@ bool TextViewer::mouseDown(int button, int x, int y)
         case SDL_BUTTON_LEFT: {
             const int line = getLineAt(x, y);
             if (line != -1) {
-                const std::size_t new_current_line = first_line_ + line;
+                const std::size_t new_current_line = line;
                 if (current_line_ == new_current_line) {
                     editLine();
                     return true;
                 }
                 current_line_ = new_current_line;
-                if (first_line_ + numFullViewportLines() < current_line_)
-                    ++first_line_;
+                scrollToCurrentLine();
                 return true;
             }
             return false;
@@ -271,34 +727,107 @@ bool TextViewer::mouseDown(int button, int x, int y)
 
 bool TextViewer::moveUp(unsigned step)
 {
+    // Reveals the start of a current line taller than the viewport first.
+    if (wrapping_ && current_line_ == first_line_ && first_row_ > 0) {
+        scrollRows(-static_cast<std::ptrdiff_t>(
+            std::min<std::size_t>(step, first_row_)));
+        return true;
+    }
     bool changed = false;
     if (current_line_ > 0) {
         current_line_ = current_line_ >= step ? current_line_ - step : 0;
         changed = true;
     }
-    if (current_line_ < first_line_) { first_line_ = current_line_; }
+    scrollToCurrentLine();
     return changed;
 }
 
 bool TextViewer::moveDown(unsigned step)
 {
-    if (lines_.empty()) return false;
+    if (numLines() == 0) return false;
+    // Reveals the end of a current line that goes past the viewport first.
+    if (wrapping_) {
+        const std::size_t viewport_rows = numFullViewportLines();
+        const std::size_t rows = rowsToCurrentLineEnd(viewport_rows + step);
+        if (rows > viewport_rows) {
+            scrollRows(std::min<std::size_t>(step, rows - viewport_rows));
+            return true;
+        }
+    }
     bool changed = false;
-    if (current_line_ + 1 < lines_.size()) {
-        current_line_ = std::min(current_line_ + step, lines_.size() - 1);
+    if (current_line_ + 1 < numLines()) {
+        current_line_ = std::min(current_line_ + step, numLines() - 1);
         changed = true;
     }
-    const int max_first_line = maxFirstLine();
-    if (current_line_ > first_line_ + numFullViewportLines() - 1) {
-        first_line_ = std::min(
-            static_cast<int>(current_line_ - numFullViewportLines() + 1),
-            max_first_line);
-    }
+    scrollToCurrentLine();
     return changed;
 }
 
+bool TextViewer::pageUp()
+{
+    const std::size_t page = std::max(1, numFullViewportLines() - 1);
+    if (!wrapping_ || current_line_ == 0) return moveUp(page);
+    if (current_line_ == first_line_ && first_row_ > 0) return moveUp(page);
+    // Moves to the line a page of rows above the current one.
+    const std::size_t row = wrap_layout_.firstRow(current_line_);
+    std::size_t row_in_line;
+    const std::size_t line = wrap_layout_.lineAt(
+        row > page ? row - page : 0, &row_in_line);
+    return moveUp(std::max<std::size_t>(current_line_ - line, 1));
+}
+
+bool TextViewer::pageDown()
+{
+    const std::size_t page = std::max(1, numFullViewportLines() - 1);
+    if (!wrapping_ || numLines() == 0) return moveDown(page);
+    const std::size_t viewport_rows = numFullViewportLines();
+    if (rowsToCurrentLineEnd(viewport_rows + 1) > viewport_rows)
+        return moveDown(page);
+    // Moves to the line a page of rows below the current one.
+    std::size_t row_in_line;
+    const std::size_t line = wrap_layout_.lineAt(
+        wrap_layout_.firstRow(current_line_) + page, &row_in_line);
+    return moveDown(line > current_line_ ? line - current_line_ : 1);
+}
+
+void TextViewer::scrollToCurrentLine()
+{
+    if (!wrapping_) {
+        if (current_line_ < first_line_) first_line_ = current_line_;
+        if (current_line_ > first_line_ + numFullViewportLines() - 1) {
+            first_line_ = std::min(
+                static_cast<int>(current_line_ - numFullViewportLines() + 1),
+                maxFirstLine());
+        }
+        return;
+    }
+    if (numLines() == 0) return;
+    if (current_line_ <= first_line_) {
+        if (current_line_ < first_line_ || first_row_ > 0) {
+            first_line_ = current_line_;
+            first_row_ = 0;
+        }
+        return;
+    }
+    const std::size_t viewport_rows = numFullViewportLines();
+    if (rowsToCurrentLineEnd(viewport_rows + 1) <= viewport_rows) return;
+    // Shows the end of the current line at the bottom of the viewport, or
+    // its start at the top if it does not fit.
+    std::size_t line = current_line_;
+    std::size_t remaining = viewport_rows;
+    while (wrappedRows(line) < remaining && line > 0) {
+        remaining -= wrappedRows(line);
+        --line;
+    }
+    first_line_ = line;
+    first_row_ = line != current_line_ && wrappedRows(line) > remaining
+        ? wrappedRows(line) - remaining
+        : 0;
+}
+
 bool TextViewer::moveLeft()
 {
+    if (wrapping_) return false;
     if (clip_.x > 0) {
         if (clip_.x > VIEWER_X_STEP_PHYS) {
             clip_.x -= VIEWER_X_STEP_PHYS;
@@ -312,13 +841,26 @@ bool TextViewer::moveLeft()
 
 bool TextViewer::moveRight()
 {
+    if (wrapping_) return false;
     clip_.x += VIEWER_X_STEP_PHYS;
     return true;
 }
 
 bool TextViewer::editLine()
 {
-    std::string title = lines_for_display_[current_line_];
+    if (current_line_ >= numLines()) return false;
+    if (file_->compressed()) {
+        ErrorDialog("Unable to edit file", "Compressed files are read-only");
+        return true;
+    }
+    if (file_->encoding() != TextEncoding::UTF8) {
+        // Edited lines are UTF-8, and would be saved among lines in the
+        // original encoding.
+        ErrorDialog("Unable to edit file", "Only UTF-8 files can be edited");
+        return true;
+    }
+    std::string title = line(current_line_);
+    adjustLineForDisplay(&title);
     constexpr std::size_t kMaxTitleLen = 60;
     if (title.size() > kMaxTitleLen) {
         std::size_t len = kMaxTitleLen - 3;
@@ -330,66 +872,80 @@ bool TextViewer::editLine()
     }
     title = "Line " + std::to_string(current_line_ + 1) + ": " + title;
     CDialog dialog { title };
+    // Each option creates the edit buffer first.
+    const auto edit = [this](std::function<void()> action) {
+        return [this, action]() {
+            startEditing();
+            action();
+            scheduleSave();
+            if (wrapping_) {
+                first_line_ = std::min(first_line_, numLines() - 1);
+                first_row_ = 0;
+                scrollToCurrentLine();
+            }
+            return true;
+        };
+    };
     dialog.addLabel("Saved automatically");
     std::vector<std::function<bool()>> handlers;
 
     dialog.addOption("Edit line");
     handlers.push_back([&]() {
-        CKeyboard keyboard(lines_[current_line_], /*support_tabs=*/true);
-        if (keyboard.execute() == 1
-            && keyboard.getInputText() != lines_[current_line_]) {
-            lines_for_display_[current_line_] = lines_[current_line_]
-                = keyboard.getInputText();
-            adjustLineForDisplay(&lines_for_display_[current_line_]);
-            saveFile();
+        startEditing();
+        const std::string text = buffer_->line(current_line_, kFullLine);
+        CKeyboard keyboard(text, /*support_tabs=*/true);
+        if (keyboard.execute() == 1 && keyboard.getInputText() != text) {
+            buffer_->replaceLine(current_line_, keyboard.getInputText());
+            if (highlighter_ != nullptr)
+                highlighter_->invalidate(current_line_);
+            if (wrapping_) {
+                wrap_layout_.invalidate(current_line_);
+                scrollToCurrentLine();
+            }
+            scheduleSave();
         }
         return true;
     });
 
     dialog.addOption("Duplicate line");
-    handlers.push_back([&]() {
-        lines_.emplace(
-            lines_.begin() + current_line_ + 1, lines_[current_line_]);
-        lines_for_display_.emplace(
-            lines_for_display_.begin() + current_line_ + 1,
-            lines_for_display_[current_line_]);
+    handlers.push_back(edit([this]() {
+        buffer_->insertLine(
+            current_line_ + 1, buffer_->line(current_line_, kFullLine));
+        if (highlighter_ != nullptr)
+            highlighter_->invalidate(current_line_ + 1);
+        if (wrapping_) wrap_layout_.insertLine(current_line_ + 1);
         if (first_line_ < maxFirstLine()) ++first_line_;
-        saveFile();
-        return true;
-    });
+    }));
 
     dialog.addOption("Insert line before");
-    handlers.push_back([&]() {
-        lines_.emplace(lines_.begin() + current_line_);
-        lines_for_display_.emplace(lines_for_display_.begin() + current_line_);
+    handlers.push_back(edit([this]() {
+        buffer_->insertLine(current_line_, {});
+        if (highlighter_ != nullptr) highlighter_->invalidate(current_line_);
+        if (wrapping_) wrap_layout_.insertLine(current_line_);
         ++current_line_;
         if (current_line_ == first_line_) --first_line_;
-        saveFile();
-        return true;
-    });
+    }));
 
     dialog.addOption("Insert line after");
-    handlers.push_back([&]() {
-        lines_.emplace(lines_.begin() + current_line_ + 1);
-        lines_for_display_.emplace(
-            lines_for_display_.begin() + current_line_ + 1);
+    handlers.push_back(edit([this]() {
+        buffer_->insertLine(current_line_ + 1, {});
+        if (highlighter_ != nullptr)
+            highlighter_->invalidate(current_line_ + 1);
+        if (wrapping_) wrap_layout_.insertLine(current_line_ + 1);
         if (first_line_ < maxFirstLine()) ++first_line_;
-        saveFile();
-        return true;
-    });
+    }));
 
     dialog.addOption("Remove line");
-    handlers.push_back([&]() {
-        lines_.erase(lines_.begin() + current_line_);
-        lines_for_display_.erase(lines_for_display_.begin() + current_line_);
-        if (lines_.empty()) {
-            lines_.emplace_back();
-            lines_for_display_.emplace_back();
+    handlers.push_back(edit([this]() {
+        buffer_->eraseLine(current_line_);
+        if (highlighter_ != nullptr) highlighter_->invalidate(current_line_);
+        if (wrapping_) wrap_layout_.eraseLine(current_line_);
+        if (buffer_->numLines() == 0) {
+            buffer_->insertLine(0, {});
+            if (wrapping_) wrap_layout_.insertLine(0);
         }
-        if (current_line_ == lines_.size()) --current_line_;
-        saveFile();
-        return true;
-    });
+        if (current_line_ == buffer_->numLines()) --current_line_;
+    }));
 
     dialog.init();
     int dialog_result = dialog.execute();
@@ -398,8 +954,20 @@ bool TextViewer::editLine()
     return true;
 }
 
+void TextViewer::scheduleSave()
+{
+    save_pending_ = true;
+    save_at_ = SDL_GetTicks() + kSaveDelayMs;
+}
+
 void TextViewer::saveFile()
 {
-    std::ofstream out(filename_, std::ofstream::trunc);
-    for (const auto &line : lines_) out << line << "\n";
+    save_pending_ = false;
+    if (!buffer_->save(filename_)) {
+        ErrorDialog(
+            "Unable to save file", filename_ + "\n" + std::strerror(errno));
+        return;
+    }
+    // The search reads the file, so it is restarted once it is written.
+    restartSearch();
 }
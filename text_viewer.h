@@ -1,20 +1,32 @@
 #ifndef TEXT_VIEWER_H_
 #define TEXT_VIEWER_H_
 
+#include <cstddef>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "sdl_ptrs.h"
 #include "sdl_ttf_multifont.h"
+#include "syntax_highlighter.h"
+#include "text_buffer.h"
+#include "text_file.h"
+#include "text_line_cache.h"
+#include "text_search.h"
 #include "window.h"
+#include "wrap_layout.h"
 
 class TextViewer : public CWindow {
   public:
     explicit TextViewer(std::string filename);
-    virtual ~TextViewer() = default;
+    virtual ~TextViewer();
 
     TextViewer(const TextViewer &) = delete;
     TextViewer &operator=(const TextViewer &) = delete;
 
+    // False if the file could not be opened, an error having been shown.
+    bool ok() const { return file_ != nullptr; }
+
   private:
     void init();
 
@@ -31,25 +43,80 @@ class TextViewer : public CWindow {
     void onResize() override;
     bool isFullScreen() const override { return true; }
 
-    // Returns the viewport line index at the given coordinates or -1.
+    // Returns the index of the line at the given coordinates or -1.
     int getLineAt(int x, int y) const;
     int maxFirstLine() const;
 
+    // Picks up the lines indexed in the background.
+    // Returns true if the visible lines have changed.
+    bool collectLines();
+
+    // Follow mode: shows new lines as they are appended to the file.
+    bool toggleFollow();
+
+    // Word wrap:
+    bool toggleWrap();
+    // The number of rows of the line, measuring it if it has not been yet.
+    std::size_t wrappedRows(std::size_t line) const;
+    // The byte offsets at which the rows of the display line start.
+    std::vector<std::size_t> wrapLine(const std::string &line) const;
+    void renderWrapped() const;
+    // Scrolls the view by rows, leaving the current line as it is.
+    void scrollRows(std::ptrdiff_t delta);
+    // The rows from the top of the viewport to the end of the current line,
+    // counting no further than `limit`.
+    std::size_t rowsToCurrentLineEnd(std::size_t limit) const;
+
+    bool openMenu();
+    // Search:
+    bool startSearch(bool regex);
+    // Restarts the search after the file has changed.
+    void restartSearch();
+    // Picks up the matches found in the background.
+    // Returns true if the view has changed.
+    bool collectMatches();
+    // Moves to the next (`direction` > 0) or previous match, wrapping around
+    // once the whole file has been searched. If the match has not been found
+    // yet, moves to it once it is.
+    bool jumpToMatch(int direction, bool include_current = false);
+    bool jumpToLine(std::size_t line);
+    // Highlights the matches in the given raw line that are within the
+    // display bytes [begin, end), drawn at `y` with `key`.
+    void renderMatches(const TextLineCache::Key &key, const std::string &line,
+        std::size_t begin, std::size_t end, int scroll_x, int y) const;
+    void renderMatchCounter() const;
+    // The colored spans of the line at `index`, which is given before its
+    // tabs are expanded, by offsets in the expanded line.
+    std::vector<TextLineCache::Span> syntaxSpans(
+        std::size_t index, const std::string &raw_line) const;
+
+    std::size_t numLines() const;
+    std::string line(std::size_t index) const;
+
+    // Creates the edit buffer on the first edit.
+    void startEditing();
+
     // Scroll:
     bool moveUp(unsigned step);
     bool moveDown(unsigned step);
+    bool pageUp();
+    bool pageDown();
+    // Scrolls so that the current line is visible.
+    void scrollToCurrentLine();
     bool moveLeft();
     bool moveRight();
 
     // Open line editing dialog for the currently highlighted line.
     bool editLine();
+    // Edits are saved once there have been none for a while.
+    void scheduleSave();
     void saveFile();
 
     const Fonts &fonts_;
     std::string filename_;
     SDLSurfaceUniquePtr background_;
-    SDLSurfaceUniquePtr image_;
     SDL_Rect clip_;
+    mutable TextLineCache line_cache_;
 
     // Colors:
     std::uint32_t border_color_;
@@ -57,12 +124,28 @@ class TextViewer : public CWindow {
     SDL_Color sdl_bg_color_;
     std::uint32_t highlight_color_;
     SDL_Color sdl_highlight_color_;
+    SDL_Color sdl_match_color_;
 
     // Text mode:
-    std::vector<std::string> lines_;
-    std::vector<std::string> lines_for_display_;
+    std::unique_ptr<TextFile> file_;
+    // The edited lines, once the file has been edited.
+    std::unique_ptr<TextBuffer> buffer_;
+    bool save_pending_ = false;
+    std::uint32_t save_at_ = 0;
+    std::unique_ptr<TextSearch> search_;
+    // For the file types that have one.
+    std::unique_ptr<SyntaxHighlighter> highlighter_;
+    // A jump to a match that has not been found yet, see `jumpToMatch`.
+    int pending_jump_ = 0;
+    bool pending_jump_include_current_ = false;
     std::size_t first_line_;
     std::size_t current_line_;
+
+    // Word wrap mode, with the rows of the lines measured so far.
+    bool wrapping_ = false;
+    mutable WrapLayout wrap_layout_;
+    // The first visible row of `first_line_` when wrapping.
+    std::size_t first_row_ = 0;
 };
 
 #endif // TEXT_VIEWER_H_
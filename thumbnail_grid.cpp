@@ -0,0 +1,254 @@
+#include "thumbnail_grid.h"
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+#include "def.h"
+#include "image_scaler.h"
+#include "screen.h"
+#include "sdlutils.h"
+#include "thumbnails.h"
+
+namespace {
+
+// Tiles are square and at least this large, in logical pixels.
+constexpr int kMinTileSize = 56;
+constexpr int kTilePadding = 2;
+
+// Decoding is mostly CPU-bound, but reading the originals from a slow SD
+// card also benefits from a few threads.
+std::size_t numThumbnailThreads()
+{
+    const unsigned num_cores = std::thread::hardware_concurrency();
+    return std::max(1u, std::min(num_cores, 4u));
+}
+
+} // namespace
+
+void ThumbnailGrid::open(std::vector<Image> images, int selected_panel_index)
+{
+    close();
+    if (thumbnailer_ == nullptr)
+        thumbnailer_ = std::unique_ptr<WorkerPool> { new WorkerPool(
+            numThumbnailThreads()) };
+    items_.reserve(images.size());
+    for (Image &image : images) {
+        if (image.panel_index == selected_panel_index)
+            selected_ = items_.size();
+        items_.push_back(Item { std::move(image), TileState::NONE, nullptr });
+    }
+    layout();
+    scrollToSelection();
+    requestTiles();
+}
+
+void ThumbnailGrid::close()
+{
+    if (thumbnailer_ != nullptr) thumbnailer_->clearPending();
+    ++generation_;
+    items_.clear();
+    selected_ = 0;
+    first_row_ = 0;
+    std::lock_guard<std::mutex> lock(results_mutex_);
+    results_.clear();
+    keep_begin_ = keep_end_ = 0;
+}
+
+void ThumbnailGrid::onResize()
+{
+    if (thumbnailer_ != nullptr) thumbnailer_->clearPending();
+    ++generation_;
+    for (Item &item : items_) {
+        item.state = TileState::NONE;
+        item.tile = nullptr;
+    }
+    layout();
+    scrollToSelection();
+    requestTiles();
+}
+
+void ThumbnailGrid::layout()
+{
+    columns_ = std::max(1, screen.w / kMinTileSize);
+    const int tile_size = screen.w / columns_;
+    tile_w_ = std::max(1, static_cast<int>(tile_size * screen.ppu_x));
+    tile_h_ = std::max(1, static_cast<int>(tile_size * screen.ppu_y));
+    padding_x_ = static_cast<int>(kTilePadding * screen.ppu_x);
+    padding_y_ = static_cast<int>(kTilePadding * screen.ppu_y);
+    const int available_h = screen.actual_h - HEADER_H_PHYS;
+    rows_ = std::max(1, available_h / tile_h_);
+    top_ = HEADER_H_PHYS + std::max(0, (available_h - rows_ * tile_h_) / 2);
+}
+
+bool ThumbnailGrid::scrollToSelection()
+{
+    const int old_first_row = first_row_;
+    const int row = static_cast<int>(selected_) / columns_;
+    if (row < first_row_)
+        first_row_ = row;
+    else if (row >= first_row_ + rows_)
+        first_row_ = row - rows_ + 1;
+    const int num_rows
+        = (static_cast<int>(items_.size()) + columns_ - 1) / columns_;
+    first_row_ = std::max(0, std::min(first_row_, num_rows - rows_));
+    return first_row_ != old_first_row;
+}
+
+void ThumbnailGrid::requestTiles()
+{
+    const std::size_t page = static_cast<std::size_t>(columns_) * rows_;
+    const std::size_t first_visible
+        = static_cast<std::size_t>(first_row_) * columns_;
+    const std::size_t end_visible
+        = std::min(items_.size(), first_visible + page);
+    // Keep a page of tiles before and after the visible ones.
+    const std::size_t keep_begin
+        = first_visible >= page ? first_visible - page : 0;
+    const std::size_t keep_end = std::min(items_.size(), end_visible + page);
+
+    // The queued requests for the tiles that are dropped here are skipped
+    // by the worker threads, and the others are still wanted.
+    {
+        std::lock_guard<std::mutex> lock(results_mutex_);
+        keep_begin_ = keep_begin;
+        keep_end_ = keep_end;
+    }
+    for (std::size_t i = 0; i < items_.size(); ++i) {
+        if (i >= keep_begin && i < keep_end) continue;
+        items_[i].state = TileState::NONE;
+        items_[i].tile = nullptr;
+    }
+
+    // Visible tiles first, then the next page, then the previous one.
+    for (std::size_t i = first_visible; i < end_visible; ++i) requestTile(i);
+    for (std::size_t i = end_visible; i < keep_end; ++i) requestTile(i);
+    for (std::size_t i = first_visible; i-- > keep_begin;) requestTile(i);
+}
+
+void ThumbnailGrid::requestTile(std::size_t index)
+{
+    Item &item = items_[index];
+    if (item.state != TileState::NONE) return;
+    item.state = TileState::PENDING;
+    const unsigned generation = generation_;
+    const std::string path = item.image.path;
+    const int max_w = std::max(1, tile_w_ - 2 * padding_x_);
+    const int max_h = std::max(1, tile_h_ - 2 * padding_y_);
+    thumbnailer_->enqueue([this, index, generation, path, max_w, max_h]() {
+        {
+            std::lock_guard<std::mutex> lock(results_mutex_);
+            if (index < keep_begin_ || index >= keep_end_) return;
+        }
+        SDLSurfaceUniquePtr tile
+            = Image_utils::loadThumbnail(path, std::max(max_w, max_h));
+        if (tile != nullptr) {
+            // Fit the tile, but never enlarge small images.
+            const double scale = std::min(1.0,
+                std::min(static_cast<double>(max_w) / tile->w,
+                    static_cast<double>(max_h) / tile->h));
+            const int w = std::max(1, static_cast<int>(tile->w * scale));
+            const int h = std::max(1, static_cast<int>(tile->h * scale));
+            if (w != tile->w || h != tile->h) {
+                SDLSurfaceUniquePtr scaled = Image_utils::scale(
+                    tile.get(), w, h, Image_utils::PixelLayout::rgba32());
+                if (scaled != nullptr) tile = std::move(scaled);
+            }
+        }
+        std::lock_guard<std::mutex> lock(results_mutex_);
+        results_.push_back(Result { index, generation, std::move(tile) });
+    });
+}
+
+bool ThumbnailGrid::collectThumbnails()
+{
+    std::vector<Result> results;
+    {
+        std::lock_guard<std::mutex> lock(results_mutex_);
+        results.swap(results_);
+    }
+    const std::size_t first_visible
+        = static_cast<std::size_t>(first_row_) * columns_;
+    const std::size_t end_visible = first_visible
+        + static_cast<std::size_t>(columns_) * rows_;
+    bool changed = false;
+    for (Result &result : results) {
+        // Tiles that have left the kept range while being generated are
+        // discarded, as they were freed.
+        if (result.generation != generation_ || result.index < keep_begin_
+            || result.index >= keep_end_)
+            continue;
+        Item &item = items_[result.index];
+        item.state = TileState::DONE;
+        item.tile = SDLSurfaceSharedPtr {
+            SDL_utils::convertImageToDisplayFormat(
+                std::move(result.tile), item.image.path)
+        };
+        if (result.index >= first_visible && result.index < end_visible)
+            changed = true;
+    }
+    return changed;
+}
+
+bool ThumbnailGrid::moveSelection(int delta)
+{
+    if (items_.empty()) return false;
+    const long last = static_cast<long>(items_.size()) - 1;
+    const std::size_t selected = static_cast<std::size_t>(
+        std::max(0L, std::min(last, static_cast<long>(selected_) + delta)));
+    if (selected == selected_) return false;
+    selected_ = selected;
+    if (scrollToSelection()) requestTiles();
+    return true;
+}
+
+int ThumbnailGrid::selectedPanelIndex() const
+{
+    return items_.empty() ? -1 : items_[selected_].image.panel_index;
+}
+
+const std::string &ThumbnailGrid::selectedPath() const
+{
+    static const std::string kEmpty;
+    return items_.empty() ? kEmpty : items_[selected_].image.path;
+}
+
+void ThumbnailGrid::render() const
+{
+    SDL_Rect area = SDL_utils::makeRect(0, HEADER_H_PHYS, screen.actual_w,
+        screen.actual_h - HEADER_H_PHYS);
+    SDL_FillRect(screen.surface, &area,
+        SDL_MapRGB(screen.surface->format, COLOR_BG_1));
+    const Uint32 cursor_color
+        = SDL_MapRGB(screen.surface->format, COLOR_CURSOR_1);
+    const Uint32 placeholder_color
+        = SDL_MapRGB(screen.surface->format, COLOR_BG_2);
+
+    const int left = (screen.actual_w - columns_ * tile_w_) / 2;
+    for (int row = 0; row < rows_; ++row) {
+        for (int column = 0; column < columns_; ++column) {
+            const std::size_t index
+                = static_cast<std::size_t>(first_row_ + row) * columns_
+                + column;
+            if (index >= items_.size()) return;
+            const Item &item = items_[index];
+            const int x = left + column * tile_w_;
+            const int y = top_ + row * tile_h_;
+            if (index == selected_) {
+                SDL_Rect rect = SDL_utils::makeRect(x, y, tile_w_, tile_h_);
+                SDL_FillRect(screen.surface, &rect, cursor_color);
+            }
+            if (item.tile != nullptr) {
+                SDL_utils::applyPpuScaledSurface(
+                    x + (tile_w_ - item.tile->w) / 2,
+                    y + (tile_h_ - item.tile->h) / 2, item.tile.get(),
+                    screen.surface);
+            } else if (item.state != TileState::DONE) {
+                SDL_Rect rect = SDL_utils::makeRect(x + padding_x_,
+                    y + padding_y_, tile_w_ - 2 * padding_x_,
+                    tile_h_ - 2 * padding_y_);
+                SDL_FillRect(screen.surface, &rect, placeholder_color);
+            }
+        }
+    }
+}
@@ -0,0 +1,121 @@
+#ifndef THUMBNAIL_GRID_H_
+#define THUMBNAIL_GRID_H_
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "sdl_ptrs.h"
+#include "worker_pool.h"
+
+/**
+ * @brief A scrollable grid of image thumbnails, used by the image viewer.
+ *
+ * Thumbnails are generated on a pool of worker threads (or read from the
+ * on-disk thumbnail cache), starting with the visible ones.
+ * Only the tiles near the visible ones are kept in memory.
+ */
+class ThumbnailGrid {
+  public:
+    struct Image {
+        // Index of the image in the panel.
+        int panel_index;
+        std::string path;
+    };
+
+    ThumbnailGrid() = default;
+
+    ThumbnailGrid(const ThumbnailGrid &) = delete;
+    ThumbnailGrid &operator=(const ThumbnailGrid &) = delete;
+
+    // Shows the given images and selects the one at the given panel index.
+    void open(std::vector<Image> images, int selected_panel_index);
+
+    // Stops generating thumbnails and frees them.
+    void close();
+
+    // Lays out the grid again for the current screen size.
+    void onResize();
+
+    // Draws the grid below the title bar.
+    void render() const;
+
+    // Moves the selection by the given number of tiles, stopping at the
+    // first and last ones. Returns false if the selection has not changed.
+    bool moveSelection(int delta);
+
+    int columns() const { return columns_; }
+    int rows() const { return rows_; }
+
+    // Picks up the thumbnails generated in the background.
+    // Returns true if any of them is visible.
+    bool collectThumbnails();
+
+    // Returns -1 if the grid is empty.
+    int selectedPanelIndex() const;
+
+    // Returns an empty string if the grid is empty.
+    const std::string &selectedPath() const;
+
+  private:
+    void layout();
+
+    // Scrolls so that the selection is visible.
+    // Returns true if the visible tiles have changed.
+    bool scrollToSelection();
+
+    // Frees the tiles that are far from the visible ones and requests the
+    // missing ones, visible ones first.
+    void requestTiles();
+
+    void requestTile(std::size_t index);
+
+    enum class TileState { NONE, PENDING, DONE };
+
+    struct Item {
+        Image image;
+        TileState state;
+        // Null if the thumbnail failed to decode or is not loaded yet.
+        SDLSurfaceSharedPtr tile;
+    };
+
+    std::vector<Item> items_;
+    std::size_t selected_ = 0;
+    int first_row_ = 0;
+
+    // Layout in physical pixels.
+    int columns_ = 1;
+    int rows_ = 1;
+    int tile_w_ = 1;
+    int tile_h_ = 1;
+    int padding_x_ = 0;
+    int padding_y_ = 0;
+    int top_ = 0;
+
+    // Results from the worker threads, guarded by `results_mutex_`.
+    struct Result {
+        std::size_t index;
+        unsigned generation;
+        SDLSurfaceUniquePtr tile;
+    };
+    std::mutex results_mutex_;
+    std::vector<Result> results_;
+
+    // The tiles kept in memory, from `requestTiles`.
+    // Written under `results_mutex_`, as the worker threads skip the queued
+    // requests outside of it.
+    std::size_t keep_begin_ = 0;
+    std::size_t keep_end_ = 0;
+
+    // Incremented to discard the results of stale requests,
+    // e.g. after a resize.
+    unsigned generation_ = 0;
+
+    // Started on the first `open`, as the grid is rarely shown.
+    // Must be destroyed first because its tasks refer to the members above.
+    std::unique_ptr<WorkerPool> thumbnailer_;
+};
+
+#endif // THUMBNAIL_GRID_H_
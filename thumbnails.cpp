@@ -0,0 +1,415 @@
+#include "thumbnails.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <SDL.h>
+
+#include "image_scaler.h"
+#include "imageutils.h"
+#include "sdlutils.h"
+
+#ifdef HAVE_LIBPNG
+#include <cerrno>
+#include <png.h>
+#endif
+
+namespace Image_utils {
+
+namespace {
+
+// Uses the thumbnail embedded in a JPEG's EXIF data if it is large enough.
+SDLSurfaceUniquePtr decodeEmbeddedThumbnail(const std::string &p_path, int p_size)
+{
+    int orig_w, orig_h;
+    SDLSurfaceUniquePtr embedded = decodeExifThumbnail(p_path, &orig_w, &orig_h);
+    if (embedded == nullptr) return nullptr;
+    const double scale_factor = std::min(1.0,
+        std::min(static_cast<double>(p_size) / orig_w,
+            static_cast<double>(p_size) / orig_h));
+    const int w = std::max(1, static_cast<int>(orig_w * scale_factor));
+    const int h = std::max(1, static_cast<int>(orig_h * scale_factor));
+    if (embedded->w < w || embedded->h < h) return nullptr;
+    return scale(embedded.get(), w, h, PixelLayout::rgba32());
+}
+
+#ifdef HAVE_LIBPNG
+
+constexpr char kSoftware[] = "DinguxCommander";
+
+// Thumbnails larger than this are not ours to read.
+constexpr png_uint_32 kMaxThumbnailSize = 2 * kLargeThumbnailSize;
+
+struct FileCloser
+{
+    void operator()(std::FILE *file) const { std::fclose(file); }
+};
+using FileUniquePtr = std::unique_ptr<std::FILE, FileCloser>;
+
+// MD5 (RFC 1321), only used to name the thumbnail files.
+std::string md5Hex(const std::string &p_data)
+{
+    static const std::uint32_t kK[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf,
+        0x4787c62a, 0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af,
+        0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e,
+        0x49b40821, 0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+        0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8, 0x21e1cde6,
+        0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+        0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122,
+        0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039,
+        0xe6db99e5, 0x1fa27cf8, 0xc4ac5665, 0xf4292244, 0x432aff97,
+        0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d,
+        0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+        0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+    };
+    static const int kShift[16]
+        = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+
+    // Pad to a multiple of 64 bytes, ending with the bit length.
+    std::vector<unsigned char> msg(p_data.begin(), p_data.end());
+    const std::uint64_t bit_length = static_cast<std::uint64_t>(msg.size()) * 8;
+    msg.push_back(0x80);
+    while (msg.size() % 64 != 56) msg.push_back(0);
+    for (int i = 0; i < 8; ++i)
+        msg.push_back(static_cast<unsigned char>(bit_length >> (8 * i)));
+
+    std::uint32_t h[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    for (std::size_t offset = 0; offset < msg.size(); offset += 64) {
+        std::uint32_t m[16];
+        for (int i = 0; i < 16; ++i) {
+            const unsigned char *p = &msg[offset + 4 * i];
+            m[i] = p[0] | (p[1] << 8) | (p[2] << 16)
+                | (static_cast<std::uint32_t>(p[3]) << 24);
+        }
+        std::uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+        for (int i = 0; i < 64; ++i) {
+            std::uint32_t f;
+            int g;
+            if (i < 16) {
+                f = (b & c) | (~b & d);
+                g = i;
+            } else if (i < 32) {
+                f = (d & b) | (~d & c);
+                g = (5 * i + 1) % 16;
+            } else if (i < 48) {
+                f = b ^ c ^ d;
+                g = (3 * i + 5) % 16;
+            } else {
+                f = c ^ (b | ~d);
+                g = (7 * i) % 16;
+            }
+            const int s = kShift[(i / 16) * 4 + i % 4];
+            const std::uint32_t x = a + f + kK[i] + m[g];
+            a = d;
+            d = c;
+            c = b;
+            b += (x << s) | (x >> (32 - s));
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+    }
+
+    static const char kHex[] = "0123456789abcdef";
+    std::string result;
+    for (std::uint32_t word : h) {
+        for (int i = 0; i < 4; ++i) {
+            const unsigned char byte = word >> (8 * i);
+            result += kHex[byte >> 4];
+            result += kHex[byte & 0xF];
+        }
+    }
+    return result;
+}
+
+// Escapes the path the same way as GLib's g_filename_to_uri, so that the
+// thumbnails are shared with other applications.
+std::string fileUri(const std::string &p_path)
+{
+    static const char kHex[] = "0123456789ABCDEF";
+    std::string result = "file://";
+    for (const char ch : p_path) {
+        const unsigned char c = ch;
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+            || (c >= '0' && c <= '9') || std::strchr("-_.!~*'()/&=:@+$,", c)) {
+            result += ch;
+        } else {
+            result += '%';
+            result += kHex[c >> 4];
+            result += kHex[c & 0xF];
+        }
+    }
+    return result;
+}
+
+// $XDG_CACHE_HOME/thumbnails, or an empty string if there is no home.
+std::string thumbnailRoot()
+{
+    const char *cache_home = std::getenv("XDG_CACHE_HOME");
+    if (cache_home != nullptr && cache_home[0] == '/')
+        return std::string(cache_home) + "/thumbnails";
+    const char *home = std::getenv("HOME");
+    if (home != nullptr && home[0] == '/')
+        return std::string(home) + "/.cache/thumbnails";
+    return "";
+}
+
+// Like `mkdir -p`, with the permissions required by the standard.
+bool makeDirectories(const std::string &p_path)
+{
+    for (std::size_t pos = 1; pos != std::string::npos;) {
+        pos = p_path.find('/', pos + 1);
+        const std::string dir = p_path.substr(0, pos);
+        if (::mkdir(dir.c_str(), 0700) == -1 && errno != EEXIST) return false;
+    }
+    return true;
+}
+
+struct ThumbnailInfo
+{
+    std::string uri;
+    std::string mtime;
+    std::string size;
+};
+
+void pngError(png_structp p_png, png_const_charp p_msg)
+{
+    std::cerr << "loadThumbnail: " << p_msg << std::endl;
+    png_longjmp(p_png, 1);
+}
+
+void pngWarning(png_structp, png_const_charp) { }
+
+// State that must survive a longjmp lives on the heap.
+struct PngReadState
+{
+    png_structp png = nullptr;
+    png_infop info = nullptr;
+    SDLSurfaceUniquePtr surface;
+    std::vector<png_bytep> rows;
+
+    ~PngReadState() { png_destroy_read_struct(&png, info != nullptr ? &info : nullptr, nullptr); }
+};
+
+// Returns true if the thumbnail exists and is up to date.
+// Only validates the thumbnail if `p_surface` is nullptr.
+bool readThumbnail(const std::string &p_path, const ThumbnailInfo &p_info, SDLSurfaceUniquePtr *p_surface)
+{
+    FileUniquePtr file { std::fopen(p_path.c_str(), "rb") };
+    if (file == nullptr) return false;
+    unsigned char magic[8];
+    if (std::fread(magic, 1, sizeof(magic), file.get()) != sizeof(magic)
+        || png_sig_cmp(magic, 0, sizeof(magic)) != 0)
+        return false;
+
+    const std::unique_ptr<PngReadState> state { new PngReadState };
+    state->png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, pngError, pngWarning);
+    if (state->png == nullptr) return false;
+    state->info = png_create_info_struct(state->png);
+    if (state->info == nullptr) return false;
+    png_structp png = state->png;
+    png_infop info = state->info;
+    if (setjmp(png_jmpbuf(png))) return false;
+
+    png_init_io(png, file.get());
+    png_set_sig_bytes(png, sizeof(magic));
+    png_read_info(png, info);
+
+    png_textp text;
+    int num_text = 0;
+    png_get_text(png, info, &text, &num_text);
+    bool uri_matches = false, mtime_matches = false, size_matches = true;
+    for (int i = 0; i < num_text; ++i) {
+        const char *value = text[i].text != nullptr ? text[i].text : "";
+        if (std::strcmp(text[i].key, "Thumb::URI") == 0)
+            uri_matches = p_info.uri == value;
+        else if (std::strcmp(text[i].key, "Thumb::MTime") == 0)
+            mtime_matches = p_info.mtime == value;
+        else if (std::strcmp(text[i].key, "Thumb::Size") == 0)
+            size_matches = p_info.size == value;
+    }
+    if (!uri_matches || !mtime_matches || !size_matches) return false;
+    if (p_surface == nullptr) return true;
+
+    const png_uint_32 width = png_get_image_width(png, info);
+    const png_uint_32 height = png_get_image_height(png, info);
+    if (width > kMaxThumbnailSize || height > kMaxThumbnailSize) return false;
+
+    // Normalize to 8-bit RGBA.
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_gray_to_rgb(png);
+    png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
+    png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+
+    const PixelLayout layout = PixelLayout::rgba32();
+    state->surface = SDLSurfaceUniquePtr { SDL_CreateRGBSurface(SDL_SWSURFACE,
+        width, height, 32, layout.rmask, layout.gmask, layout.bmask,
+        layout.amask) };
+    if (state->surface == nullptr) return false;
+    for (png_uint_32 y = 0; y < height; ++y) {
+        state->rows.push_back(static_cast<png_bytep>(state->surface->pixels)
+            + y * state->surface->pitch);
+    }
+    png_read_image(png, state->rows.data());
+    *p_surface = std::move(state->surface);
+    return true;
+}
+
+struct PngWriteState
+{
+    png_structp png = nullptr;
+    png_infop info = nullptr;
+    std::vector<png_text> text;
+
+    ~PngWriteState() { png_destroy_write_struct(&png, info != nullptr ? &info : nullptr); }
+};
+
+bool writePng(std::FILE *p_file, SDL_Surface *p_surface, const ThumbnailInfo &p_info)
+{
+    const std::unique_ptr<PngWriteState> state { new PngWriteState };
+    state->png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, pngError, pngWarning);
+    if (state->png == nullptr) return false;
+    state->info = png_create_info_struct(state->png);
+    if (state->info == nullptr) return false;
+    png_structp png = state->png;
+    png_infop info = state->info;
+    if (setjmp(png_jmpbuf(png))) return false;
+
+    png_init_io(png, p_file);
+    png_set_IHDR(png, info, p_surface->w, p_surface->h, 8,
+        PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
+        PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    const std::pair<const char *, const std::string *> entries[] = {
+        { "Thumb::URI", &p_info.uri },
+        { "Thumb::MTime", &p_info.mtime },
+        { "Thumb::Size", &p_info.size },
+    };
+    for (const auto &entry : entries) {
+        png_text text;
+        std::memset(&text, 0, sizeof(text));
+        text.compression = PNG_TEXT_COMPRESSION_NONE;
+        text.key = const_cast<png_charp>(entry.first);
+        text.text = const_cast<png_charp>(entry.second->c_str());
+        state->text.push_back(text);
+    }
+    png_text software;
+    std::memset(&software, 0, sizeof(software));
+    software.compression = PNG_TEXT_COMPRESSION_NONE;
+    software.key = const_cast<png_charp>("Software");
+    software.text = const_cast<png_charp>(kSoftware);
+    state->text.push_back(software);
+    png_set_text(png, info, state->text.data(), state->text.size());
+
+    png_write_info(png, info);
+    for (int y = 0; y < p_surface->h; ++y) {
+        png_write_row(png, static_cast<png_bytep>(p_surface->pixels)
+            + y * p_surface->pitch);
+    }
+    png_write_end(png, nullptr);
+    return true;
+}
+
+// Writes to a temporary file first so that other processes never see a
+// partially written thumbnail.
+void saveThumbnail(const std::string &p_dir, const std::string &p_path, SDL_Surface *p_surface, const ThumbnailInfo &p_info)
+{
+    if (!makeDirectories(p_dir)) return;
+    const std::string tmpl = p_dir + "/commander-XXXXXX";
+    std::vector<char> tmp_path(tmpl.begin(), tmpl.end());
+    tmp_path.push_back('\0');
+    const int fd = ::mkstemp(tmp_path.data());
+    if (fd == -1) return;
+    std::FILE *file = ::fdopen(fd, "wb");
+    if (file == nullptr) {
+        ::close(fd);
+        ::unlink(tmp_path.data());
+        return;
+    }
+    const bool ok = writePng(file, p_surface, p_info);
+    if (std::fclose(file) != 0 || !ok
+        || std::rename(tmp_path.data(), p_path.c_str()) != 0) {
+        ::unlink(tmp_path.data());
+    }
+}
+
+#endif // HAVE_LIBPNG
+
+} // namespace
+
+SDLSurfaceUniquePtr loadThumbnail(const std::string &p_path, int p_size)
+{
+    const int thumbnail_size = p_size <= kNormalThumbnailSize
+        ? kNormalThumbnailSize
+        : kLargeThumbnailSize;
+#ifdef HAVE_LIBPNG
+    struct stat st;
+    if (::stat(p_path.c_str(), &st) == -1) return nullptr;
+    const std::string root = thumbnailRoot();
+    // Never thumbnail the thumbnails.
+    const bool cacheable = !root.empty()
+        && p_path.compare(0, root.size() + 1, root + "/") != 0;
+    ThumbnailInfo info;
+    std::string name, thumbnail_dir, fail_dir;
+    if (cacheable) {
+        info.uri = fileUri(p_path);
+        info.mtime = std::to_string(static_cast<long long>(st.st_mtime));
+        info.size = std::to_string(static_cast<long long>(st.st_size));
+        name = "/" + md5Hex(info.uri) + ".png";
+        thumbnail_dir = root
+            + (thumbnail_size == kNormalThumbnailSize ? "/normal" : "/large");
+        fail_dir = root + "/fail/" + kSoftware;
+
+        SDLSurfaceUniquePtr thumbnail;
+        if (readThumbnail(thumbnail_dir + name, info, &thumbnail))
+            return thumbnail;
+        if (readThumbnail(fail_dir + name, info, nullptr)) return nullptr;
+    }
+#endif
+
+    const PixelLayout layout = PixelLayout::rgba32();
+    SDLSurfaceUniquePtr thumbnail = decodeEmbeddedThumbnail(p_path, thumbnail_size);
+    if (thumbnail == nullptr) {
+        thumbnail = SDL_utils::decodeImageToFit(
+            p_path, thumbnail_size, thumbnail_size, 1.0f, 1.0f, layout);
+    }
+    if (thumbnail != nullptr && !layout.matches(thumbnail->format)) {
+        thumbnail = scale(thumbnail.get(), thumbnail->w, thumbnail->h, layout);
+    }
+
+#ifdef HAVE_LIBPNG
+    if (cacheable) {
+        if (thumbnail != nullptr) {
+            saveThumbnail(thumbnail_dir, thumbnail_dir + name, thumbnail.get(), info);
+        } else {
+            // The standard asks for an empty PNG with the same metadata.
+            SDLSurfaceUniquePtr empty { SDL_CreateRGBSurface(SDL_SWSURFACE,
+                1, 1, 32, layout.rmask, layout.gmask, layout.bmask,
+                layout.amask) };
+            if (empty != nullptr) {
+                SDL_FillRect(empty.get(), nullptr, 0);
+                saveThumbnail(fail_dir, fail_dir + name, empty.get(), info);
+            }
+        }
+    }
+#endif
+    return thumbnail;
+}
+
+} // namespace Image_utils
@@ -0,0 +1,32 @@
+#ifndef THUMBNAILS_H_
+#define THUMBNAILS_H_
+
+#include <string>
+
+#include "sdl_ptrs.h"
+
+namespace Image_utils
+{
+    // Sizes of the freedesktop.org "normal" and "large" thumbnails.
+    constexpr int kNormalThumbnailSize = 128;
+    constexpr int kLargeThumbnailSize = 256;
+
+    // Returns a thumbnail of the image that fits in a square of the
+    // smallest freedesktop.org thumbnail size that is at least `p_size`.
+    // Images are never enlarged.
+    //
+    // Thumbnails are shared with other applications through
+    // $XDG_CACHE_HOME/thumbnails/, following the freedesktop.org Thumbnail
+    // Managing Standard: they are keyed by the file URI and validated against
+    // the file's mtime and size. Images that fail to decode are recorded in
+    // the "fail" directory so that they are not decoded again.
+    //
+    // The result is a 32-bit RGBA surface, or nullptr if the image could not
+    // be decoded. Without libpng thumbnails are always decoded from the
+    // original image.
+    //
+    // Can be called from any thread.
+    SDLSurfaceUniquePtr loadThumbnail(const std::string &p_path, int p_size);
+}
+
+#endif // THUMBNAILS_H_
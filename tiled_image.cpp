@@ -0,0 +1,291 @@
+#include "tiled_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#include "imageutils.h"
+#include "sdlutils.h"
+
+constexpr int TiledImage::kTileSize;
+
+namespace {
+
+SDLSurfaceUniquePtr createSurface(
+    int w, int h, const Image_utils::PixelLayout &layout)
+{
+    return SDLSurfaceUniquePtr { SDL_CreateRGBSurface(SDL_SWSURFACE, w, h,
+        layout.bpp, layout.rmask, layout.gmask, layout.bmask, layout.amask) };
+}
+
+// A surface that refers to a part of another surface's pixels.
+SDLSurfaceUniquePtr createView(SDL_Surface *surface, int x, int y, int w,
+    int h, const Image_utils::PixelLayout &layout)
+{
+    const int bytes_per_pixel = layout.bpp / 8;
+    return SDLSurfaceUniquePtr { SDL_CreateRGBSurfaceFrom(
+        static_cast<Uint8 *>(surface->pixels)
+            + static_cast<std::size_t>(y) * surface->pitch
+            + x * bytes_per_pixel,
+        w, h, layout.bpp, surface->pitch, layout.rmask, layout.gmask,
+        layout.bmask, layout.amask) };
+}
+
+} // namespace
+
+// Cuts the decoded rows into tiles, a strip of `kTileSize` rows at a time.
+class TiledImage::LevelBuilder : public Image_utils::RowSink {
+  public:
+    explicit LevelBuilder(const Image_utils::PixelLayout &layout)
+        : layout_(layout)
+    {
+    }
+
+    bool begin(int w, int h) override
+    {
+        level_ = Level { w, h, (w + kTileSize - 1) / kTileSize,
+            (h + kTileSize - 1) / kTileSize, {} };
+        level_.tiles.reserve(
+            static_cast<std::size_t>(level_.columns) * level_.rows);
+        strip_ = createSurface(w, kTileSize, Image_utils::PixelLayout::rgba32());
+        strip_y_ = 0;
+        y_ = 0;
+        ok_ = strip_ != nullptr;
+        return ok_;
+    }
+
+    void addRow(const unsigned char *rgba) override
+    {
+        if (!ok_ || y_ == level_.h) return;
+        std::memcpy(static_cast<Uint8 *>(strip_->pixels)
+                + static_cast<std::size_t>(strip_y_) * strip_->pitch,
+            rgba, static_cast<std::size_t>(level_.w) * 4);
+        ++strip_y_;
+        ++y_;
+        if (strip_y_ == kTileSize || y_ == level_.h) flushStrip();
+    }
+
+    bool done() const { return ok_ && y_ == level_.h; }
+
+    Level release()
+    {
+        strip_ = nullptr;
+        return std::move(level_);
+    }
+
+  private:
+    void flushStrip()
+    {
+        const Image_utils::PixelLayout rgba = Image_utils::PixelLayout::rgba32();
+        for (int x = 0; x < level_.w && ok_; x += kTileSize) {
+            const int w = std::min(kTileSize, level_.w - x);
+            SDLSurfaceUniquePtr view
+                = createView(strip_.get(), x, 0, w, strip_y_, rgba);
+            // Converts to the tile layout.
+            SDLSurfaceUniquePtr tile = view != nullptr
+                ? Image_utils::scale(view.get(), w, strip_y_, layout_)
+                : nullptr;
+            ok_ = tile != nullptr;
+            level_.tiles.push_back(std::move(tile));
+        }
+        strip_y_ = 0;
+    }
+
+    Image_utils::PixelLayout layout_;
+    Level level_;
+    SDLSurfaceUniquePtr strip_;
+    int strip_y_ = 0;
+    int y_ = 0;
+    bool ok_ = false;
+};
+
+std::unique_ptr<TiledImage> TiledImage::load(const std::string &path,
+    std::size_t max_bytes, const Image_utils::PixelLayout &layout)
+{
+    const double bytes_per_pixel = layout.bpp / 8;
+    const auto target_size = [max_bytes, bytes_per_pixel](
+                                 int w, int h, int *target_w, int *target_h) {
+        // The mip levels take another third.
+        int factor = 1;
+        while (factor < std::min(w, h)
+            && static_cast<double>(w / factor) * (h / factor) * bytes_per_pixel
+                    * 4 / 3
+                > max_bytes)
+            ++factor;
+        *target_w = std::max(1, w / factor);
+        *target_h = std::max(1, h / factor);
+    };
+
+    LevelBuilder builder(layout);
+    int orig_w, orig_h;
+    if (!Image_utils::decodeReducedRows(
+            path, target_size, max_bytes, builder, &orig_w, &orig_h)
+        || !builder.done()) {
+        // Other formats are decoded in full by SDL_image, within the same
+        // budget.
+        SDLSurfaceUniquePtr img = Image_utils::loadFull(path, max_bytes);
+        if (img == nullptr) {
+            SDL_ClearError();
+            return nullptr;
+        }
+        orig_w = img->w;
+        orig_h = img->h;
+        int w, h;
+        target_size(orig_w, orig_h, &w, &h);
+        SDLSurfaceUniquePtr rgba = Image_utils::scale(
+            img.get(), w, h, Image_utils::PixelLayout::rgba32());
+        img = nullptr;
+        if (rgba == nullptr || !builder.begin(w, h)) return nullptr;
+        for (int y = 0; y < h; ++y) {
+            builder.addRow(static_cast<const unsigned char *>(rgba->pixels)
+                + static_cast<std::size_t>(y) * rgba->pitch);
+        }
+        if (!builder.done()) return nullptr;
+    }
+
+    std::unique_ptr<TiledImage> image { new TiledImage(orig_w, orig_h, layout) };
+    image->levels_.push_back(builder.release());
+    while (image->levels_.back().w > kTileSize
+        || image->levels_.back().h > kTileSize) {
+        if (!image->addHalfLevel()) break;
+    }
+    return image;
+}
+
+bool TiledImage::addHalfLevel()
+{
+    const Level &src = levels_.back();
+    Level level;
+    level.w = std::max(1, (src.w + 1) / 2);
+    level.h = std::max(1, (src.h + 1) / 2);
+    level.columns = (level.w + kTileSize - 1) / kTileSize;
+    level.rows = (level.h + kTileSize - 1) / kTileSize;
+    level.tiles.reserve(static_cast<std::size_t>(level.columns) * level.rows);
+
+    // Each new tile is made from 2x2 tiles of the previous level,
+    // gathered into `block` first.
+    SDLSurfaceUniquePtr block
+        = createSurface(2 * kTileSize, 2 * kTileSize, layout_);
+    if (block == nullptr) return false;
+    const int bytes_per_pixel = layout_.bpp / 8;
+    for (int row = 0; row < level.rows; ++row) {
+        for (int column = 0; column < level.columns; ++column) {
+            int block_w = 0, block_h = 0;
+            for (int dy = 0; dy < 2; ++dy) {
+                for (int dx = 0; dx < 2; ++dx) {
+                    const int src_column = 2 * column + dx;
+                    const int src_row = 2 * row + dy;
+                    if (src_column >= src.columns || src_row >= src.rows)
+                        continue;
+                    const SDL_Surface *tile = src.tiles[
+                        static_cast<std::size_t>(src_row) * src.columns
+                        + src_column].get();
+                    for (int y = 0; y < tile->h; ++y) {
+                        std::memcpy(static_cast<Uint8 *>(block->pixels)
+                                + static_cast<std::size_t>(dy * kTileSize + y)
+                                    * block->pitch
+                                + dx * kTileSize * bytes_per_pixel,
+                            static_cast<const Uint8 *>(tile->pixels)
+                                + static_cast<std::size_t>(y) * tile->pitch,
+                            static_cast<std::size_t>(tile->w)
+                                * bytes_per_pixel);
+                    }
+                    block_w = std::max(block_w, dx * kTileSize + tile->w);
+                    block_h = std::max(block_h, dy * kTileSize + tile->h);
+                }
+            }
+            SDLSurfaceUniquePtr view
+                = createView(block.get(), 0, 0, block_w, block_h, layout_);
+            if (view == nullptr) return false;
+            SDLSurfaceUniquePtr tile = Image_utils::scale(view.get(),
+                std::min(kTileSize, level.w - column * kTileSize),
+                std::min(kTileSize, level.h - row * kTileSize), layout_);
+            if (tile == nullptr) return false;
+            level.tiles.push_back(std::move(tile));
+        }
+    }
+    levels_.push_back(std::move(level));
+    return true;
+}
+
+void TiledImage::render(SDL_Surface *dst, const SDL_Rect &viewport,
+    double zoom_x, double zoom_y, double center_x, double center_y)
+{
+    std::size_t index = 0;
+    while (index + 1 < levels_.size()
+        && levels_[index + 1].w >= width_ * zoom_x
+        && levels_[index + 1].h >= height_ * zoom_y)
+        ++index;
+    const Level &level = levels_[index];
+
+    // Physical pixels per level pixel.
+    const double scale_x = zoom_x * width_ / level.w;
+    const double scale_y = zoom_y * height_ / level.h;
+    if (index != scaled_level_ || scale_x != scaled_zoom_x_
+        || scale_y != scaled_zoom_y_) {
+        scaled_.clear();
+        scaled_level_ = index;
+        scaled_zoom_x_ = scale_x;
+        scaled_zoom_y_ = scale_y;
+    }
+    for (auto &entry : scaled_) entry.second.used = false;
+
+    // Position of the level's top-left corner on the destination surface.
+    const long origin_x = viewport.x
+        + std::lround(viewport.w / 2.0 - center_x * zoom_x);
+    const long origin_y = viewport.y
+        + std::lround(viewport.h / 2.0 - center_y * zoom_y);
+    const double tile_w = kTileSize * scale_x;
+    const double tile_h = kTileSize * scale_y;
+    const int first_column = std::max(0,
+        static_cast<int>(std::floor((viewport.x - origin_x) / tile_w)));
+    const int last_column = std::min(level.columns - 1,
+        static_cast<int>(
+            std::floor((viewport.x + viewport.w - 1 - origin_x) / tile_w)));
+    const int first_row = std::max(0,
+        static_cast<int>(std::floor((viewport.y - origin_y) / tile_h)));
+    const int last_row = std::min(level.rows - 1,
+        static_cast<int>(
+            std::floor((viewport.y + viewport.h - 1 - origin_y) / tile_h)));
+
+    SDL_Rect old_clip;
+    SDL_GetClipRect(dst, &old_clip);
+    SDL_Rect clip = viewport;
+    SDL_SetClipRect(dst, &clip);
+    for (int row = first_row; row <= last_row; ++row) {
+        for (int column = first_column; column <= last_column; ++column) {
+            const std::size_t i
+                = static_cast<std::size_t>(row) * level.columns + column;
+            SDL_Surface *tile = level.tiles[i].get();
+            // Rounding both edges the same way keeps the tiles seamless.
+            const long x0 = std::lround(column * kTileSize * scale_x);
+            const long x1 = std::lround((column * kTileSize + tile->w) * scale_x);
+            const long y0 = std::lround(row * kTileSize * scale_y);
+            const long y1 = std::lround((row * kTileSize + tile->h) * scale_y);
+            if (x1 <= x0 || y1 <= y0) continue;
+            SDL_Surface *surface = tile;
+            if (x1 - x0 != tile->w || y1 - y0 != tile->h) {
+                ScaledTile &scaled = scaled_[i];
+                if (scaled.surface == nullptr) {
+                    scaled.surface = Image_utils::scale(tile,
+                        static_cast<int>(x1 - x0), static_cast<int>(y1 - y0),
+                        layout_);
+                }
+                scaled.used = true;
+                surface = scaled.surface.get();
+                if (surface == nullptr) continue;
+            }
+            SDL_utils::applyPpuScaledSurface(
+                origin_x + x0, origin_y + y0, surface, dst);
+        }
+    }
+    SDL_SetClipRect(dst, &old_clip);
+
+    for (auto it = scaled_.begin(); it != scaled_.end();) {
+        if (it->second.used)
+            ++it;
+        else
+            it = scaled_.erase(it);
+    }
+}
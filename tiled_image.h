@@ -0,0 +1,87 @@
+#ifndef TILED_IMAGE_H_
+#define TILED_IMAGE_H_
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <SDL.h>
+
+#include "image_scaler.h"
+#include "sdl_ptrs.h"
+
+/**
+ * @brief A decoded image split into tiles, with mip levels that are each
+ * half the size of the previous one.
+ *
+ * Drawing a zoomed view only scales the tiles that intersect the viewport,
+ * from the smallest level that is at least as large as the zoomed image.
+ * The scaled tiles are kept while the zoom does not change, so panning only
+ * scales the tiles that come into view. At 1:1 the tiles are drawn as is.
+ */
+class TiledImage {
+  public:
+    static constexpr int kTileSize = 128;
+
+    // Decodes the image at full resolution, or at a reduced resolution if
+    // its tiles would take more than `max_bytes`. Tiles use `layout`.
+    // Returns nullptr if the image cannot be decoded.
+    //
+    // Can be called from any thread.
+    static std::unique_ptr<TiledImage> load(const std::string &path,
+        std::size_t max_bytes, const Image_utils::PixelLayout &layout);
+
+    TiledImage(const TiledImage &) = delete;
+    TiledImage &operator=(const TiledImage &) = delete;
+
+    // Size of the original image.
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    // Draws the image clipped to the viewport, at the given zoom (physical
+    // pixels per original pixel), so that the given point of the original
+    // image is at the center of the viewport.
+    //
+    // Must be called from the main thread.
+    void render(SDL_Surface *dst, const SDL_Rect &viewport, double zoom_x,
+        double zoom_y, double center_x, double center_y);
+
+  private:
+    class LevelBuilder;
+
+    struct Level {
+        int w, h;
+        int columns, rows;
+        // Row-major.
+        std::vector<SDLSurfaceUniquePtr> tiles;
+    };
+
+    TiledImage(int width, int height, const Image_utils::PixelLayout &layout)
+        : width_(width)
+        , height_(height)
+        , layout_(layout)
+    {
+    }
+
+    // Adds a level half the size of the last one.
+    bool addHalfLevel();
+
+    int width_;
+    int height_;
+    Image_utils::PixelLayout layout_;
+    std::vector<Level> levels_;
+
+    // The tiles of `scaled_level_` scaled for the last frame, by index.
+    struct ScaledTile {
+        SDLSurfaceUniquePtr surface;
+        bool used;
+    };
+    std::map<std::size_t, ScaledTile> scaled_;
+    std::size_t scaled_level_ = 0;
+    double scaled_zoom_x_ = 0;
+    double scaled_zoom_y_ = 0;
+};
+
+#endif // TILED_IMAGE_H_
@@ -29,4 +29,72 @@ void replaceTabsWithSpaces(std::string *line, std::size_t tab_width)
     *line = std::move(result);
 }
 
+std::vector<std::size_t> tabExpandedOffsets(
+    const std::string &line, std::size_t tab_width)
+{
+    std::vector<std::size_t> offsets(line.size() + 1);
+    std::size_t column = 0;
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < line.size();) {
+        if (line[i] == '\t') {
+            offsets[i++] = offset;
+            const std::size_t num_spaces = tab_width - (column % tab_width);
+            offset += num_spaces;
+            column += num_spaces;
+            continue;
+        }
+        const std::size_t len
+            = std::min(codePointLen(line.data() + i), line.size() - i);
+        for (std::size_t k = 0; k < len; ++k) offsets[i + k] = offset + k;
+        i += len;
+        offset += len;
+        ++column;
+    }
+    offsets[line.size()] = offset;
+    return offsets;
+}
+
+void removePartialCodePoint(std::string *s)
+{
+    std::size_t lead = s->size();
+    while (lead > 0 && s->size() - lead < 4 && isTrailByte((*s)[lead - 1]))
+        --lead;
+    if (lead == 0) return;
+    --lead;
+    const unsigned char lead_byte = static_cast<unsigned char>((*s)[lead]);
+    if (lead_byte >= 0xC0 && s->size() - lead < codePointLen(&(*s)[lead]))
+        s->resize(lead);
+}
+
+char32_t decodeCodePoint(const char *src, std::size_t len)
+{
+    constexpr char32_t kReplacementCharacter = 0xFFFD;
+    if (len < codePointLen(src)) return kReplacementCharacter;
+    // The bits of the lead byte that are part of the code point.
+    static const unsigned char kLeadMask[] = { 0, 0x7F, 0x1F, 0x0F, 0x07 };
+    char32_t code_point = static_cast<unsigned char>(*src) & kLeadMask[len];
+    for (std::size_t i = 1; i < len; ++i)
+        code_point = (code_point << 6) | (src[i] & 0x3F);
+    return code_point > 0x10FFFF ? kReplacementCharacter : code_point;
+}
+
+void appendCodePoint(char32_t code_point, std::string *out)
+{
+    if (code_point < 0x80) {
+        out->push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+        out->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+        out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+        out->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+        out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else {
+        out->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+        out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+}
+
 } // namespace utf8
@@ -1,7 +1,9 @@
 #ifndef UTF8_H_
 #define UTF8_H_
 
+#include <cstddef>
 #include <string>
+#include <vector>
 
 namespace utf8 {
 
@@ -15,6 +17,22 @@ inline bool isTrailByte(char x) { return static_cast<signed char>(x) < -0x40; }
 
 void replaceTabsWithSpaces(std::string *line, std::size_t tab_width = 4);
 
+// The byte offsets in `line` after `replaceTabsWithSpaces` of each byte
+// offset in it, including the end.
+std::vector<std::size_t> tabExpandedOffsets(
+    const std::string &line, std::size_t tab_width = 4);
+
+// Removes the code point at the end of `s` if it is incomplete, e.g. after
+// `s` has been cut to a number of bytes.
+void removePartialCodePoint(std::string *s);
+
+// Decodes the `len` bytes at `src`, at most `codePointLen(src)`.
+// Returns U+FFFD if the sequence is truncated or out of range.
+char32_t decodeCodePoint(const char *src, std::size_t len);
+
+// Appends the UTF-8 encoding of the code point.
+void appendCodePoint(char32_t code_point, std::string *out);
+
 // Remove the leading UTF-8 byte order mark.
 // See https://en.wikipedia.org/wiki/Byte_order_mark
 inline void removeBom(std::string *s)
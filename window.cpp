@@ -20,12 +20,14 @@ CWindow::CWindow(void)
 {
     // Add window to the lists for render
     Globals::g_windows.push_back(this);
+    SDL_utils::invalidateRenderCache();
 }
 
 CWindow::~CWindow(void)
 {
     // Remove last window
     Globals::g_windows.pop_back();
+    SDL_utils::invalidateRenderCache();
 }
 
 namespace
@@ -260,6 +262,7 @@ bool CWindow::handleZoomTrigger(const SDL_Event &event)
 }
 
 void CWindow::triggerOnResize() {
+    SDL_utils::invalidateRenderCache();
     CResourceManager::instance().onResize();
     for (auto *window : Globals::g_windows) window->onResize();
 }
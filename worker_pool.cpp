@@ -0,0 +1,51 @@
+#include "worker_pool.h"
+
+#include <utility>
+
+WorkerPool::WorkerPool(std::size_t num_threads)
+{
+    threads_.reserve(num_threads);
+    for (std::size_t i = 0; i < num_threads; ++i)
+        threads_.emplace_back(&WorkerPool::run, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        tasks_.clear();
+    }
+    cv_.notify_all();
+    for (auto &thread : threads_) thread.join();
+}
+
+void WorkerPool::enqueue(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+}
+
+void WorkerPool::clearPending()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.clear();
+}
+
+void WorkerPool::run()
+{
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+            if (stop_) return;
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
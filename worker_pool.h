@@ -0,0 +1,41 @@
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A fixed number of threads running tasks in FIFO order.
+ *
+ * Tasks that have not started yet are discarded on destruction.
+ * The destructor waits for the running tasks to finish.
+ */
+class WorkerPool {
+  public:
+    explicit WorkerPool(std::size_t num_threads = 1);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    void enqueue(std::function<void()> task);
+
+    // Discards all the tasks that have not started yet.
+    void clearPending();
+
+  private:
+    void run();
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> tasks_;
+    bool stop_ = false;
+    std::vector<std::thread> threads_;
+};
+
+#endif // WORKER_POOL_H_
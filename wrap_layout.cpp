@@ -0,0 +1,112 @@
+#include "wrap_layout.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+constexpr std::size_t kMaxRows = std::numeric_limits<std::uint16_t>::max();
+
+inline std::size_t lowestBit(std::size_t i) { return i & (~i + 1); }
+
+} // namespace
+
+void WrapLayout::reset(std::size_t num_lines)
+{
+    rows_.assign(num_lines, 1);
+    measured_.assign(num_lines, false);
+    rebuild();
+}
+
+void WrapLayout::resize(std::size_t num_lines)
+{
+    if (num_lines < rows_.size()) {
+        rows_.resize(num_lines);
+        measured_.resize(num_lines);
+        rebuild();
+        return;
+    }
+    while (rows_.size() < num_lines) {
+        // The new node covers the lines (i - lowestBit(i), i].
+        const std::size_t i = rows_.size() + 1;
+        rows_.push_back(1);
+        measured_.push_back(false);
+        tree_.push_back(static_cast<std::uint32_t>(
+            1 + firstRow(i - 1) - firstRow(i - lowestBit(i))));
+    }
+}
+
+void WrapLayout::setRows(std::size_t line, std::size_t rows)
+{
+    rows = std::min(std::max<std::size_t>(rows, 1), kMaxRows);
+    measured_[line] = true;
+    if (rows == rows_[line]) return;
+    add(line, static_cast<std::int64_t>(rows) - rows_[line]);
+    rows_[line] = static_cast<std::uint16_t>(rows);
+}
+
+void WrapLayout::invalidateAll()
+{
+    measured_.assign(measured_.size(), false);
+}
+
+void WrapLayout::insertLine(std::size_t line)
+{
+    rows_.insert(rows_.begin() + line, 1);
+    measured_.insert(measured_.begin() + line, false);
+    rebuild();
+}
+
+void WrapLayout::eraseLine(std::size_t line)
+{
+    rows_.erase(rows_.begin() + line);
+    measured_.erase(measured_.begin() + line);
+    rebuild();
+}
+
+std::size_t WrapLayout::firstRow(std::size_t line) const
+{
+    std::size_t sum = 0;
+    for (std::size_t i = line; i > 0; i -= lowestBit(i)) sum += tree_[i - 1];
+    return sum;
+}
+
+std::size_t WrapLayout::lineAt(std::size_t row, std::size_t *row_in_line) const
+{
+    if (rows_.empty()) {
+        *row_in_line = 0;
+        return 0;
+    }
+    // Finds the last line whose first row is at most `row`.
+    std::size_t line = 0;
+    std::size_t step = 1;
+    while (step * 2 <= tree_.size()) step *= 2;
+    for (; step > 0; step /= 2) {
+        if (line + step <= tree_.size() && tree_[line + step - 1] <= row) {
+            line += step;
+            row -= tree_[line - 1];
+        }
+    }
+    if (line >= rows_.size()) {
+        line = rows_.size() - 1;
+        row = rows_[line] - 1;
+    }
+    *row_in_line = row;
+    return line;
+}
+
+void WrapLayout::add(std::size_t line, std::int64_t delta)
+{
+    for (std::size_t i = line + 1; i <= tree_.size(); i += lowestBit(i))
+        tree_[i - 1] = static_cast<std::uint32_t>(tree_[i - 1] + delta);
+}
+
+void WrapLayout::rebuild()
+{
+    // O(n): each node adds itself to its parent.
+    tree_.assign(rows_.begin(), rows_.end());
+    for (std::size_t i = 1; i <= tree_.size(); ++i) {
+        const std::size_t parent = i + lowestBit(i);
+        if (parent <= tree_.size()) tree_[parent - 1] += tree_[i - 1];
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef WRAP_LAYOUT_H_
+#define WRAP_LAYOUT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief The number of display rows of each line of wrapped text, with
+ * their prefix sums in a Fenwick tree.
+ *
+ * Measuring the rows of a line requires laying it out, so the lines are
+ * measured lazily, as they are shown. Lines that have not been measured
+ * count as a single row. Finding the line at a given row, or the first row
+ * of a given line, is O(log n).
+ */
+class WrapLayout {
+  public:
+    // Forgets all the lines and adds `num_lines` unmeasured ones.
+    void reset(std::size_t num_lines);
+
+    std::size_t numLines() const { return rows_.size(); }
+
+    // Adds unmeasured lines at the end, or removes lines from the end.
+    void resize(std::size_t num_lines);
+
+    bool measured(std::size_t line) const { return measured_[line]; }
+    std::size_t rows(std::size_t line) const { return rows_[line]; }
+    void setRows(std::size_t line, std::size_t rows);
+
+    // Marks the line as unmeasured, e.g. after it has been edited.
+    // Its last known number of rows is kept until it is measured again.
+    void invalidate(std::size_t line) { measured_[line] = false; }
+    // Marks all the lines as unmeasured, e.g. after a resize.
+    void invalidateAll();
+
+    // Adds an unmeasured line before `line`, or removes `line`.
+    // Both are O(n), but nothing is measured.
+    void insertLine(std::size_t line);
+    void eraseLine(std::size_t line);
+
+    // The index of the first row of the line.
+    std::size_t firstRow(std::size_t line) const;
+    std::size_t numRows() const { return firstRow(rows_.size()); }
+
+    // Returns the line that contains the given row, or the last line if
+    // there are fewer rows, and the index of the row within that line.
+    std::size_t lineAt(std::size_t row, std::size_t *row_in_line) const;
+
+  private:
+    // Adds `delta` to the rows of the line in the tree.
+    void add(std::size_t line, std::int64_t delta);
+    void rebuild();
+
+    // Capped, as the rows are only used for the prefix sums.
+    std::vector<std::uint16_t> rows_;
+    std::vector<bool> measured_;
+    // 1-based Fenwick tree over `rows_`.
+    std::vector<std::uint32_t> tree_;
+};
+
+#endif // WRAP_LAYOUT_H_